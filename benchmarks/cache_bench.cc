@@ -0,0 +1,98 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "benchmark/benchmark.h"
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+namespace {
+
+// Enough entries to spread over every shard.  The caches are twice as
+// large, so that every shard has room for its entries.
+constexpr int kNumKeys = 100000;
+
+enum CacheType { kLRU, kClock };
+
+void DeleteNothing(const Slice& key, void* value) {}
+
+std::string MakeKey(uint32_t k) {
+  std::string result;
+  PutFixed32(&result, k);
+  return result;
+}
+
+// Return a cache of the given type and shard count holding kNumKeys
+// entries.  Caches are shared by all threads and all runs of a benchmark.
+Cache* GetCache(CacheType type, int num_shard_bits) {
+  static port::Mutex mu;
+  static std::map<std::pair<int, int>, Cache*>* caches =
+      new std::map<std::pair<int, int>, Cache*>;
+  MutexLock l(&mu);
+  Cache*& cache = (*caches)[std::make_pair(type, num_shard_bits)];
+  if (cache == nullptr) {
+    cache = (type == kLRU) ? NewLRUCache(2 * kNumKeys, num_shard_bits)
+                           : NewClockCache(2 * kNumKeys, num_shard_bits);
+    for (uint32_t k = 0; k < kNumKeys; k++) {
+      cache->Release(cache->Insert(MakeKey(k), nullptr, 1, &DeleteNothing));
+    }
+  }
+  return cache;
+}
+
+// Lookup() and Release() hits from state.threads threads at once.
+void BM_CacheLookup(benchmark::State& state, CacheType type) {
+  Cache* cache = GetCache(type, state.range(0));
+  Random rnd(static_cast<uint32_t>(
+      std::hash<std::thread::id>()(std::this_thread::get_id())));
+  char key[4];
+  for (auto _ : state) {
+    EncodeFixed32(key, rnd.Uniform(kNumKeys));
+    Cache::Handle* handle = cache->Lookup(Slice(key, sizeof(key)));
+    if (handle == nullptr) {
+      state.SkipWithError("cache miss");
+      break;
+    }
+    cache->Release(handle);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_LRUCacheLookup(benchmark::State& state) {
+  BM_CacheLookup(state, kLRU);
+}
+
+void BM_ClockCacheLookup(benchmark::State& state) {
+  BM_CacheLookup(state, kClock);
+}
+
+// Argument: number of shard bits.
+BENCHMARK(BM_LRUCacheLookup)
+    ->Arg(0)
+    ->Arg(4)
+    ->Arg(6)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+BENCHMARK(BM_ClockCacheLookup)
+    ->Arg(0)
+    ->Arg(4)
+    ->Arg(6)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+
+}  // namespace
+
+}  // namespace leveldb
+
+BENCHMARK_MAIN();
@@ -13,6 +13,7 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/persistent_cache.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
 #include "util/crc32c.h"
@@ -100,9 +101,30 @@ static int FLAGS_block_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Fraction of the cache reserved for entries that were read more than
+// once (see NewLRUCache).  Zero means plain LRU.
+static double FLAGS_cache_young_ratio = 0;
+
+// Number of bytes to use as a cache of blocks dropped from the block cache,
+// kept in compressed form.  Negative means no such cache.
+static int FLAGS_compressed_cache_size = -1;
+
+// If non-null, keep blocks dropped from the block cache in a persistent
+// cache of FLAGS_persistent_cache_size bytes in this directory.
+static const char* FLAGS_persistent_cache = nullptr;
+static int FLAGS_persistent_cache_size = 256 << 20;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
+// Bytes of parsed table metadata to cache apart from the open files.
+// Zero means each open file keeps its own metadata.
+static int FLAGS_table_metadata_cache_size = 0;
+
+// Number of threads that open the tables at DB::Open (zero opens each
+// table on first use).
+static int FLAGS_max_file_opening_threads = 0;
+
 // Bloom filter bits per key.
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
@@ -118,17 +140,87 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, write out memtables in a thread of their own.
+static bool FLAGS_separate_flush_thread = false;
+
+// If non-zero, start a new MANIFEST once it holds this many bytes.
+static int FLAGS_max_manifest_file_size = 0;
+
+// Number of threads that replay the logs when the database is opened.
+static int FLAGS_wal_recovery_threads = 1;
+
+// Number of obsolete log files to keep for reuse by new logs.
+static int FLAGS_recycle_log_file_num = 0;
+
+// Microseconds a sync write may wait for other writers to share its log
+// sync (zero disables group commit waits).
+static int FLAGS_group_commit_window = 0;
+
+// If true, leave log records buffered until the log is flushed.
+static bool FLAGS_manual_wal_flush = false;
+
+// Microseconds between background log flushes with --manual_wal_flush
+// (zero flushes only when the buffer fills up).
+static int FLAGS_wal_flush_interval = 0;
+
+// If true, writes skip the log.
+static bool FLAGS_disable_wal = false;
+
+// If true, compress log records.
+static bool FLAGS_wal_compression = false;
+
 // If true, use compression.
 static bool FLAGS_compression = true;
 
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
+// If non-null, keep the log files in this directory.
+static const char* FLAGS_wal_dir = nullptr;
+
+// If non-null, a comma-separated list of path:target_size pairs to keep
+// the tables in, e.g. "/fast/db:100000000,/slow/db:100000000000".
+static const char* FLAGS_db_paths = nullptr;
+
 namespace leveldb {
 
 namespace {
 leveldb::Env* g_env = nullptr;
 
+// Set the directories of the benchmark db from the flags.
+void SetPathOptions(Options* options) {
+  if (FLAGS_wal_dir != nullptr) {
+    options->wal_dir = FLAGS_wal_dir;
+  }
+  if (FLAGS_db_paths != nullptr) {
+    std::string list = FLAGS_db_paths;
+    size_t start = 0;
+    while (start < list.size()) {
+      size_t end = list.find(',', start);
+      if (end == std::string::npos) {
+        end = list.size();
+      }
+      const std::string entry = list.substr(start, end - start);
+      const size_t colon = entry.rfind(':');
+      if (colon == std::string::npos) {
+        std::fprintf(stderr, "Invalid db path '%s'\n", entry.c_str());
+        std::exit(1);
+      }
+      options->db_paths.emplace_back(
+          entry.substr(0, colon),
+          std::strtoull(entry.c_str() + colon + 1, nullptr, 10));
+      start = end + 1;
+    }
+  }
+}
+
+// Options that let DestroyDB() find every file of the benchmark db.
+Options DestroyOptions() {
+  Options options;
+  SetPathOptions(&options);
+  return options;
+}
+
 class CountComparator : public Comparator {
  public:
   CountComparator(const Comparator* wrapped) : wrapped_(wrapped) {}
@@ -372,6 +464,8 @@ struct ThreadState {
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* compressed_cache_;
+  PersistentCache* persistent_cache_;
   const FilterPolicy* filter_policy_;
   DB* db_;
   int num_;
@@ -463,7 +557,13 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
+      : cache_(FLAGS_cache_size >= 0
+                   ? NewLRUCache(FLAGS_cache_size, 4, FLAGS_cache_young_ratio)
+                   : nullptr),
+        compressed_cache_(FLAGS_compressed_cache_size >= 0
+                              ? NewLRUCache(FLAGS_compressed_cache_size)
+                              : nullptr),
+        persistent_cache_(nullptr),
         filter_policy_(FLAGS_bloom_bits >= 0
                            ? NewBloomFilterPolicy(FLAGS_bloom_bits)
                            : nullptr),
@@ -483,13 +583,25 @@ class Benchmark {
       }
     }
     if (!FLAGS_use_existing_db) {
-      DestroyDB(FLAGS_db, Options());
+      DestroyDB(FLAGS_db, DestroyOptions());
+    }
+    if (FLAGS_persistent_cache != nullptr) {
+      Status s = NewPersistentCache(g_env, FLAGS_persistent_cache,
+                                    FLAGS_persistent_cache_size,
+                                    &persistent_cache_);
+      if (!s.ok()) {
+        std::fprintf(stderr, "persistent cache error: %s\n",
+                     s.ToString().c_str());
+        std::exit(1);
+      }
     }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete compressed_cache_;
+    delete persistent_cache_;
     delete filter_policy_;
   }
 
@@ -515,6 +627,7 @@ class Benchmark {
       value_size_ = FLAGS_value_size;
       entries_per_batch_ = 1;
       write_options_ = WriteOptions();
+      write_options_.disable_wal = FLAGS_disable_wal;
 
       void (Benchmark::*method)(ThreadState*) = nullptr;
       bool fresh_db = false;
@@ -600,7 +713,7 @@ class Benchmark {
         } else {
           delete db_;
           db_ = nullptr;
-          DestroyDB(FLAGS_db, Options());
+          DestroyDB(FLAGS_db, DestroyOptions());
           Open();
         }
       }
@@ -765,6 +878,8 @@ class Benchmark {
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.compressed_block_cache = compressed_cache_;
+    options.persistent_cache = persistent_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
@@ -772,8 +887,20 @@ class Benchmark {
       options.comparator = &count_comparator_;
     }
     options.max_open_files = FLAGS_open_files;
+    options.table_metadata_cache_size = FLAGS_table_metadata_cache_size;
+    options.max_file_opening_threads = FLAGS_max_file_opening_threads;
     options.filter_policy = filter_policy_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.separate_flush_thread = FLAGS_separate_flush_thread;
+    options.max_manifest_file_size = FLAGS_max_manifest_file_size;
+    options.wal_recovery_threads = FLAGS_wal_recovery_threads;
+    options.recycle_log_file_num = FLAGS_recycle_log_file_num;
+    options.group_commit_window_micros = FLAGS_group_commit_window;
+    options.manual_wal_flush = FLAGS_manual_wal_flush;
+    options.wal_flush_interval_micros = FLAGS_wal_flush_interval;
+    options.wal_compression =
+        FLAGS_wal_compression ? kSnappyCompression : kNoCompression;
+    SetPathOptions(&options);
     options.compression =
         FLAGS_compression ? kSnappyCompression : kNoCompression;
     Status s = DB::Open(options, FLAGS_db, &db_);
@@ -1050,6 +1177,13 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--separate_flush_thread=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_separate_flush_thread = n;
+    } else if (sscanf(argv[i], "--max_manifest_file_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_max_manifest_file_size = n;
     } else if (sscanf(argv[i], "--compression=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_compression = n;
@@ -1071,12 +1205,57 @@ int main(int argc, char** argv) {
       FLAGS_key_prefix = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--cache_young_ratio=%lf%c", &d, &junk) == 1 &&
+               d >= 0 && d < 1) {
+      FLAGS_cache_young_ratio = d;
+    } else if (sscanf(argv[i], "--compressed_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_compressed_cache_size = n;
+    } else if (strncmp(argv[i], "--persistent_cache=", 19) == 0) {
+      FLAGS_persistent_cache = argv[i] + 19;
+    } else if (sscanf(argv[i], "--persistent_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_persistent_cache_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--wal_recovery_threads=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_wal_recovery_threads = n;
+    } else if (sscanf(argv[i], "--recycle_log_file_num=%d%c", &n, &junk) ==
+                   1 &&
+               n >= 0) {
+      FLAGS_recycle_log_file_num = n;
+    } else if (sscanf(argv[i], "--group_commit_window=%d%c", &n, &junk) ==
+                   1 &&
+               n >= 0) {
+      FLAGS_group_commit_window = n;
+    } else if (sscanf(argv[i], "--manual_wal_flush=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_manual_wal_flush = n;
+    } else if (sscanf(argv[i], "--wal_flush_interval=%d%c", &n, &junk) ==
+                   1 &&
+               n >= 0) {
+      FLAGS_wal_flush_interval = n;
+    } else if (sscanf(argv[i], "--disable_wal=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_disable_wal = n;
+    } else if (sscanf(argv[i], "--wal_compression=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_wal_compression = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--table_metadata_cache_size=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_table_metadata_cache_size = n;
+    } else if (sscanf(argv[i], "--max_file_opening_threads=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_max_file_opening_threads = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
+    } else if (strncmp(argv[i], "--wal_dir=", 10) == 0) {
+      FLAGS_wal_dir = argv[i] + 10;
+    } else if (strncmp(argv[i], "--db_paths=", 11) == 0) {
+      FLAGS_db_paths = argv[i] + 11;
     } else {
       std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
       std::exit(1);
@@ -0,0 +1,94 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/blob_cache.h"
+
+#include "db/blob_file.h"
+#include "db/filename.h"
+#include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace leveldb {
+
+static void DeleteEntry(const Slice& key, void* value) {
+  delete reinterpret_cast<RandomAccessFile*>(value);
+}
+
+BlobCache::BlobCache(const std::string& dbname, const Options& options,
+                     int entries)
+    : env_(options.env), dbname_(dbname), cache_(NewLRUCache(entries)) {}
+
+BlobCache::~BlobCache() { delete cache_; }
+
+Status BlobCache::FindFile(uint64_t file_number, Cache::Handle** handle) {
+  Status s;
+  char buf[sizeof(file_number)];
+  EncodeFixed64(buf, file_number);
+  Slice key(buf, sizeof(buf));
+  *handle = cache_->Lookup(key);
+  if (*handle == nullptr) {
+    RandomAccessFile* file = nullptr;
+    s = env_->NewRandomAccessFile(BlobFileName(dbname_, file_number), &file);
+    if (s.ok()) {
+      *handle = cache_->Insert(key, file, 1, &DeleteEntry);
+    }
+    // We do not cache error results so that if the error is transient,
+    // or somebody repairs the file, we recover automatically.
+  }
+  return s;
+}
+
+Status BlobCache::Get(const BlobIndex& index, std::string* value) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindFile(index.file_number, &handle);
+  if (!s.ok()) {
+    return s;
+  }
+
+  RandomAccessFile* file =
+      reinterpret_cast<RandomAccessFile*>(cache_->Value(handle));
+  const size_t n = static_cast<size_t>(index.record_size());
+  char* buf = new char[n];
+  Slice contents;
+  s = file->Read(index.offset, n, &contents, buf);
+  cache_->Release(handle);
+  if (s.ok()) {
+    if (contents.size() != n) {
+      s = Status::Corruption("truncated blob record");
+    } else {
+      // Blob values are large, so checksums are always verified: the cost
+      // is small next to the read itself.
+      const char* data = contents.data();
+      const uint32_t crc = crc32c::Unmask(DecodeFixed32(data));
+      const uint32_t actual =
+          crc32c::Value(data + kBlobRecordHeaderSize, index.size);
+      if (actual != crc) {
+        s = Status::Corruption("blob checksum mismatch");
+      } else {
+        value->assign(data + kBlobRecordHeaderSize, index.size);
+      }
+    }
+  }
+  delete[] buf;
+  return s;
+}
+
+Status BlobCache::Get(const Slice& encoded_index, std::string* value) {
+  BlobIndex index;
+  Status s = index.DecodeFrom(encoded_index);
+  if (s.ok()) {
+    s = Get(index, value);
+  }
+  return s;
+}
+
+void BlobCache::Evict(uint64_t file_number) {
+  char buf[sizeof(file_number)];
+  EncodeFixed64(buf, file_number);
+  cache_->Erase(Slice(buf, sizeof(buf)));
+}
+
+}  // namespace leveldb
@@ -0,0 +1,54 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Thread-safe (provides internal synchronization)
+
+#ifndef STORAGE_LEVELDB_DB_BLOB_CACHE_H_
+#define STORAGE_LEVELDB_DB_BLOB_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/cache.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+struct BlobIndex;
+struct Options;
+
+// BlobCache keeps blob files open so that values stored in them can be
+// read without reopening the file for every lookup.
+class BlobCache {
+ public:
+  BlobCache(const std::string& dbname, const Options& options, int entries);
+
+  BlobCache(const BlobCache&) = delete;
+  BlobCache& operator=(const BlobCache&) = delete;
+
+  ~BlobCache();
+
+  // Read the value identified by "index" into *value.
+  Status Get(const BlobIndex& index, std::string* value);
+
+  // Decode the BlobIndex stored in "encoded_index" and read the value
+  // it identifies into *value.  "encoded_index" may point into *value.
+  Status Get(const Slice& encoded_index, std::string* value);
+
+  // Evict any entry for the specified file number
+  void Evict(uint64_t file_number);
+
+ private:
+  Status FindFile(uint64_t file_number, Cache::Handle**);
+
+  Env* const env_;
+  const std::string dbname_;
+  Cache* cache_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_BLOB_CACHE_H_
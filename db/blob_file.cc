@@ -0,0 +1,48 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/blob_file.h"
+
+#include "leveldb/env.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace leveldb {
+
+void BlobIndex::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, file_number);
+  PutVarint64(dst, offset);
+  PutVarint64(dst, size);
+}
+
+Status BlobIndex::DecodeFrom(const Slice& input) {
+  Slice in = input;
+  if (GetVarint64(&in, &file_number) && GetVarint64(&in, &offset) &&
+      GetVarint64(&in, &size) && in.empty()) {
+    return Status::OK();
+  }
+  return Status::Corruption("bad blob index");
+}
+
+BlobFileBuilder::BlobFileBuilder(WritableFile* file, uint64_t file_number)
+    : file_(file), file_number_(file_number), offset_(0) {}
+
+Status BlobFileBuilder::Add(const Slice& value, BlobIndex* index) {
+  char header[kBlobRecordHeaderSize];
+  EncodeFixed32(header,
+                crc32c::Mask(crc32c::Value(value.data(), value.size())));
+  Status s = file_->Append(Slice(header, sizeof(header)));
+  if (s.ok()) {
+    s = file_->Append(value);
+  }
+  if (s.ok()) {
+    index->file_number = file_number_;
+    index->offset = offset_;
+    index->size = value.size();
+    offset_ += index->record_size();
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Blob files hold values that are too large to be worth rewriting at every
+// compaction (see Options::min_blob_size).  A blob file is a sequence of
+// records:
+//
+//    record :=
+//       checksum: uint32     // masked crc32c of value
+//       value: uint8[n]
+//
+// The sstable entry for such a value has type kTypeBlobIndex and holds an
+// encoded BlobIndex that identifies the record.
+
+#ifndef STORAGE_LEVELDB_DB_BLOB_FILE_H_
+#define STORAGE_LEVELDB_DB_BLOB_FILE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class WritableFile;
+
+// Size of the header in front of every value in a blob file.
+static const int kBlobRecordHeaderSize = 4;
+
+// Location of a value stored in a blob file.
+struct BlobIndex {
+  BlobIndex() : file_number(0), offset(0), size(0) {}
+
+  // Number of bytes the record for this value occupies in its blob file.
+  uint64_t record_size() const { return kBlobRecordHeaderSize + size; }
+
+  void EncodeTo(std::string* dst) const;
+  Status DecodeFrom(const Slice& input);
+
+  uint64_t file_number;
+  uint64_t offset;  // Offset of the record within the file
+  uint64_t size;    // Size of the value
+};
+
+// Appends values to a blob file.
+class BlobFileBuilder {
+ public:
+  // Create a builder that will append values to "*file", which is the
+  // blob file numbered "file_number".  "*file" must be initially empty
+  // and must remain live while this builder is in use.
+  BlobFileBuilder(WritableFile* file, uint64_t file_number);
+
+  BlobFileBuilder(const BlobFileBuilder&) = delete;
+  BlobFileBuilder& operator=(const BlobFileBuilder&) = delete;
+
+  // Append "value" to the file and store its location in *index.
+  Status Add(const Slice& value, BlobIndex* index);
+
+  // Number of bytes appended so far.
+  uint64_t FileSize() const { return offset_; }
+
+ private:
+  WritableFile* const file_;
+  const uint64_t file_number_;
+  uint64_t offset_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_BLOB_FILE_H_
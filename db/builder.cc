@@ -4,6 +4,7 @@
 
 #include "db/builder.h"
 
+#include "db/blob_file.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/table_cache.h"
@@ -15,12 +16,18 @@
 namespace leveldb {
 
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  BlobFileMetaData* blob, CompressionPool* pool) {
   Status s;
   meta->file_size = 0;
+  if (blob != nullptr) {
+    blob->file_size = 0;
+  }
   iter->SeekToFirst();
 
-  std::string fname = TableFileName(dbname, meta->number);
+  std::string fname =
+      TableFileName(options.db_paths[meta->path_id].path, meta->number);
+  bool blob_file_created = false;
   if (iter->Valid()) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
@@ -28,20 +35,56 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
       return s;
     }
 
-    TableBuilder* builder = new TableBuilder(options, file);
+    const bool separate_values = (blob != nullptr && options.min_blob_size > 0);
+    WritableFile* blob_file = nullptr;
+    BlobFileBuilder* blob_builder = nullptr;
+    TableBuilder* builder = new TableBuilder(options, file, pool);
     meta->smallest.DecodeFrom(iter->key());
     Slice key;
+    std::string blob_key, blob_index;
     // 遍历迭代器，将KV对加入到一个TableBuilder对象里
     for (; iter->Valid(); iter->Next()) {
       key = iter->key();
-      builder->Add(key, iter->value());
+      const Slice value = iter->value();
+      ParsedInternalKey ikey;
+      if (separate_values && value.size() >= options.min_blob_size &&
+          ParseInternalKey(key, &ikey) && ikey.type == kTypeValue) {
+        // Move the value to the blob file and keep only its location
+        if (blob_builder == nullptr) {
+          s = env->NewWritableFile(BlobFileName(dbname, blob->number),
+                                   &blob_file);
+          if (!s.ok()) {
+            break;
+          }
+          blob_file_created = true;
+          blob_builder = new BlobFileBuilder(blob_file, blob->number);
+        }
+        BlobIndex index;
+        s = blob_builder->Add(value, &index);
+        if (!s.ok()) {
+          break;
+        }
+        blob_key.clear();
+        AppendInternalKey(&blob_key, ParsedInternalKey(ikey.user_key,
+                                                       ikey.sequence,
+                                                       kTypeBlobIndex));
+        blob_index.clear();
+        index.EncodeTo(&blob_index);
+        builder->Add(blob_key, blob_index);
+      } else {
+        builder->Add(key, value);
+      }
     }
     if (!key.empty()) {
       meta->largest.DecodeFrom(key);
     }
 
     // Finish and check for builder errors
-    s = builder->Finish();
+    if (s.ok()) {
+      s = builder->Finish();
+    } else {
+      builder->Abandon();
+    }
     if (s.ok()) {
       meta->file_size = builder->FileSize();
       assert(meta->file_size > 0);
@@ -58,10 +101,23 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     delete file;
     file = nullptr;
 
+    // The blob file must be durable before the table that refers to it
+    if (blob_builder != nullptr) {
+      if (s.ok()) {
+        blob->file_size = blob_builder->FileSize();
+        s = blob_file->Sync();
+      }
+      if (s.ok()) {
+        s = blob_file->Close();
+      }
+      delete blob_builder;
+      delete blob_file;
+    }
+
     if (s.ok()) {
       // Verify that the table is usable
-      Iterator* it = table_cache->NewIterator(ReadOptions(), meta->number,
-                                              meta->file_size);
+      Iterator* it = table_cache->NewIterator(
+          ReadOptions(), meta->number, meta->path_id, meta->file_size, 0);
       s = it->status();
       delete it;
     }
@@ -76,6 +132,10 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     // Keep it
   } else {
     env->RemoveFile(fname);
+    if (blob_file_created) {
+      env->RemoveFile(BlobFileName(dbname, blob->number));
+      blob->file_size = 0;
+    }
   }
   return s;
 }
@@ -10,8 +10,10 @@
 namespace leveldb {
 
 struct Options;
+struct BlobFileMetaData;
 struct FileMetaData;
 
+class CompressionPool;
 class Env;
 class Iterator;
 class TableCache;
@@ -22,8 +24,18 @@ class VersionEdit;
 // *meta will be filled with metadata about the generated table.
 // If no data is present in *iter, meta->file_size will be set to
 // zero, and no Table file will be produced.
+//
+// If "blob" is non-null and options.min_blob_size is non-zero, values of
+// at least that size are written to the blob file named according to
+// blob->number instead, and blob->file_size is set to the size of that
+// file.  If no such values are present blob->file_size will be set to
+// zero, and no blob file will be produced.
+//
+// Data blocks are compressed on the threads of "pool" if it is non-null
+// (see TableBuilder).
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  BlobFileMetaData* blob, CompressionPool* pool = nullptr);
 
 }  // namespace leveldb
 
@@ -8,10 +8,13 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "db/blob_cache.h"
+#include "db/blob_file.h"
 #include "db/builder.h"
 #include "db/db_iter.h"
 #include "db/dbformat.h"
@@ -19,16 +22,19 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
 #include "port/port.h"
 #include "table/block.h"
+#include "table/compression_pool.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
@@ -39,14 +45,23 @@ namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+// Number of blob files kept open by BlobCache.
+const int kNumBlobCacheFiles = 100;
+
+// Stored in a thread's slot of DBImpl::local_super_version_ while a read
+// uses the super version that was cached there.
+static char super_version_in_use;
+static void* const kSuperVersionInUse = &super_version_in_use;
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr), sync(false), disable_wal(false), done(false), cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
+  bool disable_wal;
   bool done;
   port::CondVar cv;
 };
@@ -55,6 +70,7 @@ struct DBImpl::CompactionState {
   // Files produced by compaction
   struct Output {
     uint64_t number;
+    uint32_t path_id;
     uint64_t file_size;
     InternalKey smallest, largest;
   };
@@ -66,7 +82,19 @@ struct DBImpl::CompactionState {
         smallest_snapshot(0),
         outfile(nullptr),
         builder(nullptr),
-        total_bytes(0) {}
+        total_bytes(0),
+        blob_number(0),
+        blob_outfile(nullptr),
+        blob_builder(nullptr) {}
+
+  // Record that the blob value referenced by "blob_index" is no longer
+  // referenced by the output of this compaction.
+  void AddBlobGarbage(const Slice& blob_index) {
+    BlobIndex index;
+    if (index.DecodeFrom(blob_index).ok()) {
+      blob_garbage[index.file_number] += index.record_size();
+    }
+  }
 
   Compaction* const compaction;
 
@@ -83,6 +111,15 @@ struct DBImpl::CompactionState {
   TableBuilder* builder;
 
   uint64_t total_bytes;
+
+  // Blob file receiving values moved out of blob files that are mostly
+  // garbage.  Opened lazily.
+  uint64_t blob_number;
+  WritableFile* blob_outfile;
+  BlobFileBuilder* blob_builder;
+
+  // Bytes of blob records that were dropped, per blob file
+  std::map<uint64_t, uint64_t> blob_garbage;
 };
 
 // Fix user-supplied options to be reasonable
@@ -94,7 +131,7 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
-                        const Options& src) {
+                        const Options& src, bool read_only) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
@@ -102,7 +139,21 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
-  if (result.info_log == nullptr) {
+  if (result.wal_dir.empty()) {
+    result.wal_dir = dbname;
+  }
+  if (result.db_paths.empty()) {
+    result.db_paths.emplace_back(dbname, UINT64_MAX);
+  }
+  if (result.recycle_log_file_num > 0) {
+    // A recycled log may end in stale records of its previous use, and
+    // records appended after those would be lost on the next recovery.
+    result.reuse_logs = false;
+  }
+  if (read_only) {
+    // Never reopen the MANIFEST or a log file for appending.
+    result.reuse_logs = false;
+  } else if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
     src.env->RenameFile(InfoLogFileName(dbname), OldInfoLogFileName(dbname));
@@ -123,39 +174,73 @@ static int TableCacheSize(const Options& sanitized_options) {
   return sanitized_options.max_open_files - kNumNonTableCacheFiles;
 }
 
-DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
+DBImpl::DBImpl(const Options& raw_options, const std::string& dbname,
+               OpenMode mode)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_, raw_options,
+                               mode != kOpenReadWrite)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
+      mode_(mode),
       table_cache_(new TableCache(dbname_, options_, TableCacheSize(options_))),
+      blob_cache_(new BlobCache(dbname_, options_, kNumBlobCacheFiles)),
+      compression_pool_(options_.compression_threads > 1 &&
+                                options_.table_format == kBlockTableFormat &&
+                                mode == kOpenReadWrite
+                            ? new CompressionPool(env_,
+                                                  options_.compression_threads)
+                            : nullptr),
       db_lock_(nullptr),
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
+      flush_work_signal_(&mutex_),
       mem_(nullptr),
       imm_(nullptr),
       has_imm_(false),
+      super_version_(nullptr),
+      super_version_number_(0),
+      local_super_version_(&UnrefCachedSuperVersion),
       logfile_(nullptr),
       logfile_number_(0),
       log_(nullptr),
+      first_recyclable_log_(0),
       seed_(0),
       tmp_batch_(new WriteBatch),
+      avg_log_sync_micros_(0),
+      last_sync_group_size_(0),
       background_compaction_scheduled_(false),
+      wal_flush_thread_running_(false),
+      flush_thread_running_(false),
+      ingesting_files_(false),
       manual_compaction_(nullptr),
-      versions_(new VersionSet(dbname_, &options_, table_cache_,
+      versions_(new VersionSet(dbname_, &options_, table_cache_, blob_cache_,
                                &internal_comparator_)) {}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  background_work_finished_signal_.SignalAll();  // Wake the log flusher
+  flush_work_signal_.Signal();
+  while (background_compaction_scheduled_ || wal_flush_thread_running_ ||
+         flush_thread_running_) {
     background_work_finished_signal_.Wait();
   }
+  std::vector<void*> cached;
+  local_super_version_.Scrape(&cached, nullptr);
+  for (void* sv : cached) {
+    if (sv != kSuperVersionInUse) {
+      UnrefSuperVersion(static_cast<SuperVersion*>(sv));
+    }
+  }
+  if (super_version_ != nullptr) {
+    UnrefSuperVersion(super_version_);
+    super_version_ = nullptr;
+  }
   mutex_.Unlock();
 
   if (db_lock_ != nullptr) {
@@ -169,6 +254,8 @@ DBImpl::~DBImpl() {
   delete log_;
   delete logfile_;
   delete table_cache_;
+  delete blob_cache_;
+  delete compression_pool_;
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -235,18 +322,36 @@ void DBImpl::RemoveObsoleteFiles() {
   std::set<uint64_t> live = pending_outputs_;
   versions_->AddLiveFiles(&live);
 
+  // Log files and tables may live in directories of their own, which
+  // hold no other files of the database.
+  std::vector<std::string> dirs(1, dbname_);
+  if (options_.wal_dir != dbname_) {
+    dirs.push_back(options_.wal_dir);
+  }
+  for (const DbPath& db_path : options_.db_paths) {
+    if (std::find(dirs.begin(), dirs.end(), db_path.path) == dirs.end()) {
+      dirs.push_back(db_path.path);
+    }
+  }
   std::vector<std::string> filenames;
-  env_->GetChildren(dbname_, &filenames);  // Ignoring errors on purpose
   uint64_t number;
   FileType type;
   std::vector<std::string> files_to_delete;
-  for (std::string& filename : filenames) {
-    if (ParseFileName(filename, &number, &type)) {
+  for (const std::string& dir : dirs) {
+    env_->GetChildren(dir, &filenames);  // Ignoring errors on purpose
+    for (const std::string& filename : filenames) {
+      if (!ParseFileName(filename, &number, &type) ||
+          (dir != dbname_ && type != kLogFile && type != kTableFile)) {
+        continue;
+      }
       bool keep = true;
       switch (type) {
         case kLogFile:
           keep = ((number >= versions_->LogNumber()) ||
                   (number == versions_->PrevLogNumber()));
+          if (!keep) {
+            keep = KeepLogForReuse(number);
+          }
           break;
         case kDescriptorFile:
           // Keep my manifest file, and any newer incarnations'
@@ -254,6 +359,7 @@ void DBImpl::RemoveObsoleteFiles() {
           keep = (number >= versions_->ManifestFileNumber());
           break;
         case kTableFile:
+        case kBlobFile:
           keep = (live.find(number) != live.end());
           break;
         case kTempFile:
@@ -264,14 +370,17 @@ void DBImpl::RemoveObsoleteFiles() {
         case kCurrentFile:
         case kDBLockFile:
         case kInfoLogFile:
+        case kIdentityFile:
           keep = true;
           break;
       }
 
       if (!keep) {
-        files_to_delete.push_back(std::move(filename));
+        files_to_delete.push_back(dir + "/" + filename);
         if (type == kTableFile) {
           table_cache_->Evict(number);
+        } else if (type == kBlobFile) {
+          blob_cache_->Evict(number);
         }
         Log(options_.info_log, "Delete type=%d #%lld\n", static_cast<int>(type),
             static_cast<unsigned long long>(number));
@@ -283,12 +392,71 @@ void DBImpl::RemoveObsoleteFiles() {
   // have unique names which will not collide with newly created files and
   // are therefore safe to delete while allowing other threads to proceed.
   mutex_.Unlock();
-  for (const std::string& filename : files_to_delete) {
-    env_->RemoveFile(dbname_ + "/" + filename);
+  for (const std::string& fname : files_to_delete) {
+    env_->RemoveFile(fname);
   }
   mutex_.Lock();
 }
 
+bool DBImpl::KeepLogForReuse(uint64_t number) {
+  mutex_.AssertHeld();
+  if (first_recyclable_log_ == 0 || number < first_recyclable_log_) {
+    return false;
+  }
+  if (std::find(recycled_logs_.begin(), recycled_logs_.end(), number) !=
+      recycled_logs_.end()) {
+    return true;
+  }
+  if (recycled_logs_.size() >= options_.recycle_log_file_num) {
+    return false;
+  }
+  Log(options_.info_log, "Keep log #%llu for reuse",
+      static_cast<unsigned long long>(number));
+  recycled_logs_.push_back(number);
+  return true;
+}
+
+Status DBImpl::NewLog(uint64_t number, WritableFile** file,
+                      log::Writer** writer) {
+  mutex_.AssertHeld();
+  const std::string fname = LogFileName(options_.wal_dir, number);
+  if (options_.recycle_log_file_num == 0) {
+    Status s = env_->NewWritableFile(fname, file);
+    if (s.ok()) {
+      *writer = new log::Writer(*file);
+      (*writer)->SetManualFlush(options_.manual_wal_flush);
+      (*writer)->SetCompression(options_.wal_compression);
+    }
+    return s;
+  }
+
+  Status s = Status::NotFound("no log file to reuse");
+  if (!recycled_logs_.empty()) {
+    const uint64_t old_number = recycled_logs_.front();
+    recycled_logs_.pop_front();
+    s = env_->ReuseWritableFile(
+        fname, LogFileName(options_.wal_dir, old_number), file);
+    Log(options_.info_log, "Reuse log #%llu as #%llu: %s",
+        static_cast<unsigned long long>(old_number),
+        static_cast<unsigned long long>(number), s.ToString().c_str());
+  }
+  if (!s.ok()) {
+    s = env_->NewWritableFile(fname, file);
+  }
+  if (s.ok()) {
+    // Only a hint: a file that cannot be preallocated works all the same.
+    (*file)->Preallocate(options_.write_buffer_size +
+                         options_.write_buffer_size / 8);
+    if (first_recyclable_log_ == 0) {
+      first_recyclable_log_ = number;
+    }
+    *writer = new log::Writer(*file, 0, number);
+    (*writer)->SetManualFlush(options_.manual_wal_flush);
+    (*writer)->SetCompression(options_.wal_compression);
+  }
+  return s;
+}
+
 Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   mutex_.AssertHeld();
 
@@ -296,6 +464,12 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   // committed only when the descriptor is created, and this directory
   // may already exist from a previous failed creation attempt.
   env_->CreateDir(dbname_);
+  if (options_.wal_dir != dbname_) {
+    env_->CreateDir(options_.wal_dir);
+  }
+  for (const DbPath& db_path : options_.db_paths) {
+    env_->CreateDir(db_path.path);
+  }
   assert(db_lock_ == nullptr);
   Status s = env_->LockFile(LockFileName(dbname_), &db_lock_);
   if (!s.ok()) {
@@ -321,21 +495,21 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
     }
   }
 
+  if (options_.persistent_cache != nullptr) {
+    std::string identity;
+    s = GetDBIdentity(env_, dbname_, true, &identity);
+    if (!s.ok()) {
+      return s;
+    }
+    table_cache_->SetDBIdentity(identity);
+  }
+
   s = versions_->Recover(save_manifest);
   if (!s.ok()) {
     return s;
   }
   SequenceNumber max_sequence(0);
 
-  // Recover from all newer log files than the ones named in the
-  // descriptor (new log files may have been added by the previous
-  // incarnation without registering them in the descriptor).
-  //
-  // Note that PrevLogNumber() is no longer used, but we pay
-  // attention to it in case we are recovering a database
-  // produced by an older version of leveldb.
-  const uint64_t min_log = versions_->LogNumber();
-  const uint64_t prev_log = versions_->PrevLogNumber();
   std::vector<std::string> filenames;
   s = env_->GetChildren(dbname_, &filenames);
   if (!s.ok()) {
@@ -345,12 +519,20 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   versions_->AddLiveFiles(&expected);
   uint64_t number;
   FileType type;
-  std::vector<uint64_t> logs;
   for (size_t i = 0; i < filenames.size(); i++) {
     if (ParseFileName(filenames[i], &number, &type)) {
       expected.erase(number);
-      if (type == kLogFile && ((number >= min_log) || (number == prev_log)))
-        logs.push_back(number);
+    }
+  }
+  for (const DbPath& db_path : options_.db_paths) {
+    if (db_path.path != dbname_ &&
+        env_->GetChildren(db_path.path, &filenames).ok()) {
+      for (size_t i = 0; i < filenames.size(); i++) {
+        if (ParseFileName(filenames[i], &number, &type) &&
+            type == kTableFile) {
+          expected.erase(number);
+        }
+      }
     }
   }
   if (!expected.empty()) {
@@ -360,8 +542,21 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
     return Status::Corruption(buf, TableFileName(dbname_, *(expected.begin())));
   }
 
-  // Recover in the order in which the logs were generated
-  std::sort(logs.begin(), logs.end());
+  // Recover from all newer log files than the ones named in the
+  // descriptor (new log files may have been added by the previous
+  // incarnation without registering them in the descriptor).
+  std::vector<uint64_t> logs;
+  s = FindLogsToRecover(&logs);
+  if (!s.ok()) {
+    return s;
+  }
+  if (options_.wal_recovery_threads > 1 && !logs.empty()) {
+    s = RecoverLogFilesInParallel(logs, save_manifest, edit, &max_sequence);
+    if (!s.ok()) {
+      return s;
+    }
+    logs.clear();
+  }
   for (size_t i = 0; i < logs.size(); i++) {
     s = RecoverLogFile(logs[i], (i == logs.size() - 1), save_manifest, edit,
                        &max_sequence);
@@ -382,6 +577,30 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   return Status::OK();
 }
 
+Status DBImpl::FindLogsToRecover(std::vector<uint64_t>* logs) {
+  // Note that PrevLogNumber() is no longer used, but we pay
+  // attention to it in case we are recovering a database
+  // produced by an older version of leveldb.
+  const uint64_t min_log = versions_->LogNumber();
+  const uint64_t prev_log = versions_->PrevLogNumber();
+  std::vector<std::string> filenames;
+  Status s = env_->GetChildren(options_.wal_dir, &filenames);
+  if (!s.ok()) {
+    return s;
+  }
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) && type == kLogFile &&
+        ((number >= min_log) || (number == prev_log))) {
+      logs->push_back(number);
+    }
+  }
+  // Recover in the order in which the logs were generated
+  std::sort(logs->begin(), logs->end());
+  return s;
+}
+
 Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
                               bool* save_manifest, VersionEdit* edit,
                               SequenceNumber* max_sequence) {
@@ -401,7 +620,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   mutex_.AssertHeld();
 
   // Open the log file
-  std::string fname = LogFileName(dbname_, log_number);
+  std::string fname = LogFileName(options_.wal_dir, log_number);
   SequentialFile* file;
   Status status = env_->NewSequentialFile(fname, &file);
   if (!status.ok()) {
@@ -419,7 +638,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   // paranoid_checks==false so that corruptions cause entire commits
   // to be skipped instead of propagating bad information (like overly
   // large sequence numbers).
-  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/);
+  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/,
+                     log_number);
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long)log_number);
 
@@ -428,7 +648,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   Slice record;
   WriteBatch batch;
   int compactions = 0;
-  MemTable* mem = nullptr;
+  // Read-only instances cannot write tables, so they keep everything
+  // they recover in mem_.
+  MemTable* mem = read_only() ? mem_ : nullptr;
   while (reader.ReadRecord(&record, &scratch) && status.ok()) {
     if (record.size() < 12) {
       reporter.Corruption(record.size(),
@@ -452,7 +674,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
       *max_sequence = last_seq;
     }
 
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
+    if (!read_only() &&
+        mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
       status = WriteLevel0Table(mem, edit, nullptr);
@@ -468,6 +691,10 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 
   delete file;
 
+  if (read_only()) {
+    return status;
+  }
+
   // See if we should keep reusing the last log file.
   if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
     assert(logfile_ == nullptr);
@@ -477,7 +704,14 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (env_->GetFileSize(fname, &lfile_size).ok() &&
         env_->NewAppendableFile(fname, &logfile_).ok()) {
       Log(options_.info_log, "Reusing old log %s \n", fname.c_str());
-      log_ = new log::Writer(logfile_, lfile_size);
+      if (options_.recycle_log_file_num > 0) {
+        // Records may follow plain ones: readers accept both in a file.
+        log_ = new log::Writer(logfile_, lfile_size, log_number);
+      } else {
+        log_ = new log::Writer(logfile_, lfile_size);
+      }
+      log_->SetManualFlush(options_.manual_wal_flush);
+      log_->SetCompression(options_.wal_compression);
       logfile_number_ = log_number;
       if (mem != nullptr) {
         mem_ = mem;
@@ -502,13 +736,221 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   return status;
 }
 
+namespace {
+
+// Consecutive log records that are replayed into one memtable.
+struct RecoveryChunk {
+  uint64_t file_number;  // Number of the level-0 table to write
+  std::vector<std::string> records;
+};
+
+}  // namespace
+
+Status DBImpl::RecoverLogFilesInParallel(const std::vector<uint64_t>& logs,
+                                         bool* save_manifest,
+                                         VersionEdit* edit,
+                                         SequenceNumber* max_sequence) {
+  struct LogReporter : public log::Reader::Reporter {
+    Logger* info_log;
+    const char* fname;
+    Status* status;  // null if options_.paranoid_checks==false
+    void Corruption(size_t bytes, const Status& s) override {
+      Log(info_log, "%s%s: dropping %d bytes; %s",
+          (this->status == nullptr ? "(ignoring error) " : ""), fname,
+          static_cast<int>(bytes), s.ToString().c_str());
+      if (this->status != nullptr && this->status->ok()) *this->status = s;
+    }
+  };
+
+  // Shared by the opening thread and the workers; guarded by mutex_.
+  struct State {
+    State(DBImpl* db, VersionEdit* edit)
+        : db(db), edit(edit), cv(&db->mutex_), max_sequence(0),
+          pending(0), live_threads(0), done(false) {}
+
+    DBImpl* const db;
+    VersionEdit* const edit;
+    port::CondVar cv;
+    std::deque<RecoveryChunk*> queue;
+    Status status;                // First error of any worker
+    SequenceNumber max_sequence;  // Largest sequence number replayed
+    int pending;                  // Chunks queued or being replayed
+    int live_threads;
+    bool done;                    // No more chunks will be queued
+  };
+
+  struct Worker {
+    static void ThreadMain(void* arg) {
+      State* state = reinterpret_cast<State*>(arg);
+      DBImpl* db = state->db;
+      MutexLock l(&db->mutex_);
+      while (true) {
+        while (state->queue.empty() && !state->done) {
+          state->cv.Wait();
+        }
+        if (state->queue.empty()) {
+          break;
+        }
+        RecoveryChunk* chunk = state->queue.front();
+        state->queue.pop_front();
+        if (state->status.ok()) {
+          Replay(state, chunk);
+        }
+        db->pending_outputs_.erase(chunk->file_number);
+        delete chunk;
+        state->pending--;
+        state->cv.SignalAll();
+      }
+      state->live_threads--;
+      state->cv.SignalAll();
+    }
+
+    // Insert the records of "chunk" into a memtable and write it out.
+    static void Replay(State* state, RecoveryChunk* chunk) {
+      DBImpl* db = state->db;
+      db->mutex_.Unlock();
+      MemTable* mem = new MemTable(db->internal_comparator_);
+      mem->Ref();
+      Status s;
+      SequenceNumber max_sequence = 0;
+      WriteBatch batch;
+      for (size_t i = 0; i < chunk->records.size(); i++) {
+        WriteBatchInternal::SetContents(&batch, chunk->records[i]);
+        s = WriteBatchInternal::InsertInto(&batch, mem);
+        db->MaybeIgnoreError(&s);
+        if (!s.ok()) {
+          break;
+        }
+        const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
+                                        WriteBatchInternal::Count(&batch) - 1;
+        if (last_seq > max_sequence) {
+          max_sequence = last_seq;
+        }
+      }
+      db->mutex_.Lock();
+      if (s.ok()) {
+        s = db->WriteLevel0Table(mem, state->edit, nullptr,
+                                 chunk->file_number);
+      }
+      mem->Unref();
+      if (max_sequence > state->max_sequence) {
+        state->max_sequence = max_sequence;
+      }
+      if (state->status.ok()) {
+        state->status = s;
+      }
+    }
+  };
+
+  mutex_.AssertHeld();
+  // Table numbers are allocated below; make sure they follow the logs.
+  for (size_t i = 0; i < logs.size(); i++) {
+    versions_->MarkFileNumberUsed(logs[i]);
+  }
+  *save_manifest = true;
+
+  State state(this, edit);
+  const int threads = options_.wal_recovery_threads;
+  for (int i = 0; i < threads; i++) {
+    state.live_threads++;
+    env_->StartThread(&Worker::ThreadMain, &state);
+  }
+
+  // Hand "chunk" to the workers.  Chunks get increasing table numbers, so
+  // that level-0 tables holding newer entries have larger numbers even
+  // though they may be written first.  At most one chunk per worker waits
+  // in the queue, to bound the memory held by records.
+  auto schedule = [&](RecoveryChunk* chunk) {
+    while (state.pending >= 2 * threads && state.status.ok()) {
+      state.cv.Wait();
+    }
+    chunk->file_number = versions_->NewFileNumber();
+    pending_outputs_.insert(chunk->file_number);
+    state.queue.push_back(chunk);
+    state.pending++;
+    state.cv.SignalAll();
+  };
+
+  Status status;
+  RecoveryChunk* chunk = new RecoveryChunk;
+  size_t chunk_bytes = 0;
+  for (size_t i = 0; i < logs.size() && status.ok(); i++) {
+    std::string fname = LogFileName(options_.wal_dir, logs[i]);
+    SequentialFile* file;
+    status = env_->NewSequentialFile(fname, &file);
+    if (!status.ok()) {
+      MaybeIgnoreError(&status);
+      continue;
+    }
+    Log(options_.info_log, "Recovering log #%llu",
+        (unsigned long long)logs[i]);
+
+    mutex_.Unlock();
+    LogReporter reporter;
+    reporter.info_log = options_.info_log;
+    reporter.fname = fname.c_str();
+    reporter.status = (options_.paranoid_checks ? &status : nullptr);
+    log::Reader reader(file, &reporter, true /*checksum*/,
+                       0 /*initial_offset*/, logs[i]);
+    std::string scratch;
+    Slice record;
+    while (reader.ReadRecord(&record, &scratch) && status.ok()) {
+      if (record.size() < 12) {
+        reporter.Corruption(record.size(),
+                            Status::Corruption("log record too small"));
+        continue;
+      }
+      chunk->records.push_back(record.ToString());
+      chunk_bytes += record.size();
+      if (chunk_bytes > options_.write_buffer_size) {
+        mutex_.Lock();
+        schedule(chunk);
+        if (!state.status.ok()) {
+          status = state.status;
+        }
+        mutex_.Unlock();
+        chunk = new RecoveryChunk;
+        chunk_bytes = 0;
+      }
+    }
+    mutex_.Lock();
+    delete file;
+  }
+  if (status.ok() && !chunk->records.empty()) {
+    schedule(chunk);
+  } else {
+    delete chunk;
+  }
+
+  state.done = true;
+  state.cv.SignalAll();
+  while (state.live_threads > 0) {
+    state.cv.Wait();
+  }
+  if (status.ok()) {
+    status = state.status;
+  }
+  if (state.max_sequence > *max_sequence) {
+    *max_sequence = state.max_sequence;
+  }
+  return status;
+}
+
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base, uint64_t file_number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
-  meta.number = versions_->NewFileNumber();
+  meta.number = (file_number != 0) ? file_number : versions_->NewFileNumber();
+  // The level is picked once the table is written, so place it as a
+  // level-0 table.
+  meta.path_id = versions_->PathIdForLevel(0);
   pending_outputs_.insert(meta.number);
+  BlobFileMetaData blob;
+  if (options_.min_blob_size > 0) {
+    blob.number = versions_->NewFileNumber();
+    pending_outputs_.insert(blob.number);
+  }
   Iterator* iter = mem->NewIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
@@ -517,7 +959,8 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   {
     mutex_.Unlock();
     // 核心操作，调用BuildTable建立Sorted Table
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta, &blob,
+                   compression_pool_);
     mutex_.Lock();
   }
 
@@ -526,6 +969,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       s.ToString().c_str());
   delete iter;
   pending_outputs_.erase(meta.number);
+  pending_outputs_.erase(blob.number);
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -537,12 +981,15 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+                  meta.largest, 0, meta.path_id);
+    if (blob.file_size > 0) {
+      edit->AddBlobFile(blob.number, blob.file_size);
+    }
   }
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
-  stats.bytes_written = meta.file_size;
+  stats.bytes_written = meta.file_size + blob.file_size;
   stats_[level].Add(stats);
   return s;
 }
@@ -551,12 +998,15 @@ void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
   assert(imm_ != nullptr);
 
-  // Save the contents of the memtable as a new Table
+  // Save the contents of the memtable as a new Table.  A compaction may
+  // be running in another thread, so only push the table below level-0
+  // when compactions run in this thread.
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
   // 将imm_数据写到Level0中
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  Status s = WriteLevel0Table(imm_, &edit,
+                              options_.separate_flush_thread ? nullptr : base);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -575,6 +1025,7 @@ void DBImpl::CompactMemTable() {
     imm_->Unref();
     imm_ = nullptr;
     has_imm_.store(false, std::memory_order_release);
+    InstallSuperVersion();
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -582,6 +1033,9 @@ void DBImpl::CompactMemTable() {
 }
 
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
+  if (read_only()) {
+    return;
+  }
   int max_level_with_files = 1;
   {
     MutexLock l(&mutex_);
@@ -637,8 +1091,11 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
   }
 }
 
-Status DBImpl::TEST_CompactMemTable() {
-  // nullptr batch means just wait for earlier writes to be done
+Status DBImpl::TEST_CompactMemTable() { return Flush(); }
+
+Status DBImpl::Flush() {
+  // nullptr batch means just wait for earlier writes to be done, and
+  // forces the memtable to be switched out
   Status s = Write(WriteOptions(), nullptr);
   if (s.ok()) {
     // Wait until the compaction completes
@@ -668,10 +1125,14 @@ void DBImpl::MaybeScheduleCompaction() {
     // Already scheduled
   } else if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
+  } else if (read_only()) {
+    // Read-only instances never change the database
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
+  } else if (ingesting_files_) {
+    // IngestExternalFile will reschedule once its files are installed
+  } else if ((imm_ == nullptr || options_.separate_flush_thread) &&
+             manual_compaction_ == nullptr && !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
     background_compaction_scheduled_ = true;
@@ -703,12 +1164,59 @@ void DBImpl::BackgroundCall() {
   background_work_finished_signal_.SignalAll();
 }
 
+void DBImpl::BGWALFlush(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundWALFlush();
+}
+
+void DBImpl::BackgroundWALFlush() {
+  MutexLock l(&mutex_);
+  assert(wal_flush_thread_running_);
+  const uint64_t interval = options_.wal_flush_interval_micros;
+  uint64_t next_flush = env_->NowMicros() + interval;
+  while (!shutting_down_.load(std::memory_order_acquire) && bg_error_.ok()) {
+    const uint64_t now = env_->NowMicros();
+    if (now < next_flush) {
+      // Also woken by other background work and at shutdown.
+      background_work_finished_signal_.TimedWait(next_flush - now);
+      continue;
+    }
+    mutex_.Unlock();
+    FlushWAL(true);  // Failures are recorded in bg_error_
+    mutex_.Lock();
+    next_flush = env_->NowMicros() + interval;
+  }
+  wal_flush_thread_running_ = false;
+  background_work_finished_signal_.SignalAll();
+}
+
+void DBImpl::BGFlush(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlush();
+}
+
+void DBImpl::BackgroundFlush() {
+  MutexLock l(&mutex_);
+  assert(flush_thread_running_);
+  while (!shutting_down_.load(std::memory_order_acquire) && bg_error_.ok()) {
+    if (imm_ == nullptr) {
+      flush_work_signal_.Wait();
+      continue;
+    }
+    CompactMemTable();
+    // The new level-0 table may need compacting.
+    MaybeScheduleCompaction();
+    // Wake up MakeRoomForWrite() if necessary.
+    background_work_finished_signal_.SignalAll();
+  }
+  flush_thread_running_ = false;
+  background_work_finished_signal_.SignalAll();
+}
+
 void DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
   // 1.优先将ImmMemTable Flush到Level0中
   // 若imm_非空，则直接执行CompactMemTable()，并返回
-  if (imm_ != nullptr) {
+  if (imm_ != nullptr && !options_.separate_flush_thread) {
     CompactMemTable();
     return;
   }
@@ -746,9 +1254,11 @@ void DBImpl::BackgroundCompaction() {
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
+                       f->largest, f->global_seqno, f->path_id);
     status = versions_->LogAndApply(c->edit(), &mutex_);
-    if (!status.ok()) {
+    if (status.ok()) {
+      InstallSuperVersion();
+    } else {
       RecordBackgroundError(status);
     }
     VersionSet::LevelSummaryStorage tmp;
@@ -802,10 +1312,15 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
     assert(compact->outfile == nullptr);
   }
   delete compact->outfile;
+  delete compact->blob_builder;
+  delete compact->blob_outfile;
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
     pending_outputs_.erase(out.number);
   }
+  if (compact->blob_number != 0) {
+    pending_outputs_.erase(compact->blob_number);
+  }
   delete compact;
 }
 
@@ -819,6 +1334,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     pending_outputs_.insert(file_number);
     CompactionState::Output out;
     out.number = file_number;
+    out.path_id = versions_->PathIdForLevel(compact->compaction->level() + 1);
     out.smallest.Clear();
     out.largest.Clear();
     compact->outputs.push_back(out);
@@ -826,10 +1342,12 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   }
 
   // Make the output file
-  std::string fname = TableFileName(dbname_, file_number);
+  std::string fname = TableFileName(
+      options_.db_paths[compact->current_output()->path_id].path, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->builder =
+        new TableBuilder(options_, compact->outfile, compression_pool_);
   }
   return s;
 }
@@ -841,6 +1359,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   assert(compact->builder != nullptr);
 
   const uint64_t output_number = compact->current_output()->number;
+  const uint32_t output_path_id = compact->current_output()->path_id;
   assert(output_number != 0);
 
   // Check for iterator errors
@@ -869,8 +1388,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
   if (s.ok() && current_entries > 0) {
     // Verify that the table is usable
-    Iterator* iter =
-        table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
+    Iterator* iter = table_cache_->NewIterator(
+        ReadOptions(), output_number, output_path_id, current_bytes, 0);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -883,6 +1402,63 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   return s;
 }
 
+Status DBImpl::FinishCompactionBlobFile(CompactionState* compact) {
+  assert(compact->blob_builder != nullptr);
+  Status s = compact->blob_outfile->Sync();
+  if (s.ok()) {
+    s = compact->blob_outfile->Close();
+  }
+  if (s.ok()) {
+    Log(options_.info_log, "Generated blob file #%llu: %lld bytes",
+        (unsigned long long)compact->blob_number,
+        (unsigned long long)compact->blob_builder->FileSize());
+  }
+  return s;
+}
+
+Status DBImpl::MaybeRelocateBlob(CompactionState* compact,
+                                 const Slice& blob_index,
+                                 std::string* new_index) {
+  BlobIndex index;
+  Status s = index.DecodeFrom(blob_index);
+  if (!s.ok() || !compact->compaction->ShouldRelocateBlobFile(
+                     index.file_number)) {
+    // Keep the reference as is; bad indexes are reported by readers.
+    new_index->assign(blob_index.data(), blob_index.size());
+    return Status::OK();
+  }
+
+  std::string value;
+  s = blob_cache_->Get(index, &value);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Open the output blob file if necessary
+  if (compact->blob_builder == nullptr) {
+    mutex_.Lock();
+    compact->blob_number = versions_->NewFileNumber();
+    pending_outputs_.insert(compact->blob_number);
+    mutex_.Unlock();
+    s = env_->NewWritableFile(BlobFileName(dbname_, compact->blob_number),
+                              &compact->blob_outfile);
+    if (!s.ok()) {
+      return s;
+    }
+    compact->blob_builder =
+        new BlobFileBuilder(compact->blob_outfile, compact->blob_number);
+  }
+
+  BlobIndex relocated;
+  s = compact->blob_builder->Add(value, &relocated);
+  if (s.ok()) {
+    compact->blob_garbage[index.file_number] += index.record_size();
+    new_index->clear();
+    relocated.EncodeTo(new_index);
+  }
+  return s;
+}
+
 Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
   Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
@@ -896,36 +1472,152 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
     compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+                                         out.smallest, out.largest, 0,
+                                         out.path_id);
+  }
+  if (compact->blob_builder != nullptr &&
+      compact->blob_builder->FileSize() > 0) {
+    compact->compaction->edit()->AddBlobFile(
+        compact->blob_number, compact->blob_builder->FileSize());
+  }
+  for (const auto& kvp : compact->blob_garbage) {
+    compact->compaction->edit()->AddBlobGarbage(kvp.first, kvp.second);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  Status s = versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  if (s.ok()) {
+    InstallSuperVersion();
+  }
+  return s;
 }
 
-Status DBImpl::DoCompactionWork(CompactionState* compact) {
-  const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
-
-  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
-      compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
-
-  assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
-  assert(compact->builder == nullptr);
-  assert(compact->outfile == nullptr);
-  if (snapshots_.empty()) {
-    // compact->smallest_snapshot 是为了
-    // 让当前的 Snapshot 的数据在 Compaction 过程中不丢失
-    compact->smallest_snapshot = versions_->LastSequence();
-  } else {
-    compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+Status DBImpl::AddCompactionOutput(CompactionState* compact, const Slice& key,
+                                   const Slice& value, Iterator* input) {
+  // Open output file if necessary
+  if (compact->builder == nullptr) {
+    Status s = OpenCompactionOutputFile(compact);
+    if (!s.ok()) {
+      return s;
+    }
   }
+  if (compact->builder->NumEntries() == 0) {
+    compact->current_output()->smallest.DecodeFrom(key);
+  }
+  compact->current_output()->largest.DecodeFrom(key);
+  compact->builder->Add(key, value);
 
-  // versions_->MakeInputIterator 返回 Compaction 文件集合的合并迭代器
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  // Close output file if it is big enough
+  // 当输出的大小超过阈值，同样执行 FinishCompactionOutputFile
+  if (compact->builder->FileSize() >=
+      compact->compaction->MaxOutputFileSize()) {
+    return FinishCompactionOutputFile(compact, input);
+  }
+  return Status::OK();
+}
 
-  // Release mutex while we're actually doing the compaction work
-  mutex_.Unlock();
+Status DBImpl::CompactMergeOperands(CompactionState* compact, Iterator* input) {
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(input->key(), &ikey)) {
+    return Status::Corruption("corrupted merge key in compaction input");
+  }
+  assert(ikey.type == kTypeMerge);
+  const std::string user_key = ikey.user_key.ToString();
+  const SequenceNumber sequence = ikey.sequence;
+
+  // Gather the operands (newest first) up to and including the first
+  // value or deletion for this user key.  Every entry is kept so that
+  // they can be written out unchanged if they cannot be combined.
+  MergeContext merge_context(options_.merge_operator);
+  std::vector<std::pair<std::string, std::string>> entries;
+  ValueType base_type = kTypeMerge;  // kTypeMerge means "no base found"
+  while (input->Valid()) {
+    const Slice key = input->key();
+    if (!ParseInternalKey(key, &ikey) ||
+        user_comparator()->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    entries.emplace_back(key.ToString(), input->value().ToString());
+    input->Next();
+    if (ikey.type != kTypeMerge) {
+      base_type = ikey.type;
+      break;
+    }
+    merge_context.AddOlderOperand(entries.back().second);
+  }
+
+  std::string merged_key, merged_value;
+  if (base_type != kTypeMerge ||
+      compact->compaction->IsBaseLevelForKey(user_key)) {
+    // We know the full history of the key, so the operands can be
+    // turned into a plain value.
+    const bool has_base =
+        (base_type == kTypeValue || base_type == kTypeBlobIndex);
+    std::string blob_value;
+    Slice base_value;
+    Status s;
+    if (base_type == kTypeValue) {
+      base_value = entries.back().second;
+    } else if (base_type == kTypeBlobIndex) {
+      s = blob_cache_->Get(entries.back().second, &blob_value);
+      base_value = blob_value;
+    }
+    if (s.ok()) {
+      s = merge_context.Finish(user_key, has_base ? &base_value : nullptr,
+                               &merged_value);
+    }
+    if (s.ok()) {
+      AppendInternalKey(&merged_key,
+                        ParsedInternalKey(user_key, sequence, kTypeValue));
+      if (base_type == kTypeBlobIndex) {
+        compact->AddBlobGarbage(entries.back().second);
+      }
+    } else {
+      Log(options_.info_log, "Keeping merge operands: %s",
+          s.ToString().c_str());
+    }
+  } else if (merge_context.size() > 1 &&
+             merge_context.PartialMerge(user_key, &merged_value)) {
+    // The base value lives in a deeper level; keep a single operand.
+    AppendInternalKey(&merged_key,
+                      ParsedInternalKey(user_key, sequence, kTypeMerge));
+  }
+
+  if (!merged_key.empty()) {
+    return AddCompactionOutput(compact, merged_key, merged_value, input);
+  }
+  for (const auto& entry : entries) {
+    Status s = AddCompactionOutput(compact, entry.first, entry.second, input);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status DBImpl::DoCompactionWork(CompactionState* compact) {
+  const uint64_t start_micros = env_->NowMicros();
+  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
+
+  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
+      compact->compaction->num_input_files(0), compact->compaction->level(),
+      compact->compaction->num_input_files(1),
+      compact->compaction->level() + 1);
+
+  assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
+  assert(compact->builder == nullptr);
+  assert(compact->outfile == nullptr);
+  if (snapshots_.empty()) {
+    // compact->smallest_snapshot 是为了
+    // 让当前的 Snapshot 的数据在 Compaction 过程中不丢失
+    compact->smallest_snapshot = versions_->LastSequence();
+  } else {
+    compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+  }
+
+  // versions_->MakeInputIterator 返回 Compaction 文件集合的合并迭代器
+  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+
+  // Release mutex while we're actually doing the compaction work
+  mutex_.Unlock();
 
   input->SeekToFirst();
   Status status;
@@ -933,13 +1625,15 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  std::string blob_index;
   // 一个巨大的循环。
   // 首先判断是否已经 shutting_down_，
   // 如果已经关闭了，则终止当前的 Compaction 过程；
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
     // Prioritize immutable compaction work
     // 随后判断当前是否有 imm_，如果存在的话则也先执行 CompactMemTable
-    if (has_imm_.load(std::memory_order_relaxed)) {
+    if (!options_.separate_flush_thread &&
+        has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
       if (imm_ != nullptr) {
@@ -964,6 +1658,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 
     // Handle key/value, add to state, etc.
     bool drop = false;
+    bool collapse_merge = false;
     if (!ParseInternalKey(key, &ikey)) {
       // Do not hide error keys
       current_user_key.clear();
@@ -999,7 +1694,19 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;
       }
 
-      last_sequence_for_key = ikey.sequence;
+      if (!drop && ikey.type == kTypeMerge) {
+        // A merge operand does not hide older entries for its key, so
+        // it only updates last_sequence_for_key if it is collapsed with
+        // them.  Operands that no snapshot can observe separately are
+        // collapsed with the older entries they apply to.
+        if (ikey.sequence <= compact->smallest_snapshot &&
+            options_.merge_operator != nullptr) {
+          collapse_merge = true;
+          last_sequence_for_key = ikey.sequence;
+        }
+      } else {
+        last_sequence_for_key = ikey.sequence;
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -1011,29 +1718,35 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
-    if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == nullptr) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
-        }
+    if (collapse_merge) {
+      // Consumes the entries for this user key and leaves input
+      // positioned at the next entry to process.
+      status = CompactMergeOperands(compact, input);
+      if (!status.ok()) {
+        break;
       }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+      continue;
+    }
+
+    const bool is_blob_index =
+        has_current_user_key && ikey.type == kTypeBlobIndex;
+    if (drop) {
+      if (is_blob_index) {
+        compact->AddBlobGarbage(input->value());
       }
-      compact->current_output()->largest.DecodeFrom(key);
+    } else if (is_blob_index) {
+      status = MaybeRelocateBlob(compact, input->value(), &blob_index);
+      if (status.ok()) {
+        status = AddCompactionOutput(compact, key, blob_index, input);
+      }
+      if (!status.ok()) {
+        break;
+      }
+    } else {
       // 对于没有丢弃的键值对，将其写入当前的 Table Builder
-      compact->builder->Add(key, input->value());
-
-      // Close output file if it is big enough
-      // 当输出的大小超过阈值，同样执行 FinishCompactionOutputFile
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+      status = AddCompactionOutput(compact, key, input->value(), input);
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -1046,6 +1759,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && compact->builder != nullptr) {
     status = FinishCompactionOutputFile(compact, input);
   }
+  if (status.ok() && compact->blob_builder != nullptr) {
+    status = FinishCompactionBlobFile(compact);
+  }
   if (status.ok()) {
     status = input->status();
   }
@@ -1062,6 +1778,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     stats.bytes_written += compact->outputs[i].file_size;
   }
+  if (compact->blob_builder != nullptr) {
+    stats.bytes_written += compact->blob_builder->FileSize();
+  }
 
   mutex_.Lock();
   stats_[compact->compaction->level() + 1].Add(stats);
@@ -1144,50 +1863,152 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
-Status DBImpl::Get(const ReadOptions& options, const Slice& key,
-                   std::string* value) {
-  Status s;
-  MutexLock l(&mutex_);
-  SequenceNumber snapshot;
+void DBImpl::InstallSuperVersion() {
+  mutex_.AssertHeld();
+  SuperVersion* sv = new SuperVersion;
+  sv->mem = mem_;
+  sv->imm = imm_;
+  sv->current = versions_->current();
+  sv->mem->Ref();
+  if (sv->imm != nullptr) sv->imm->Ref();
+  sv->current->Ref();
+  sv->version_number =
+      super_version_number_.load(std::memory_order_relaxed) + 1;
+  sv->refs.store(1, std::memory_order_relaxed);  // Held by super_version_
+
+  SuperVersion* old = super_version_;
+  super_version_ = sv;
+  super_version_number_.store(sv->version_number, std::memory_order_release);
+
+  // Reads in progress keep using the super version they claimed, and
+  // release it themselves (see ReleaseSuperVersion()).
+  std::vector<void*> cached;
+  local_super_version_.Scrape(&cached, nullptr);
+  for (void* ptr : cached) {
+    if (ptr != kSuperVersionInUse) {
+      UnrefSuperVersion(static_cast<SuperVersion*>(ptr));
+    }
+  }
+  if (old != nullptr) {
+    UnrefSuperVersion(old);
+  }
+}
+
+void DBImpl::UnrefSuperVersion(SuperVersion* sv) {
+  mutex_.AssertHeld();
+  if (sv->Unref()) {
+    sv->mem->Unref();
+    if (sv->imm != nullptr) sv->imm->Unref();
+    sv->current->Unref();
+    delete sv;
+  }
+}
+
+void DBImpl::UnrefCachedSuperVersion(void* ptr) {
+  // InstallSuperVersion() scrapes the caches before it drops the
+  // reference held by super_version_, and cannot run concurrently with
+  // this handler, so a cached super version is never the last reference
+  // and no cleanup (which would need mutex_) is due here.
+  SuperVersion* sv = static_cast<SuperVersion*>(ptr);
+  const bool last = sv->Unref();
+  assert(!last);
+  (void)last;
+}
+
+DBImpl::SuperVersion* DBImpl::AcquireSuperVersion(const ReadOptions& options,
+                                                  SequenceNumber* snapshot) {
+  // Claim the cached super version.  A concurrent InstallSuperVersion()
+  // then leaves it alone.
+  SuperVersion* sv =
+      static_cast<SuperVersion*>(local_super_version_.Swap(kSuperVersionInUse));
+  assert(sv != kSuperVersionInUse);
   if (options.snapshot != nullptr) {
-    snapshot =
+    *snapshot =
         static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
   } else {
-    snapshot = versions_->LastSequence();
+    *snapshot = versions_->LastSequence();
+  }
+  // The number is read after the snapshot, so if "sv" is still the
+  // latest super version it holds every entry up to *snapshot.
+  if (sv != nullptr &&
+      sv->version_number ==
+          super_version_number_.load(std::memory_order_acquire)) {
+    return sv;
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != nullptr) imm->Ref();
-  current->Ref();
+  MutexLock l(&mutex_);
+  if (sv != nullptr) {
+    UnrefSuperVersion(sv);
+  }
+  sv = super_version_;
+  sv->Ref();
+  if (options.snapshot == nullptr) {
+    *snapshot = versions_->LastSequence();
+  }
+  return sv;
+}
+
+void DBImpl::ReleaseSuperVersion(SuperVersion* sv) {
+  void* expected = kSuperVersionInUse;
+  if (!local_super_version_.CompareAndSwap(sv, expected)) {
+    // InstallSuperVersion() dropped the cache while "sv" was in use.
+    assert(expected == nullptr);
+    MutexLock l(&mutex_);
+    UnrefSuperVersion(sv);
+  }
+}
 
+Status DBImpl::Get(const ReadOptions& options, const Slice& key,
+                   std::string* value) {
+  // Values that are found in place are copied out only once, here.
+  PinnableSlice pinnable(value);
+  Status s = GetImpl(options, key, &pinnable);
+  if (s.ok() && pinnable.IsPinned()) {
+    value->assign(pinnable.data(), pinnable.size());
+  }
+  return s;
+}
+
+Status DBImpl::Get(const ReadOptions& options, const Slice& key,
+                   PinnableSlice* value) {
+  value->Reset();
+  Status s = GetImpl(options, key, value);
+  if (!s.ok()) {
+    value->Reset();
+  }
+  return s;
+}
+
+Status DBImpl::GetImpl(const ReadOptions& options, const Slice& key,
+                       PinnableSlice* value) {
+  SequenceNumber snapshot;
+  SuperVersion* sv = AcquireSuperVersion(options, &snapshot);
+
+  Status s;
   bool have_stat_update = false;
   Version::GetStats stats;
 
-  // Unlock while reading from files and memtables
-  {
-    mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
-    }
-    mutex_.Lock();
+  // First look in the memtable, then in the immutable memtable (if any).
+  LookupKey lkey(key, snapshot);
+  MergeContext merge_context(options_.merge_operator);
+  if (sv->mem->Get(lkey, value, &s, &merge_context)) {
+    // Done
+  } else if (sv->imm != nullptr &&
+             sv->imm->Get(lkey, value, &s, &merge_context)) {
+    // Done
+  } else {
+    s = sv->current->Get(options, lkey, value, &stats, &merge_context);
+    have_stat_update = true;
   }
 
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  // Only reads that looked at more than one file charge a seek.
+  if (have_stat_update && stats.seek_file != nullptr) {
+    MutexLock l(&mutex_);
+    if (sv->current->UpdateStats(stats)) {
+      MaybeScheduleCompaction();
+    }
   }
-  mem->Unref();
-  if (imm != nullptr) imm->Unref();
-  current->Unref();
+  ReleaseSuperVersion(sv);
   return s;
 }
 
@@ -1195,7 +2016,8 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
   Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
-  return NewDBIterator(this, user_comparator(), iter,
+  return NewDBIterator(this, user_comparator(), options_.merge_operator,
+                       blob_cache_, iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
@@ -1229,15 +2051,33 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  if (options_.merge_operator == nullptr) {
+    return Status::NotSupported("Merge() requires Options::merge_operator");
+  }
+  return DB::Merge(options, key, value);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  if (read_only()) {
+    return Status::NotSupported("write to a read-only instance");
+  }
+
   Writer w(&mutex_);
   w.batch = updates;
-  w.sync = options.sync;
+  w.sync = options.sync && !options.disable_wal;
+  w.disable_wal = options.disable_wal;
   w.done = false;
 
   MutexLock l(&mutex_);
   // 将Writer放入写入队列deque writers_中
   writers_.push_back(&w);
+  if (w.sync &&
+      writers_.size() == static_cast<size_t>(last_sync_group_size_)) {
+    // The front writer may be waiting for us to share its log sync.
+    writers_.front()->cv.Signal();
+  }
   while (!w.done && &w != writers_.front()) {
     w.cv.Wait();
   }
@@ -1247,8 +2087,22 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(updates == nullptr);
+  if (status.ok() && updates != nullptr && w.sync) {
+    // Give other sync writers a chance to share the log sync.  They queue
+    // up behind &w and wake us once the last group size is reached.
+    const uint64_t window = GroupCommitWindow();
+    if (window > 0) {
+      const uint64_t deadline = env_->NowMicros() + window;
+      uint64_t now;
+      while (writers_.size() < static_cast<size_t>(last_sync_group_size_) &&
+             (now = env_->NowMicros()) < deadline) {
+        w.cv.TimedWait(deadline - now);
+      }
+    }
+  }
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
+  uint64_t sync_micros = 0;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
     WriteBatch* write_batch = BuildBatchGroup(&last_writer);
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
@@ -1263,10 +2117,14 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
       mutex_.Unlock();
       // AddRecord()每次调用会向文件中追加写一条record记录，
       // 写入时按32KB进行切分，并加入了CRC32校验，最终flush()
-      status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+      if (!w.disable_wal) {
+        status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+      }
       bool sync_error = false;
-      if (status.ok() && options.sync) {
+      if (status.ok() && w.sync) {
+        const uint64_t start_micros = env_->NowMicros();
         status = logfile_->Sync();
+        sync_micros = env_->NowMicros() - start_micros + 1;
         if (!status.ok()) {
           sync_error = true;
         }
@@ -1288,9 +2146,11 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     versions_->SetLastSequence(last_sequence);
   }
 
+  int group_size = 0;
   while (true) {
     Writer* ready = writers_.front();
     writers_.pop_front();
+    group_size++;
     if (ready != &w) {
       ready->status = status;
       ready->done = true;
@@ -1298,6 +2158,12 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     }
     if (ready == last_writer) break;
   }
+  if (sync_micros > 0) {
+    avg_log_sync_micros_ = (avg_log_sync_micros_ == 0)
+                               ? sync_micros
+                               : (7 * avg_log_sync_micros_ + sync_micros) / 8;
+    last_sync_group_size_ = group_size;
+  }
 
   // Notify new head of write queue
   if (!writers_.empty()) {
@@ -1320,9 +2186,14 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
 
   // Allow the group to grow up to a maximum size, but if the
   // original write is small, limit the growth so we do not slow
-  // down the small write too much.
+  // down the small write too much.  With group commit, a sync write
+  // waits for the log sync anyway, so its group may take more of the
+  // queued writers the longer the queue is.
   size_t max_size = 1 << 20;
-  if (size <= (128 << 10)) {
+  if (first->sync && options_.group_commit_window_micros > 0) {
+    max_size = std::max<size_t>(
+        max_size, std::min<size_t>(writers_.size() * (32 << 10), 4 << 20));
+  } else if (size <= (128 << 10)) {
     max_size = size + (128 << 10);
   }
 
@@ -1336,27 +2207,87 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
-    if (w->batch != nullptr) {
-      size += WriteBatchInternal::ByteSize(w->batch);
-      if (size > max_size) {
-        // Do not make batch too big
-        break;
-      }
+    if (w->disable_wal != first->disable_wal) {
+      // Writes that skip the log cannot share a group with logged ones.
+      break;
+    }
 
-      // Append to *result
-      if (result == first->batch) {
-        // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
-        assert(WriteBatchInternal::Count(result) == 0);
-        WriteBatchInternal::Append(result, first->batch);
-      }
-      WriteBatchInternal::Append(result, w->batch);
+    if (w->batch == nullptr) {
+      // Memtable flushes, file ingestion and log flushes need their own
+      // turn at the head of the queue.
+      break;
+    }
+
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
     }
+
+    // Append to *result
+    if (result == first->batch) {
+      // Switch to temporary batch instead of disturbing caller's batch
+      result = tmp_batch_;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
+    }
+    WriteBatchInternal::Append(result, w->batch);
     *last_writer = w;
   }
   return result;
 }
 
+uint64_t DBImpl::GroupCommitWindow() {
+  mutex_.AssertHeld();
+  if (options_.group_commit_window_micros == 0) {
+    return 0;
+  }
+  // Waiting only adds latency unless other sync writers are around, and
+  // is pointless once as many writers are queued as joined the last group.
+  if (last_sync_group_size_ <= 1 ||
+      writers_.size() >= static_cast<size_t>(last_sync_group_size_)) {
+    return 0;
+  }
+  // Waiting longer than a fraction of a sync would cost more than the
+  // syncs it saves.
+  return std::min(options_.group_commit_window_micros,
+                  avg_log_sync_micros_ / 2);
+}
+
+Status DBImpl::FlushWAL(bool sync) {
+  if (read_only()) {
+    return Status::NotSupported("write to a read-only instance");
+  }
+
+  // Take a turn at the head of the writer queue so that no log records
+  // are being appended and the log is not switched meanwhile.
+  Writer w(&mutex_);
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  Status s = bg_error_;
+  if (s.ok()) {
+    WritableFile* file = logfile_;
+    mutex_.Unlock();
+    s = sync ? file->Sync() : file->Flush();
+    mutex_.Lock();
+    if (!s.ok()) {
+      // The state of the log file is unknown, as after a failed sync
+      // in Write().
+      RecordBackgroundError(s);
+    }
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
 // 申请Write的空间
@@ -1409,7 +2340,8 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       assert(versions_->PrevLogNumber() == 0);
       uint64_t new_log_number = versions_->NewFileNumber();
       WritableFile* lfile = nullptr;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      log::Writer* new_log = nullptr;
+      s = NewLog(new_log_number, &lfile, &new_log);
       if (!s.ok()) {
         // Avoid chewing through file number space in a tight loop.
         versions_->ReuseFileNumber(new_log_number);
@@ -1419,14 +2351,16 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       delete logfile_;
       logfile_ = lfile;
       logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
+      log_ = new_log;
       // 将已满的mem_给imm_指针
       imm_ = mem_;
       has_imm_.store(true, std::memory_order_release);
       // 生成新的MemTable
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
+      InstallSuperVersion();
       force = false;  // Do not force another compaction if have room
+      flush_work_signal_.Signal();
       // 触发Compaction
       MaybeScheduleCompaction();
     }
@@ -1514,6 +2448,248 @@ void DBImpl::GetApproximateSizes(const Range* range, int n, uint64_t* sizes) {
   v->Unref();
 }
 
+namespace {
+
+// A file passed to DB::IngestExternalFile.
+struct IngestedFile {
+  std::string path;
+  uint64_t file_size;
+  std::string smallest;  // Smallest user key in the file
+  std::string largest;   // Largest user key in the file
+  uint64_t number;       // Number of the copy made in the DB directory
+};
+
+// Open the table at file->path with "options" (which hold the user
+// comparator), check that its keys are in strictly increasing order, and
+// fill in the rest of *file.
+Status ScanExternalFile(const Options& options, IngestedFile* file) {
+  Env* env = options.env;
+  Status s = env->GetFileSize(file->path, &file->file_size);
+  RandomAccessFile* raf = nullptr;
+  if (s.ok()) {
+    s = env->NewRandomAccessFile(file->path, &raf);
+  }
+  Table* table = nullptr;
+  if (s.ok()) {
+    s = Table::Open(options, raf, file->file_size, &table);
+  }
+  if (s.ok()) {
+    ReadOptions ro;
+    ro.verify_checksums = true;
+    ro.fill_cache = false;
+    Iterator* iter = table->NewIterator(ro);
+    bool empty = true;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      Slice key = iter->key();
+      if (empty) {
+        file->smallest.assign(key.data(), key.size());
+        empty = false;
+      } else if (options.comparator->Compare(key, file->largest) <= 0) {
+        s = Status::InvalidArgument(file->path, "keys out of order");
+        break;
+      }
+      file->largest.assign(key.data(), key.size());
+    }
+    if (s.ok()) {
+      s = iter->status();
+    }
+    if (s.ok() && empty) {
+      s = Status::InvalidArgument(file->path, "file is empty");
+    }
+    delete iter;
+  }
+  delete table;
+  delete raf;
+  return s;
+}
+
+Status CopyFile(Env* env, const std::string& src, const std::string& dst) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(dst, &out);
+  if (!s.ok()) {
+    delete in;
+    return s;
+  }
+  static const size_t kBufferSize = 65536;
+  char* space = new char[kBufferSize];
+  while (true) {
+    Slice fragment;
+    s = in->Read(kBufferSize, &fragment, space);
+    if (!s.ok() || fragment.empty()) {
+      break;
+    }
+    s = out->Append(fragment);
+    if (!s.ok()) {
+      break;
+    }
+  }
+  delete[] space;
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  delete in;
+  if (!s.ok()) {
+    env->RemoveFile(dst);
+  }
+  return s;
+}
+
+// Return true iff "mem" holds an entry for a user key in [smallest,largest].
+bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                      const Slice& smallest, const Slice& largest) {
+  LookupKey lkey(smallest, kMaxSequenceNumber);
+  Iterator* iter = mem->NewIterator();
+  iter->Seek(lkey.internal_key());
+  const bool result = iter->Valid() &&
+                      ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0;
+  delete iter;
+  return result;
+}
+
+}  // namespace
+
+Status DBImpl::IngestExternalFile(const std::vector<std::string>& paths) {
+  if (read_only()) {
+    return Status::NotSupported("ingestion into a read-only instance");
+  }
+  if (paths.empty()) {
+    return Status::OK();
+  }
+
+  // Ingested tables hold user keys, so read them with the user comparator.
+  Options table_options = options_;
+  table_options.comparator = user_comparator();
+  table_options.filter_policy = nullptr;
+
+  const Comparator* ucmp = user_comparator();
+  std::vector<IngestedFile> files(paths.size());
+  Status s;
+  for (size_t i = 0; i < paths.size() && s.ok(); i++) {
+    files[i].path = paths[i];
+    s = ScanExternalFile(table_options, &files[i]);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  std::sort(files.begin(), files.end(),
+            [ucmp](const IngestedFile& a, const IngestedFile& b) {
+              return ucmp->Compare(a.smallest, b.smallest) < 0;
+            });
+  for (size_t i = 1; i < files.size(); i++) {
+    if (ucmp->Compare(files[i - 1].largest, files[i].smallest) >= 0) {
+      return Status::InvalidArgument(files[i].path,
+                                     "overlaps another ingested file");
+    }
+  }
+
+  // Take the head of the writer queue so that no write can slip in
+  // between the sequence number assigned below and the new files.
+  Writer w(&mutex_);
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  // Memtable entries are older than the ingested files but are read
+  // before any table, so flush the ones that would shadow new data.
+  bool overlaps_memtable = false;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (MemTableOverlaps(mem_, ucmp, files[i].smallest, files[i].largest)) {
+      overlaps_memtable = true;
+      break;
+    }
+  }
+  if (overlaps_memtable) {
+    s = MakeRoomForWrite(true /* force */);
+  }
+  while (s.ok() && imm_ != nullptr) {
+    if (!bg_error_.ok()) {
+      s = bg_error_;
+    } else {
+      background_work_finished_signal_.Wait();
+    }
+  }
+
+  // A running compaction could move older data above the levels chosen
+  // below, so wait for it and hold off new ones until we are done.
+  if (s.ok()) {
+    ingesting_files_ = true;
+    while (background_compaction_scheduled_) {
+      background_work_finished_signal_.Wait();
+    }
+    s = bg_error_;
+  }
+
+  if (s.ok()) {
+    for (size_t i = 0; i < files.size(); i++) {
+      files[i].number = versions_->NewFileNumber();
+      pending_outputs_.insert(files[i].number);
+    }
+    mutex_.Unlock();
+    for (size_t i = 0; i < files.size() && s.ok(); i++) {
+      s = CopyFile(env_, files[i].path,
+                   TableFileName(options_.db_paths[0].path, files[i].number));
+    }
+    mutex_.Lock();
+
+    if (s.ok()) {
+      // Place each file in the deepest level that no older data for its
+      // key range sits above.
+      const SequenceNumber seq = versions_->LastSequence() + 1;
+      Version* current = versions_->current();
+      VersionEdit edit;
+      for (size_t i = 0; i < files.size(); i++) {
+        const IngestedFile& f = files[i];
+        Slice smallest(f.smallest);
+        Slice largest(f.largest);
+        int level = 0;
+        if (!current->OverlapInLevel(0, &smallest, &largest)) {
+          while (level + 1 < config::kNumLevels &&
+                 !current->OverlapInLevel(level + 1, &smallest, &largest)) {
+            level++;
+          }
+        }
+        edit.AddFile(level, f.number, f.file_size,
+                     InternalKey(f.smallest, seq, kTypeValue),
+                     InternalKey(f.largest, seq, kTypeValue), seq);
+        Log(options_.info_log, "Ingested %s as #%llu at level-%d",
+            f.path.c_str(), static_cast<unsigned long long>(f.number), level);
+      }
+      versions_->SetLastSequence(seq);
+      s = versions_->LogAndApply(&edit, &mutex_);
+      if (s.ok()) {
+        InstallSuperVersion();
+      }
+    }
+
+    for (size_t i = 0; i < files.size(); i++) {
+      pending_outputs_.erase(files[i].number);
+    }
+    if (!s.ok()) {
+      RemoveObsoleteFiles();
+    }
+  }
+
+  ingesting_files_ = false;
+  MaybeScheduleCompaction();
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
 // Default implementations of convenience methods that subclasses of DB
 // can call if they wish
 Status DB::Put(const WriteOptions& opt, const Slice& key, const Slice& value) {
@@ -1530,6 +2706,33 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Get(const ReadOptions& options, const Slice& key,
+               PinnableSlice* value) {
+  value->Reset();
+  Status s = Get(options, key, value->GetSelf());
+  value->PinSelf();
+  return s;
+}
+
+Status DB::IngestExternalFile(const std::vector<std::string>& paths) {
+  return Status::NotSupported("IngestExternalFile");
+}
+
+Status DB::TryCatchUpWithPrimary() {
+  return Status::NotSupported("not a secondary instance");
+}
+
+Status DB::FlushWAL(bool sync) { return Status::NotSupported("FlushWAL"); }
+
+Status DB::Flush() { return Status::NotSupported("Flush"); }
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1545,13 +2748,13 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     // Create new log and a corresponding memtable.
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    log::Writer* log;
+    s = impl->NewLog(new_log_number, &lfile, &log);
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
-      impl->log_ = new log::Writer(lfile);
+      impl->log_ = log;
       impl->mem_ = new MemTable(impl->internal_comparator_);
       impl->mem_->Ref();
     }
@@ -1562,12 +2765,56 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
   }
   if (s.ok()) {
+    impl->InstallSuperVersion();
     impl->RemoveObsoleteFiles();
     impl->MaybeScheduleCompaction();
+    if (impl->options_.manual_wal_flush &&
+        impl->options_.wal_flush_interval_micros > 0) {
+      impl->wal_flush_thread_running_ = true;
+      impl->env_->StartThread(&DBImpl::BGWALFlush, impl);
+    }
+    if (impl->options_.separate_flush_thread) {
+      impl->flush_thread_running_ = true;
+      impl->env_->StartThread(&DBImpl::BGFlush, impl);
+    }
   }
   impl->mutex_.Unlock();
   if (s.ok()) {
     assert(impl->mem_ != nullptr);
+    impl->LoadTables();
+    *dbptr = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
+Status DB::OpenForReadOnly(const Options& options, const std::string& dbname,
+                           DB** dbptr) {
+  return DBImpl::OpenReadOnly(options, dbname, DBImpl::kOpenReadOnly, dbptr);
+}
+
+Status DB::OpenAsSecondary(const Options& options, const std::string& dbname,
+                           DB** dbptr) {
+  return DBImpl::OpenReadOnly(options, dbname, DBImpl::kOpenSecondary, dbptr);
+}
+
+Status DBImpl::OpenReadOnly(const Options& options, const std::string& dbname,
+                            OpenMode mode, DB** dbptr) {
+  *dbptr = nullptr;
+
+  DBImpl* impl = new DBImpl(options, dbname, mode);
+  std::string identity;
+  if (impl->options_.persistent_cache != nullptr &&
+      GetDBIdentity(impl->env_, dbname, false, &identity).ok()) {
+    // Without an identity the tables bypass the persistent cache.
+    impl->table_cache_->SetDBIdentity(identity);
+  }
+  impl->mutex_.Lock();
+  Status s = impl->LoadReadOnlyState();
+  impl->mutex_.Unlock();
+  if (s.ok()) {
+    impl->LoadTables();
     *dbptr = impl;
   } else {
     delete impl;
@@ -1575,6 +2822,87 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   return s;
 }
 
+void DBImpl::LoadTables() {
+  if (options_.max_file_opening_threads <= 0) {
+    return;
+  }
+  mutex_.Lock();
+  Version* current = versions_->current();
+  current->Ref();
+  mutex_.Unlock();
+
+  // Tables beyond the capacity of the table cache would only evict the
+  // ones opened before them.
+  const size_t limit = TableCacheSize(options_);
+  std::vector<FileMetaData*> files;
+  for (int level = 0; level < config::kNumLevels && files.size() < limit;
+       level++) {
+    std::vector<FileMetaData*> level_files;
+    current->GetOverlappingInputs(level, nullptr, nullptr, &level_files);
+    for (size_t i = 0; i < level_files.size() && files.size() < limit; i++) {
+      files.push_back(level_files[i]);
+    }
+  }
+  table_cache_->LoadTables(files, options_.max_file_opening_threads);
+
+  mutex_.Lock();
+  current->Unref();
+  mutex_.Unlock();
+}
+
+Status DBImpl::LoadReadOnlyState() {
+  mutex_.AssertHeld();
+  assert(read_only());
+  if (!env_->FileExists(CurrentFileName(dbname_))) {
+    return Status::InvalidArgument(dbname_, "does not exist");
+  }
+
+  bool save_manifest = false;  // Ignored: read-only instances never write
+  Status s = versions_->Recover(&save_manifest);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Replay the same log files as DBImpl::Recover.
+  std::vector<uint64_t> logs;
+  s = FindLogsToRecover(&logs);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Concurrent readers keep using the old memtable until it is replaced.
+  MemTable* old_mem = mem_;
+  mem_ = new MemTable(internal_comparator_);
+  mem_->Ref();
+  VersionEdit edit;  // Unused: nothing is flushed
+  SequenceNumber max_sequence(0);
+  for (size_t i = 0; i < logs.size() && s.ok(); i++) {
+    s = RecoverLogFile(logs[i], (i == logs.size() - 1), &save_manifest, &edit,
+                       &max_sequence);
+  }
+  if (!s.ok()) {
+    mem_->Unref();
+    mem_ = old_mem;
+    return s;
+  }
+  if (old_mem != nullptr) {
+    old_mem->Unref();
+  }
+  if (versions_->LastSequence() < max_sequence) {
+    versions_->SetLastSequence(max_sequence);
+  }
+  InstallSuperVersion();
+  return s;
+}
+
+Status DBImpl::TryCatchUpWithPrimary() {
+  if (mode_ != kOpenSecondary) {
+    return DB::TryCatchUpWithPrimary();
+  }
+  MutexLock l(&mutex_);
+  return LoadReadOnlyState();
+}
+
 Snapshot::~Snapshot() = default;
 
 Status DestroyDB(const std::string& dbname, const Options& options) {
@@ -1601,6 +2929,35 @@ Status DestroyDB(const std::string& dbname, const Options& options) {
         }
       }
     }
+    if (!options.wal_dir.empty() && options.wal_dir != dbname &&
+        env->GetChildren(options.wal_dir, &filenames).ok()) {
+      for (size_t i = 0; i < filenames.size(); i++) {
+        if (ParseFileName(filenames[i], &number, &type) &&
+            type == kLogFile) {
+          Status del = env->RemoveFile(options.wal_dir + "/" + filenames[i]);
+          if (result.ok() && !del.ok()) {
+            result = del;
+          }
+        }
+      }
+      env->RemoveDir(options.wal_dir);  // Ignore error as for dbname
+    }
+    for (const DbPath& db_path : options.db_paths) {
+      if (db_path.path == dbname ||
+          !env->GetChildren(db_path.path, &filenames).ok()) {
+        continue;
+      }
+      for (size_t i = 0; i < filenames.size(); i++) {
+        if (ParseFileName(filenames[i], &number, &type) &&
+            type == kTableFile) {
+          Status del = env->RemoveFile(db_path.path + "/" + filenames[i]);
+          if (result.ok() && !del.ok()) {
+            result = del;
+          }
+        }
+      }
+      env->RemoveDir(db_path.path);  // Ignore error as for dbname
+    }
     env->UnlockFile(lock);  // Ignore error since state is already gone
     env->RemoveFile(lockname);
     env->RemoveDir(dbname);  // Ignore error in case dir contains other files
@@ -9,6 +9,7 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
@@ -17,10 +18,13 @@
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/thread_local.h"
 
 namespace leveldb {
 
 class MemTable;
+class BlobCache;
+class CompressionPool;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -28,7 +32,12 @@ class VersionSet;
 
 class DBImpl : public DB {
  public:
-  DBImpl(const Options& options, const std::string& dbname);
+  // How the database was opened: see DB::Open, DB::OpenForReadOnly and
+  // DB::OpenAsSecondary.
+  enum OpenMode { kOpenReadWrite, kOpenReadOnly, kOpenSecondary };
+
+  DBImpl(const Options& options, const std::string& dbname,
+         OpenMode mode = kOpenReadWrite);
 
   DBImpl(const DBImpl&) = delete;
   DBImpl& operator=(const DBImpl&) = delete;
@@ -39,15 +48,23 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status Merge(const WriteOptions&, const Slice& key,
+               const Slice& value) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  Status Get(const ReadOptions& options, const Slice& key,
+             PinnableSlice* value) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
+  Status IngestExternalFile(const std::vector<std::string>& paths) override;
+  Status TryCatchUpWithPrimary() override;
+  Status FlushWAL(bool sync) override;
+  Status Flush() override;
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -101,12 +118,69 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
+  // The memtables and Version that Get() reads, referenced together so
+  // that each thread can cache them without taking mutex_.
+  struct SuperVersion {
+    void Ref() { refs.fetch_add(1, std::memory_order_relaxed); }
+
+    // Returns true if this was the last reference.
+    bool Unref() { return refs.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+    MemTable* mem;
+    MemTable* imm;  // May be nullptr
+    Version* current;
+    uint64_t version_number;  // Value of super_version_number_ when installed
+    std::atomic<int> refs;
+  };
+
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
                                 uint32_t* seed);
 
   Status NewDB();
 
+  // Replace super_version_ with one that refers to the current mem_,
+  // imm_ and Version, and drop the super versions cached by threads.
+  // Must be called whenever any of those change.
+  void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Drop a reference to "sv", deleting it if it was the last.
+  void UnrefSuperVersion(SuperVersion* sv) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return a referenced super version for a read at the snapshot chosen
+  // by "options", which is stored in *snapshot.  Usually this is the
+  // calling thread's cached one, and no lock is taken.
+  SuperVersion* AcquireSuperVersion(const ReadOptions& options,
+                                    SequenceNumber* snapshot)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Return "sv", obtained from AcquireSuperVersion(), to the calling
+  // thread's cache.
+  void ReleaseSuperVersion(SuperVersion* sv) LOCKS_EXCLUDED(mutex_);
+
+  // Unref handler of local_super_version_, run when a thread exits.
+  static void UnrefCachedSuperVersion(void* ptr);
+
+  // Implementation of both Get() overloads.
+  // REQUIRES: !value->IsPinned()
+  Status GetImpl(const ReadOptions& options, const Slice& key,
+                 PinnableSlice* value);
+
+  // Implementation of DB::OpenForReadOnly and DB::OpenAsSecondary.
+  static Status OpenReadOnly(const Options& options, const std::string& dbname,
+                             OpenMode mode, DB** dbptr);
+
+  // Load the version described by the current MANIFEST and replace mem_
+  // with a memtable holding the contents of the live log files.  Used by
+  // read-only instances, which never write to the database directory.
+  Status LoadReadOnlyState() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  bool read_only() const { return mode_ != kOpenReadWrite; }
+
+  // Open the tables of the current version ahead of their first use (see
+  // Options::max_file_opening_threads).
+  void LoadTables() LOCKS_EXCLUDED(mutex_);
+
   // Recover the descriptor from persistent storage.  May do a significant
   // amount of work to recover recently logged updates.  Any changes to
   // be made to the descriptor are added to *edit.
@@ -118,16 +192,40 @@ class DBImpl : public DB {
   // Delete any unneeded files and stale in-memory entries.
   void RemoveObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Return true if the obsolete log file "number" is, or has now become,
+  // one of the files kept for reuse (see Options::recycle_log_file_num).
+  bool KeepLogForReuse(uint64_t number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Create log file "number", reusing an obsolete log file if possible,
+  // and a writer for it.
+  Status NewLog(uint64_t number, WritableFile** file, log::Writer** writer)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Compact the in-memory write buffer to disk.  Switches to a new
   // log-file/memtable and writes a new descriptor iff successful.
   // Errors are recorded in bg_error_.
   void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Store the numbers of the log files that recovery must replay in
+  // *logs, oldest first.
+  Status FindLogsToRecover(std::vector<uint64_t>* logs)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Replay "logs" in order with options_.wal_recovery_threads threads,
+  // writing all of their contents to level-0 tables.
+  Status RecoverLogFilesInParallel(const std::vector<uint64_t>& logs,
+                                   bool* save_manifest, VersionEdit* edit,
+                                   SequenceNumber* max_sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Write the contents of "mem" to a new level-0 table numbered
+  // "file_number", or a newly allocated number if it is zero.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          uint64_t file_number = 0)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
@@ -135,11 +233,22 @@ class DBImpl : public DB {
   WriteBatch* BuildBatchGroup(Writer** last_writer)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Microseconds the writer at the front of writers_ should wait for more
+  // sync writers before committing (see
+  // Options::group_commit_window_micros).
+  uint64_t GroupCommitWindow() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
   void BackgroundCall();
+  // Body of the thread started for Options::wal_flush_interval_micros.
+  static void BGWALFlush(void* db);
+  void BackgroundWALFlush();
+  // Body of the thread started for Options::separate_flush_thread.
+  static void BGFlush(void* db);
+  void BackgroundFlush();
   void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -147,7 +256,22 @@ class DBImpl : public DB {
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
+  // Append an entry to the current compaction output, opening a new
+  // output file or finishing a full one as needed.
+  Status AddCompactionOutput(CompactionState* compact, const Slice& key,
+                             const Slice& value, Iterator* input);
+  // Collapse the merge operands for the user key at which "input" is
+  // positioned, together with the value they apply to, and write the
+  // result to the compaction output.  Advances "input" past the entries
+  // it consumed.
+  Status CompactMergeOperands(CompactionState* compact, Iterator* input);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // If the blob file referenced by "blob_index" is mostly garbage, copy the
+  // value to the compaction's blob output file.  Stores the reference to
+  // write in *new_index.
+  Status MaybeRelocateBlob(CompactionState* compact, const Slice& blob_index,
+                           std::string* new_index);
+  Status FinishCompactionBlobFile(CompactionState* compact);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -163,9 +287,15 @@ class DBImpl : public DB {
   const bool owns_info_log_;
   const bool owns_cache_;
   const std::string dbname_;
+  const OpenMode mode_;
 
   // table_cache_ provides its own synchronization
   TableCache* const table_cache_;
+  BlobCache* const blob_cache_;
+
+  // Threads that compress data blocks for every table the DB writes, or
+  // nullptr unless Options::compression_threads is greater than one.
+  CompressionPool* const compression_pool_;
 
   // Lock over the persistent DB state.  Non-null iff successfully acquired.
   FileLock* db_lock_;
@@ -174,18 +304,33 @@ class DBImpl : public DB {
   port::Mutex mutex_;
   std::atomic<bool> shutting_down_;
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
+  port::CondVar flush_work_signal_ GUARDED_BY(mutex_);  // imm_ was set
   MemTable* mem_;
   MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
   std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
+  SuperVersion* super_version_ GUARDED_BY(mutex_);
+  std::atomic<uint64_t> super_version_number_;  // Bumped by each install
+  ThreadLocalPtr local_super_version_;  // Per-thread cached SuperVersion
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
+  // Obsolete log files kept for reuse, oldest first.  Only logs numbered
+  // first_recyclable_log_ or above, which this instance wrote in the
+  // recyclable format, are reused.
+  std::deque<uint64_t> recycled_logs_ GUARDED_BY(mutex_);
+  uint64_t first_recyclable_log_ GUARDED_BY(mutex_);
   uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // Moving average of the time taken by log syncs, and the number of
+  // writers committed by the last sync.  Used to size the group commit
+  // window.
+  uint64_t avg_log_sync_micros_ GUARDED_BY(mutex_);
+  int last_sync_group_size_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
@@ -195,6 +340,16 @@ class DBImpl : public DB {
   // Has a background compaction been scheduled or is running?
   bool background_compaction_scheduled_ GUARDED_BY(mutex_);
 
+  // Is the thread that periodically flushes the log running?
+  bool wal_flush_thread_running_ GUARDED_BY(mutex_);
+
+  // Is the thread that writes out imm_ running?
+  bool flush_thread_running_ GUARDED_BY(mutex_);
+
+  // Is IngestExternalFile choosing levels for new files?  No compaction
+  // may be scheduled while it does.
+  bool ingesting_files_ GUARDED_BY(mutex_);
+
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
   VersionSet* const versions_ GUARDED_BY(mutex_);
@@ -206,11 +361,12 @@ class DBImpl : public DB {
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
-// it is not equal to src.info_log.
+// it is not equal to src.info_log.  If "read_only" is true, nothing is
+// created in the db directory, so a missing info_log is left null.
 Options SanitizeOptions(const std::string& db,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
-                        const Options& src);
+                        const Options& src, bool read_only = false);
 
 }  // namespace leveldb
 
@@ -4,9 +4,11 @@
 
 #include "db/db_iter.h"
 
+#include "db/blob_cache.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/merge_helper.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -43,16 +45,24 @@ class DBIter : public Iterator {
   //     the exact entry that yields this->key(), this->value()
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
+  // An exception to (1) is an entry produced by combining merge operands
+  // or by reading a value from a blob file: the key and value are then held
+  // in saved_key_/saved_value_ and the internal iterator is positioned
+  // after the entries that were read.
   enum Direction { kForward, kReverse };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
+  DBIter(DBImpl* db, const Comparator* cmp, const MergeOperator* merge_operator,
+         BlobCache* blob_cache, Iterator* iter, SequenceNumber s,
          uint32_t seed)
       : db_(db),
         user_comparator_(cmp),
+        merge_operator_(merge_operator),
+        blob_cache_(blob_cache),
         iter_(iter),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        saved_entry_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
@@ -63,11 +73,14 @@ class DBIter : public Iterator {
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !saved_entry_)
+               ? ExtractUserKey(iter_->key())
+               : saved_key_;
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !saved_entry_) ? iter_->value()
+                                                     : saved_value_;
   }
   Status status() const override {
     if (status_.ok()) {
@@ -86,6 +99,8 @@ class DBIter : public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  void MergeValuesNewToOld();
+  void ReadBlobValue();
   bool ParseKey(ParsedInternalKey* key);
 
   inline void SaveKey(const Slice& k, std::string* dst) {
@@ -108,6 +123,8 @@ class DBIter : public Iterator {
 
   DBImpl* db_;
   const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
+  BlobCache* const blob_cache_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
   Status status_;
@@ -115,6 +132,7 @@ class DBIter : public Iterator {
   std::string saved_value_;  // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool saved_entry_;  // Current entry is held in saved_key_/saved_value_
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -157,6 +175,15 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (saved_entry_) {
+    // iter_ has already moved past the entries read for this->key(), and
+    // saved_key_ holds the key to skip past.
+    saved_entry_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -189,9 +216,17 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           skipping = true;
           break;
         case kTypeValue:
+        case kTypeMerge:
+        case kTypeBlobIndex:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+          } else if (ikey.type == kTypeMerge) {
+            MergeValuesNewToOld();
+            return;
+          } else if (ikey.type == kTypeBlobIndex) {
+            ReadBlobValue();
+            return;
           } else {
             valid_ = true;
             saved_key_.clear();
@@ -206,14 +241,86 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+// Combine the merge operand at which iter_ is positioned with the older
+// entries for the same user key.
+void DBIter::MergeValuesNewToOld() {
+  MergeContext merge_context(merge_operator_);
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  merge_context.AddOlderOperand(iter_->value());
+
+  std::string blob_value;
+  Slice base_value;
+  bool has_base = false;
+  Status s;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey) ||
+        user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      merge_context.AddOlderOperand(iter_->value());
+      continue;
+    }
+    if (ikey.type == kTypeValue) {
+      base_value = iter_->value();
+      has_base = true;
+    } else if (ikey.type == kTypeBlobIndex) {
+      s = blob_cache_->Get(iter_->value(), &blob_value);
+      base_value = blob_value;
+      has_base = true;
+    }
+    break;
+  }
+
+  if (s.ok()) {
+    s = merge_context.Finish(saved_key_, has_base ? &base_value : nullptr,
+                             &saved_value_);
+  }
+  if (!s.ok()) {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    return;
+  }
+  saved_entry_ = true;
+  valid_ = true;
+}
+
+// Read the value of the blob index entry at which iter_ is positioned.
+void DBIter::ReadBlobValue() {
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  Status s = blob_cache_->Get(iter_->value(), &saved_value_);
+  if (!s.ok()) {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    return;
+  }
+  iter_->Next();
+  saved_entry_ = true;
+  valid_ = true;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
   if (direction_ == kForward) {  // Switch directions?
-    // iter_ is pointing at the current entry.  Scan backwards until
-    // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    if (saved_entry_) {
+      // iter_ is positioned after the entries for the current key (or
+      // is exhausted) and saved_key_ holds the current key.
+      saved_entry_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      // iter_ is pointing at the current entry.  Scan backwards until
+      // the key changes so we can use the normal reverse scanning code.
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -237,6 +344,11 @@ void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
   ValueType value_type = kTypeDeletion;
+  // Entries for a key are visited from oldest to newest, so merge
+  // operands are applied to the value (if any) seen before them.
+  MergeContext merge_context(merge_operator_);
+  bool has_base = false;       // saved_value_ holds the value operands apply to
+  bool is_blob_index = false;  // saved_value_ holds a BlobIndex
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
@@ -250,6 +362,12 @@ void DBIter::FindPrevUserEntry() {
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+          merge_context.Clear();
+          has_base = false;
+          is_blob_index = false;
+        } else if (value_type == kTypeMerge) {
+          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          merge_context.AddNewerOperand(iter_->value());
         } else {
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
@@ -258,6 +376,9 @@ void DBIter::FindPrevUserEntry() {
           }
           SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
           saved_value_.assign(raw_value.data(), raw_value.size());
+          merge_context.Clear();
+          has_base = true;
+          is_blob_index = (value_type == kTypeBlobIndex);
         }
       }
       iter_->Prev();
@@ -270,13 +391,33 @@ void DBIter::FindPrevUserEntry() {
     saved_key_.clear();
     ClearSavedValue();
     direction_ = kForward;
-  } else {
+    return;
+  }
+
+  // Only the newest value is read from its blob file.
+  Status s;
+  if (is_blob_index) {
+    s = blob_cache_->Get(saved_value_, &saved_value_);
+  }
+  if (s.ok() && !merge_context.empty()) {
+    Slice base_value(saved_value_);
+    s = merge_context.Finish(saved_key_, has_base ? &base_value : nullptr,
+                             &saved_value_);
+  }
+  if (s.ok()) {
     valid_ = true;
+  } else {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    direction_ = kForward;
   }
 }
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  saved_entry_ = false;
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
@@ -291,6 +432,7 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  saved_entry_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -302,6 +444,7 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  saved_entry_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
@@ -310,9 +453,11 @@ void DBIter::SeekToLast() {
 }  // anonymous namespace
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
-                        Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        const MergeOperator* merge_operator,
+                        BlobCache* blob_cache, Iterator* internal_iter,
+                        SequenceNumber sequence, uint32_t seed) {
+  return new DBIter(db, user_key_comparator, merge_operator, blob_cache,
+                    internal_iter, sequence, seed);
 }
 
 }  // namespace leveldb
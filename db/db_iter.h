@@ -12,14 +12,20 @@
 
 namespace leveldb {
 
+class BlobCache;
 class DBImpl;
+class MergeOperator;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
 // into appropriate user keys.
+// Merge operands are combined using "merge_operator", which may be null
+// if the DB contains no merge operands.  Values stored in blob files are
+// read through "blob_cache".
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
-                        Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        const MergeOperator* merge_operator,
+                        BlobCache* blob_cache, Iterator* internal_iter,
+                        SequenceNumber sequence, uint32_t seed);
 
 }  // namespace leveldb
 
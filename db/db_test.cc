@@ -4,8 +4,10 @@
 
 #include "leveldb/db.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cinttypes>
+#include <set>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -16,7 +18,10 @@
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/persistent_cache.h"
 #include "leveldb/table.h"
+#include "leveldb/table_builder.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
 #include "util/hash.h"
@@ -121,6 +126,9 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Number of successful sstable/log Sync() calls.
+  AtomicCounter data_sync_counter_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -157,7 +165,11 @@ class SpecialEnv : public EnvWrapper {
         while (env_->delay_data_sync_.load(std::memory_order_acquire)) {
           DelayMilliseconds(100);
         }
-        return base_->Sync();
+        Status s = base_->Sync();
+        if (s.ok()) {
+          env_->data_sync_counter_.Increment();
+        }
+        return s;
       }
     };
     class ManifestFile : public WritableFile {
@@ -276,6 +288,12 @@ class DBTest : public testing::Test {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kHashIndex:
+        options.data_block_hash_index = true;
+        break;
+      case kPlainTable:
+        options.table_format = kPlainTableFormat;
+        break;
       default:
         break;
     }
@@ -390,6 +408,12 @@ class DBTest : public testing::Test {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
+            case kTypeBlobIndex:
+              result += "BLOB";
+              break;
           }
         }
         iter->Next();
@@ -441,6 +465,43 @@ class DBTest : public testing::Test {
     return static_cast<int>(files.size());
   }
 
+  // Return the numbers of the blob files in the DB directory, in order.
+  std::set<uint64_t> BlobFiles() {
+    std::vector<std::string> files;
+    env_->GetChildren(dbname_, &files);
+    std::set<uint64_t> result;
+    uint64_t number;
+    FileType type;
+    for (const std::string& file : files) {
+      if (ParseFileName(file, &number, &type) && type == kBlobFile) {
+        result.insert(number);
+      }
+    }
+    return result;
+  }
+
+  // Write "entries", which must be sorted by key, to a new table at
+  // "fname" that can be passed to DB::IngestExternalFile.
+  Status WriteExternalFile(
+      const std::string& fname,
+      const std::vector<std::pair<std::string, std::string>>& entries) {
+    WritableFile* file;
+    Status s = env_->NewWritableFile(fname, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    TableBuilder builder(last_options_, file);
+    for (const auto& entry : entries) {
+      builder.Add(entry.first, entry.second);
+    }
+    s = builder.Finish();
+    if (s.ok()) {
+      s = file->Close();
+    }
+    delete file;
+    return s;
+  }
+
   uint64_t Size(const Slice& start, const Slice& limit) {
     Range r(start, limit);
     uint64_t size;
@@ -532,7 +593,15 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kHashIndex,
+    kPlainTable,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
   int option_config_;
@@ -615,6 +684,43 @@ TEST_F(DBTest, GetFromVersions) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetPinnableSlice) {
+  do {
+    ASSERT_LEVELDB_OK(Put("foo", "v1"));
+    ASSERT_LEVELDB_OK(Put("bar", "b1"));
+    PinnableSlice value;
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "foo", &value));
+    ASSERT_TRUE(value.IsPinned());  // Points into the memtable
+    ASSERT_EQ("v1", value.ToString());
+
+    // The pinned memtable outlives its flush.
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("v1", value.ToString());
+
+    // Reusing the slice releases what it pinned before.
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "bar", &value));
+    ASSERT_TRUE(value.IsPinned());  // Points into a table block
+    ASSERT_EQ("b1", value.ToString());
+    ASSERT_LEVELDB_OK(Put("bar", "b2"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+    ASSERT_EQ("b1", value.ToString());
+
+    ASSERT_LEVELDB_OK(Delete("foo"));
+    ASSERT_TRUE(db_->Get(ReadOptions(), "foo", &value).IsNotFound());
+    ASSERT_FALSE(value.IsPinned());
+    ASSERT_TRUE(value.empty());
+
+    std::string buf;
+    PinnableSlice external(&buf);
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "bar", &external));
+    ASSERT_EQ("b2", external.ToString());
+    external.Reset();
+    ASSERT_FALSE(external.IsPinned());
+    ASSERT_TRUE(external.empty());
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, GetMemUsage) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -1098,6 +1204,98 @@ TEST_F(DBTest, RecoverWithLargeLog) {
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
 }
 
+TEST_F(DBTest, RecycleLogFiles) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000;
+  options.recycle_log_file_num = 2;
+  options.paranoid_checks = true;
+  Reopen(&options);
+
+  // Each round switches memtables several times, so later logs reuse the
+  // files of earlier ones.  The latest log then ends in stale records of
+  // a longer earlier one, which recovery must not replay.
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 500; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'a' + round)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_LEVELDB_OK(Put(Key(0), std::string(10, 'x')));
+
+    std::vector<std::string> files;
+    env_->GetChildren(dbname_, &files);
+    int logs = 0;
+    uint64_t number;
+    FileType type;
+    for (const std::string& file : files) {
+      if (ParseFileName(file, &number, &type) && type == kLogFile) {
+        logs++;
+      }
+    }
+    ASSERT_LE(logs, 1 + 2);
+
+    Reopen(&options);
+    ASSERT_EQ(std::string(10, 'x'), Get(Key(0)));
+    for (int i = 1; i < 500; i++) {
+      ASSERT_EQ(std::string(100, 'a' + round), Get(Key(i)));
+    }
+  }
+}
+
+TEST_F(DBTest, RecycleLogFilesWithReuseLogs) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000;
+  options.recycle_log_file_num = 2;
+  options.reuse_logs = true;
+  options.paranoid_checks = true;
+  Reopen(&options);
+
+  // Leave a recycled log with a stale tail behind, as in RecycleLogFiles.
+  for (int i = 0; i < 500; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'v')));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 500; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'w')));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+
+  // Writes made after a reopen survive the next one.
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  Reopen(&options);
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vb", Get("b"));
+}
+
+TEST_F(DBTest, RecoverInParallel) {
+  Options options = CurrentOptions();
+  Reopen(&options);
+  // Every key is written three times, so each version lands in a
+  // different chunk and the newest must win.
+  const int N = 300;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < N; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'a' + round)));
+    }
+    if (round == 1) {
+      ASSERT_LEVELDB_OK(Delete(Key(0)));
+    }
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+
+  options.write_buffer_size = 10000;
+  options.wal_recovery_threads = 4;
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(std::string(100, 'c'), Get(Key(i)));
+  }
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(std::string(100, 'c'), Get(Key(N - 1)));
+}
+
 TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   Options options = CurrentOptions();
   options.write_buffer_size = 100000000;  // Large write buffer
@@ -1433,6 +1631,448 @@ TEST_F(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
+namespace {
+
+// Appends operands to the existing value, separated by commas.
+class AppendOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "test.AppendOperator"; }
+
+  bool Merge(const Slice& key, const Slice* existing_value,
+             const Slice& operand, std::string* new_value) const override {
+    new_value->clear();
+    if (existing_value != nullptr) {
+      new_value->assign(existing_value->data(), existing_value->size());
+      new_value->push_back(',');
+    }
+    new_value->append(operand.data(), operand.size());
+    return true;
+  }
+
+  bool PartialMerge(const Slice& key, const Slice& older_operand,
+                    const Slice& newer_operand,
+                    std::string* new_operand) const override {
+    *new_operand = older_operand.ToString() + "," + newer_operand.ToString();
+    return true;
+  }
+};
+
+}  // namespace
+
+TEST_F(DBTest, MergeWithoutOperator) {
+  ASSERT_TRUE(db_->Merge(WriteOptions(), "foo", "v1").IsNotSupportedError());
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+}
+
+TEST_F(DBTest, MergeGet) {
+  AppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.merge_operator = &merge_operator;
+  DestroyAndReopen(&options);
+
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "a"));
+  ASSERT_EQ("a", Get("foo"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "b"));
+  ASSERT_EQ("a,b", Get("foo"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+
+  // Operands spread across the memtable and several levels.
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "c"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "d"));
+  ASSERT_EQ("a,b,c,d", Get("foo"));
+  ASSERT_EQ("a,b", Get("foo", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  ASSERT_LEVELDB_OK(Put("foo", "x"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "y"));
+  ASSERT_EQ("x,y", Get("foo"));
+  ASSERT_LEVELDB_OK(Delete("foo"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "z"));
+  ASSERT_EQ("z", Get("foo"));
+
+  // Operands are replayed from the log on recovery.
+  Reopen(&options);
+  ASSERT_EQ("z", Get("foo"));
+}
+
+TEST_F(DBTest, GetPinnableSliceMerge) {
+  AppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.merge_operator = &merge_operator;
+  DestroyAndReopen(&options);
+
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "a"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "b"));
+  PinnableSlice value;
+  ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "foo", &value));
+  ASSERT_FALSE(value.IsPinned());  // Merged into the slice's own buffer
+  ASSERT_EQ("a,b", value.ToString());
+  ASSERT_EQ("a,b", *value.GetSelf());
+}
+
+TEST_F(DBTest, MergeIterator) {
+  AppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.merge_operator = &merge_operator;
+  DestroyAndReopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "m1"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "m2"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "c", "m3"));
+  ASSERT_LEVELDB_OK(Put("d", "vd"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->vb,m1,m2");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->m3");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->vb,m1,m2");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->m3");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "d->vd");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "d->vd");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "c->m3");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->vb,m1,m2");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->m3");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->vb,m1,m2");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+  iter->Seek("c");
+  ASSERT_EQ(IterStatus(iter), "c->m3");
+  delete iter;
+}
+
+TEST_F(DBTest, MergeCompaction) {
+  AppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.merge_operator = &merge_operator;
+  DestroyAndReopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const int last = config::kMaxMemCompactLevel;
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
+
+  // Place a table at level last-1 to prevent merging with preceding mutation
+  ASSERT_LEVELDB_OK(Put("a", "begin"));
+  ASSERT_LEVELDB_OK(Put("z", "end"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);
+  ASSERT_EQ(NumTableFilesAtLevel(last - 1), 1);
+
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "m1"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "m2"));
+  ASSERT_EQ(AllEntriesFor("foo"), "[ MERGE(m2), MERGE(m1), v1 ]");
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());  // Moves to level last-2
+  ASSERT_EQ("v1,m1,m2", Get("foo"));
+  dbfull()->TEST_CompactRange(last - 2, nullptr, nullptr);
+  // Base value lives in a level not being compacted, so the operands
+  // are only combined with each other.
+  ASSERT_EQ(AllEntriesFor("foo"), "[ MERGE(m1,m2), v1 ]");
+  ASSERT_EQ("v1,m1,m2", Get("foo"));
+  dbfull()->TEST_CompactRange(last - 1, nullptr, nullptr);
+  // Merging last-1 w/ last, so the operands are applied to the base value.
+  ASSERT_EQ(AllEntriesFor("foo"), "[ v1,m1,m2 ]");
+  ASSERT_EQ("v1,m1,m2", Get("foo"));
+}
+
+TEST_F(DBTest, BlobValues) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.min_blob_size = 100;
+  DestroyAndReopen(&options);
+
+  const std::string big1(1000, 'x');
+  const std::string big2(2000, 'y');
+  ASSERT_LEVELDB_OK(Put("a", "small"));
+  ASSERT_LEVELDB_OK(Put("b", big1));
+  ASSERT_LEVELDB_OK(Put("c", big2));
+  ASSERT_EQ(big1, Get("b"));  // Served from the memtable
+  ASSERT_TRUE(BlobFiles().empty());
+
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, BlobFiles().size());
+  ASSERT_EQ(AllEntriesFor("a"), "[ small ]");
+  ASSERT_EQ(AllEntriesFor("b"), "[ BLOB ]");
+  ASSERT_EQ("small", Get("a"));
+  ASSERT_EQ(big1, Get("b"));
+  ASSERT_EQ(big2, Get("c"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "a->small");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->" + big1);
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->" + big2);
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->" + big1);
+  iter->Next();
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "c->" + big2);
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->" + big1);
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->small");
+  delete iter;
+
+  Reopen(&options);
+  ASSERT_EQ(big1, Get("b"));
+  ASSERT_EQ(big2, Get("c"));
+}
+
+TEST_F(DBTest, BlobGarbageCollection) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.min_blob_size = 100;
+  DestroyAndReopen(&options);
+
+  const std::string big1(1000, '1');
+  const std::string big2(1000, '2');
+  const std::string big3(1000, '3');
+  ASSERT_LEVELDB_OK(Put("a", big1));
+  ASSERT_LEVELDB_OK(Put("b", big2));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const std::set<uint64_t> initial = BlobFiles();
+  ASSERT_EQ(1, initial.size());
+
+  // Overwrite half of the first blob file.
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Put("a", big3));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(2, BlobFiles().size());
+  for (int level = 0; level < 3; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  // The snapshot keeps the old value alive.
+  ASSERT_EQ(big1, Get("a", snapshot));
+  ASSERT_EQ(2, BlobFiles().size());
+  ASSERT_EQ(1, BlobFiles().count(*initial.begin()));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Once the old value is dropped, the live value in the first blob file
+  // is moved to a new blob file and the first file is deleted.
+  for (int level = 3; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  std::set<uint64_t> live = BlobFiles();
+  ASSERT_EQ(2, live.size());
+  ASSERT_EQ(0, live.count(*initial.begin()));
+  ASSERT_EQ(big3, Get("a"));
+  ASSERT_EQ(big2, Get("b"));
+
+  // Deleting every key frees every blob file.
+  ASSERT_LEVELDB_OK(Delete("a"));
+  ASSERT_LEVELDB_OK(Delete("b"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  ASSERT_TRUE(BlobFiles().empty());
+
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_TRUE(BlobFiles().empty());
+}
+
+TEST_F(DBTest, IngestExternalFile) {
+  const std::string ext1 = dbname_ + "_ext1";
+  const std::string ext2 = dbname_ + "_ext2";
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va0"));
+    ASSERT_LEVELDB_OK(Put("c", "vc0"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+
+    ASSERT_LEVELDB_OK(WriteExternalFile(ext1, {{"b", "vb1"}, {"c", "vc1"}}));
+    ASSERT_LEVELDB_OK(WriteExternalFile(ext2, {{"x", "vx1"}}));
+    ASSERT_LEVELDB_OK(db_->IngestExternalFile({ext2, ext1}));
+    ASSERT_TRUE(env_->FileExists(ext1));
+
+    ASSERT_EQ("(a->va0)(b->vb1)(c->vc1)(x->vx1)", Contents());
+    ASSERT_EQ("vc1", Get("c"));
+    ASSERT_EQ("vc0", Get("c", snapshot));
+    ASSERT_EQ("NOT_FOUND", Get("b", snapshot));
+    db_->ReleaseSnapshot(snapshot);
+
+    // Later writes shadow ingested values.
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_EQ("vc2", Get("c"));
+
+    Reopen();
+    ASSERT_EQ("(a->va0)(b->vb1)(c->vc2)(x->vx1)", Contents());
+    db_->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("(a->va0)(b->vb1)(c->vc2)(x->vx1)", Contents());
+  } while (ChangeOptions());
+  env_->RemoveFile(ext1);
+  env_->RemoveFile(ext2);
+}
+
+TEST_F(DBTest, IngestExternalFileLevel) {
+  const std::string ext = dbname_ + "_ext";
+
+  // With nothing to overlap, the file goes to the last level.
+  ASSERT_LEVELDB_OK(WriteExternalFile(ext, {{"a", "v1"}, {"c", "v1"}}));
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile({ext}));
+  ASSERT_EQ("0,0,0,0,0,0,1", FilesPerLevel());
+
+  // Otherwise it goes just above the newest overlapping data.
+  ASSERT_LEVELDB_OK(Put("b", "v2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1,0,0,0,1", FilesPerLevel());
+  ASSERT_LEVELDB_OK(WriteExternalFile(ext, {{"b", "v3"}}));
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile({ext}));
+  ASSERT_EQ("0,1,1,0,0,0,1", FilesPerLevel());
+  ASSERT_EQ("(a->v1)(b->v3)(c->v1)", Contents());
+  env_->RemoveFile(ext);
+}
+
+TEST_F(DBTest, IngestExternalFileRepair) {
+  const std::string ext = dbname_ + "_ext";
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(Put("b", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(WriteExternalFile(ext, {{"b", "v2"}, {"c", "v2"}}));
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile({ext}));
+  ASSERT_LEVELDB_OK(Put("c", "v3"));
+
+  // Repair reads the sequence number of the ingested table from the old
+  // descriptor, so its entries keep their place among the others.
+  Close();
+  ASSERT_LEVELDB_OK(RepairDB(dbname_, CurrentOptions()));
+  Reopen();
+  ASSERT_EQ("(a->v1)(b->v2)(c->v3)", Contents());
+  ASSERT_LEVELDB_OK(Put("d", "v4"));
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("(a->v1)(b->v2)(c->v3)(d->v4)", Contents());
+  env_->RemoveFile(ext);
+}
+
+TEST_F(DBTest, IngestExternalFileErrors) {
+  const std::string ext1 = dbname_ + "_ext1";
+  const std::string ext2 = dbname_ + "_ext2";
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  const int num_files = CountFiles();
+
+  ASSERT_LEVELDB_OK(WriteExternalFile(ext1, {{"b", "v1"}, {"d", "v1"}}));
+  ASSERT_LEVELDB_OK(WriteExternalFile(ext2, {{"c", "v2"}}));
+  ASSERT_TRUE(db_->IngestExternalFile({ext1, ext2}).IsInvalidArgument());
+
+  ASSERT_LEVELDB_OK(WriteExternalFile(ext2, {}));
+  ASSERT_TRUE(db_->IngestExternalFile({ext2}).IsInvalidArgument());
+
+  ASSERT_TRUE(!db_->IngestExternalFile({dbname_ + "_missing"}).ok());
+
+  ASSERT_EQ("(a->va)", Contents());
+  ASSERT_EQ(num_files, CountFiles());
+  env_->RemoveFile(ext1);
+  env_->RemoveFile(ext2);
+}
+
+static std::string GetFrom(DB* db, const std::string& k) {
+  std::string result;
+  Status s = db->Get(ReadOptions(), k, &result);
+  if (s.IsNotFound()) {
+    result = "NOT_FOUND";
+  } else if (!s.ok()) {
+    result = s.ToString();
+  }
+  return result;
+}
+
+TEST_F(DBTest, OpenForReadOnly) {
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(Put("b", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(Put("b", "v2"));  // Only in the log
+  ASSERT_LEVELDB_OK(Delete("a"));
+
+  std::vector<std::string> files;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &files));
+  std::sort(files.begin(), files.end());
+
+  // The primary is still open, so the lock is held.
+  DB* ro = nullptr;
+  ASSERT_LEVELDB_OK(DB::OpenForReadOnly(CurrentOptions(), dbname_, &ro));
+  ASSERT_EQ("NOT_FOUND", GetFrom(ro, "a"));
+  ASSERT_EQ("v2", GetFrom(ro, "b"));
+  ASSERT_TRUE(ro->Put(WriteOptions(), "c", "v").IsNotSupportedError());
+  ASSERT_TRUE(ro->TryCatchUpWithPrimary().IsNotSupportedError());
+  ro->CompactRange(nullptr, nullptr);
+
+  ASSERT_LEVELDB_OK(Put("b", "v3"));
+  ASSERT_EQ("v2", GetFrom(ro, "b"));
+  delete ro;
+
+  std::vector<std::string> after;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &after));
+  std::sort(after.begin(), after.end());
+  ASSERT_EQ(files, after);
+}
+
+TEST_F(DBTest, OpenForReadOnlyMissing) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  const std::string missing = dbname_ + "_missing";
+  DB* ro = nullptr;
+  ASSERT_TRUE(!DB::OpenForReadOnly(options, missing, &ro).ok());
+  ASSERT_TRUE(ro == nullptr);
+  ASSERT_TRUE(!env_->FileExists(missing));
+}
+
+TEST_F(DBTest, OpenAsSecondary) {
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  DB* secondary = nullptr;
+  ASSERT_LEVELDB_OK(DB::OpenAsSecondary(CurrentOptions(), dbname_, &secondary));
+  ASSERT_EQ("v1", GetFrom(secondary, "a"));
+  ASSERT_TRUE(db_->TryCatchUpWithPrimary().IsNotSupportedError());
+
+  ASSERT_LEVELDB_OK(Put("a", "v2"));
+  ASSERT_LEVELDB_OK(Put("b", "v2"));
+  ASSERT_EQ("v1", GetFrom(secondary, "a"));
+  ASSERT_EQ("NOT_FOUND", GetFrom(secondary, "b"));
+  ASSERT_LEVELDB_OK(secondary->TryCatchUpWithPrimary());
+  ASSERT_EQ("v2", GetFrom(secondary, "a"));
+  ASSERT_EQ("v2", GetFrom(secondary, "b"));
+
+  // Follow the primary through a flush and a full compaction.
+  ASSERT_LEVELDB_OK(Put("c", "v3"));
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_LEVELDB_OK(Delete("a"));
+  ASSERT_LEVELDB_OK(secondary->TryCatchUpWithPrimary());
+  ASSERT_EQ("NOT_FOUND", GetFrom(secondary, "a"));
+  ASSERT_EQ("v2", GetFrom(secondary, "b"));
+  ASSERT_EQ("v3", GetFrom(secondary, "c"));
+  delete secondary;
+}
+
 TEST_F(DBTest, OverlapInLevel0) {
   do {
     ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
@@ -1941,6 +2581,479 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST_F(DBTest, PersistentCacheIdentity) {
+  const std::string cache_path = dbname_ + "_persistent_cache";
+  Options options = CurrentOptions();
+  ASSERT_LEVELDB_OK(NewPersistentCache(env_, cache_path, 1 << 20,
+                                       &options.persistent_cache));
+
+  // Only DBs that use a persistent cache get an identity.
+  Reopen();
+  ASSERT_TRUE(!env_->FileExists(IdentityFileName(dbname_)));
+  Reopen(&options);
+  std::string identity;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, IdentityFileName(dbname_),
+                                     &identity));
+  ASSERT_EQ(32, identity.size());
+
+  // It is kept across reopens and compactions.
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  Compact("a", "z");
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  std::string reopened;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, IdentityFileName(dbname_),
+                                     &reopened));
+  ASSERT_EQ(identity, reopened);
+
+  Close();
+  ASSERT_LEVELDB_OK(DestroyDB(dbname_, options));
+  ASSERT_TRUE(!env_->FileExists(IdentityFileName(dbname_)));
+  delete options.persistent_cache;
+
+  std::vector<std::string> filenames;
+  env_->GetChildren(cache_path, &filenames);
+  for (const std::string& filename : filenames) {
+    env_->RemoveFile(cache_path + "/" + filename);
+  }
+  env_->RemoveDir(cache_path);
+}
+
+TEST_F(DBTest, OpenLoadsTables) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+  const int kNumTables = 5;
+  for (int i = 0; i < kNumTables; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+
+  // Without loading, the first read of a table also reads its footer and
+  // index block.
+  env_->count_random_reads_ = true;
+  Reopen(&options);
+  env_->random_read_counter_.Reset();
+  ASSERT_EQ("v", Get(Key(0)));
+  ASSERT_GT(env_->random_read_counter_.Read(), 1);
+
+  options.max_file_opening_threads = 3;
+  Reopen(&options);
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < kNumTables; i++) {
+    ASSERT_EQ("v", Get(Key(i)));
+  }
+  ASSERT_EQ(kNumTables, env_->random_read_counter_.Read());
+
+  env_->count_random_reads_ = false;
+  Close();
+  delete options.block_cache;
+}
+
+TEST_F(DBTest, TableMetadataCache) {
+  Options options = CurrentOptions();
+  // Too small to keep any table, so tables are reopened from the files
+  // that stay in the file cache.
+  options.table_metadata_cache_size = 1;
+  Reopen(&options);
+
+  for (int i = 0; i < 10; i++) {
+    for (int j = 0; j < 100; j++) {
+      ASSERT_LEVELDB_OK(Put(Key(i * 100 + j), std::string(100, 'a' + i)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  for (int i = 0; i < 1000; i += 7) {
+    ASSERT_EQ(std::string(100, 'a' + i / 100), Get(Key(i)));
+  }
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(std::string(100, 'a' + count / 100), iter->value().ToString());
+    count++;
+  }
+  ASSERT_EQ(1000, count);
+  delete iter;
+
+  // Compaction reads and deletes files through both caches.
+  Compact(Key(0), Key(999));
+  Reopen(&options);
+  for (int i = 0; i < 1000; i += 7) {
+    ASSERT_EQ(std::string(100, 'a' + i / 100), Get(Key(i)));
+  }
+}
+
+namespace {
+
+struct SyncWriterState {
+  DB* db;
+  int id;
+  Status status;  // First error, if any
+  std::atomic<bool>* done;
+};
+
+static const int kSyncWrites = 50;
+
+static void SyncWriterBody(void* arg) {
+  SyncWriterState* state = reinterpret_cast<SyncWriterState*>(arg);
+  WriteOptions options;
+  options.sync = true;
+  for (int i = 0; i < kSyncWrites && state->status.ok(); i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "%d.%d", state->id, i);
+    state->status = state->db->Put(options, key, std::string(100, 'v'));
+  }
+  state->done->store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST_F(DBTest, GroupCommitWindow) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.group_commit_window_micros = 1000;
+  Reopen(&options);
+
+  // Hold the first log sync back so that the other writers queue up
+  // behind it and the DB sees sync writes overlap.
+  env_->data_sync_counter_.Reset();
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  const int kWriters = 4;
+  std::atomic<bool> done[kWriters];
+  SyncWriterState state[kWriters];
+  for (int id = 0; id < kWriters; id++) {
+    done[id].store(false, std::memory_order_release);
+    state[id].db = db_;
+    state[id].id = id;
+    state[id].done = &done[id];
+    env_->StartThread(SyncWriterBody, &state[id]);
+  }
+  DelayMilliseconds(100);
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  for (int id = 0; id < kWriters; id++) {
+    while (!done[id].load(std::memory_order_acquire)) {
+      DelayMilliseconds(10);
+    }
+  }
+  for (int id = 0; id < kWriters; id++) {
+    ASSERT_LEVELDB_OK(state[id].status);
+  }
+
+  // Writers shared log syncs, two or more of them to a sync on average.
+  ASSERT_LE(env_->data_sync_counter_.Read(), kWriters * kSyncWrites / 2);
+
+  Reopen(&options);
+  for (int id = 0; id < kWriters; id++) {
+    for (int i = 0; i < kSyncWrites; i++) {
+      char key[20];
+      std::snprintf(key, sizeof(key), "%d.%d", id, i);
+      ASSERT_EQ(std::string(100, 'v'), Get(key));
+    }
+  }
+}
+
+namespace {
+
+// Keeps the Env's background thread busy until *arg is set.
+static void BlockBackgroundThread(void* arg) {
+  std::atomic<bool>* release = reinterpret_cast<std::atomic<bool>*>(arg);
+  while (!release->load(std::memory_order_acquire)) {
+    DelayMilliseconds(10);
+  }
+}
+
+}  // namespace
+
+TEST_F(DBTest, SeparateFlushThread) {
+  Options options = CurrentOptions();
+  options.separate_flush_thread = true;
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+
+  // Memtables are written to level-0 even if they overlap nothing.
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("1", FilesPerLevel());
+
+  // Flushes run while the compaction thread is busy.
+  std::atomic<bool> release(false);
+  env_->Schedule(&BlockBackgroundThread, &release);
+  ASSERT_LEVELDB_OK(Put("bar", "v2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("2", FilesPerLevel());
+  release.store(true, std::memory_order_release);
+
+  // Writes keep going while tables are compacted.
+  Random rnd(301);
+  const int N = 2000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(N + rnd.Uniform(N)), RandomString(&rnd, 1000)));
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + i % 26)));
+  }
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(std::string(1000, 'a' + i % 26), Get(Key(i)));
+  }
+  ASSERT_GT(TotalTableFiles(), 1);
+
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(std::string(1000, 'a' + i % 26), Get(Key(i)));
+  }
+}
+
+namespace {
+
+// Total size of the log files in "dbname" as seen by the file system.
+uint64_t LogFilesSize(Env* env, const std::string& dbname) {
+  std::vector<std::string> files;
+  env->GetChildren(dbname, &files);
+  uint64_t total = 0;
+  uint64_t number;
+  FileType type;
+  for (const std::string& file : files) {
+    uint64_t size;
+    if (ParseFileName(file, &number, &type) && type == kLogFile &&
+        env->GetFileSize(dbname + "/" + file, &size).ok()) {
+      total += size;
+    }
+  }
+  return total;
+}
+
+}  // namespace
+
+TEST_F(DBTest, ManualWALFlush) {
+  Options options = CurrentOptions();
+  options.manual_wal_flush = true;
+  Reopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_LEVELDB_OK(Put("bar", "v2"));
+  ASSERT_EQ(0, LogFilesSize(env_, dbname_));
+  ASSERT_LEVELDB_OK(db_->FlushWAL(false));
+  const uint64_t flushed = LogFilesSize(env_, dbname_);
+  ASSERT_GT(flushed, 0);
+
+  // Sync writes still reach the file.
+  WriteOptions sync_options;
+  sync_options.sync = true;
+  ASSERT_LEVELDB_OK(db_->Put(sync_options, "baz", "v3"));
+  ASSERT_GT(LogFilesSize(env_, dbname_), flushed);
+
+  // Buffered records are written out on close.
+  ASSERT_LEVELDB_OK(Put("qux", "v4"));
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+  ASSERT_EQ("v3", Get("baz"));
+  ASSERT_EQ("v4", Get("qux"));
+}
+
+TEST_F(DBTest, WALFlushInterval) {
+  Options options = CurrentOptions();
+  options.manual_wal_flush = true;
+  options.wal_flush_interval_micros = 1000;
+  Reopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  for (int i = 0; i < 1000 && LogFilesSize(env_, dbname_) == 0; i++) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_GT(LogFilesSize(env_, dbname_), 0);
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+}
+
+namespace {
+
+// Number of files of type "want" in "dir".
+int CountFilesOfType(Env* env, const std::string& dir, FileType want) {
+  std::vector<std::string> files;
+  env->GetChildren(dir, &files);
+  int count = 0;
+  uint64_t number;
+  FileType type;
+  for (const std::string& file : files) {
+    if (ParseFileName(file, &number, &type) && type == want) {
+      count++;
+    }
+  }
+  return count;
+}
+
+}  // namespace
+
+TEST_F(DBTest, SeparateWALDir) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.write_buffer_size = 10000;
+  options.wal_dir = dbname_ + "_wal";
+  Close();
+  DestroyDB(dbname_, options);
+  Reopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_EQ(0, CountFilesOfType(env_, dbname_, kLogFile));
+  ASSERT_EQ(1, CountFilesOfType(env_, options.wal_dir, kLogFile));
+  ASSERT_GT(LogFilesSize(env_, options.wal_dir), 0);
+
+  // Obsolete logs are removed from the log directory.
+  for (int i = 0; i < 500; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'v')));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, CountFilesOfType(env_, options.wal_dir, kLogFile));
+
+  ASSERT_LEVELDB_OK(Put("bar", "v2"));
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+  ASSERT_EQ(std::string(100, 'v'), Get(Key(499)));
+
+  // Repair finds the logs as well.
+  ASSERT_LEVELDB_OK(Put("baz", "v3"));
+  Close();
+  ASSERT_LEVELDB_OK(RepairDB(dbname_, options));
+  Reopen(&options);
+  ASSERT_EQ("v3", Get("baz"));
+
+  Close();
+  ASSERT_LEVELDB_OK(DestroyDB(dbname_, options));
+  ASSERT_EQ(0, CountFilesOfType(env_, options.wal_dir, kLogFile));
+}
+
+TEST_F(DBTest, DBPaths) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  const std::string slow_path = dbname_ + "_slow";
+  options.db_paths.emplace_back(dbname_, 10 << 20);  // Room for level-0
+  options.db_paths.emplace_back(slow_path, 1 << 30);
+  Close();
+  DestroyDB(dbname_, options);
+  Reopen(&options);
+
+  const int N = 100;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'a' + i % 26)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, CountFilesOfType(env_, dbname_, kTableFile));
+  ASSERT_EQ(0, CountFilesOfType(env_, slow_path, kTableFile));
+
+  // Compaction outputs below level-0 go to the second path.
+  for (int level = 0; level < config::kMaxMemCompactLevel + 1; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  ASSERT_EQ(0, CountFilesOfType(env_, dbname_, kTableFile));
+  ASSERT_GT(CountFilesOfType(env_, slow_path, kTableFile), 0);
+
+  ASSERT_LEVELDB_OK(Put(Key(0), "v2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, CountFilesOfType(env_, dbname_, kTableFile));
+
+  Reopen(&options);
+  ASSERT_EQ("v2", Get(Key(0)));
+  for (int i = 1; i < N; i++) {
+    ASSERT_EQ(std::string(100, 'a' + i % 26), Get(Key(i)));
+  }
+
+  // Repair finds the tables in every path.
+  Close();
+  ASSERT_LEVELDB_OK(RepairDB(dbname_, options));
+  Reopen(&options);
+  ASSERT_EQ("v2", Get(Key(0)));
+  ASSERT_EQ(std::string(100, 'a' + 1), Get(Key(1)));
+
+  Close();
+  ASSERT_LEVELDB_OK(DestroyDB(dbname_, options));
+  ASSERT_EQ(0, CountFilesOfType(env_, slow_path, kTableFile));
+}
+
+TEST_F(DBTest, ManifestRollover) {
+  Options options = CurrentOptions();
+  options.max_manifest_file_size = 2000;
+  Reopen(&options);
+
+  std::string first_manifest;
+  ASSERT_LEVELDB_OK(
+      ReadFileToString(env_, CurrentFileName(dbname_), &first_manifest));
+  for (int i = 0; i < 50; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'a' + i % 26)));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+
+  // The MANIFEST was replaced, and the old ones were deleted.
+  std::string manifest;
+  ASSERT_LEVELDB_OK(
+      ReadFileToString(env_, CurrentFileName(dbname_), &manifest));
+  ASSERT_NE(first_manifest, manifest);
+  manifest.resize(manifest.size() - 1);  // Drop the newline
+  uint64_t manifest_size;
+  ASSERT_LEVELDB_OK(
+      env_->GetFileSize(dbname_ + "/" + manifest, &manifest_size));
+  ASSERT_LT(manifest_size, 2 * options.max_manifest_file_size);
+  ASSERT_EQ(1, CountFilesOfType(env_, dbname_, kDescriptorFile));
+
+  Reopen(&options);
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(std::string(100, 'a' + i % 26), Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, WALCompression) {
+  Options options = CurrentOptions();
+  options.wal_compression = kSnappyCompression;
+  options.recycle_log_file_num = 1;
+  Reopen(&options);
+
+  const int N = 100;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + i % 26)));
+  }
+  ASSERT_LEVELDB_OK(Put("small", "v"));
+  std::string out;
+  if (port::Snappy_Compress("aaaa", 4, &out)) {
+    ASSERT_LT(LogFilesSize(env_, dbname_), N * 1000 / 2);
+  }
+
+  // Readers handle compressed records whatever the option says.
+  options.wal_compression = kNoCompression;
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(std::string(1000, 'a' + i % 26), Get(Key(i)));
+  }
+  ASSERT_EQ("v", Get("small"));
+}
+
+TEST_F(DBTest, DisableWAL) {
+  WriteOptions no_wal;
+  no_wal.disable_wal = true;
+  no_wal.sync = true;  // Ignored
+  ASSERT_LEVELDB_OK(db_->Put(no_wal, "foo", "v1"));
+  ASSERT_LEVELDB_OK(Put("bar", "v2"));
+  ASSERT_LEVELDB_OK(db_->Put(no_wal, "baz", "v3"));
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v3", Get("baz"));
+
+  // Only the logged write survives a reopen without a flush.
+  Reopen();
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+  ASSERT_EQ("NOT_FOUND", Get("baz"));
+  const uint64_t log_size = LogFilesSize(env_, dbname_);
+
+  ASSERT_LEVELDB_OK(db_->Put(no_wal, "foo", "v4"));
+  ASSERT_LEVELDB_OK(db_->Delete(no_wal, "bar"));
+  ASSERT_EQ(log_size, LogFilesSize(env_, dbname_));
+  ASSERT_LEVELDB_OK(db_->Flush());
+  Reopen();
+  ASSERT_EQ("v4", Get("foo"));
+  ASSERT_EQ("NOT_FOUND", Get("bar"));
+}
+
 // Multi-threaded test:
 namespace {
 
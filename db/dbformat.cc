@@ -104,6 +104,10 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
+Slice InternalKeyComparator::HashIndexKey(const Slice& key) const {
+  return user_comparator_->HashIndexKey(ExtractUserKey(key));
+}
+
 const char* InternalFilterPolicy::Name() const { return user_policy_->Name(); }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
@@ -44,6 +44,11 @@ static const int kMaxMemCompactLevel = 2;
 // Approximate gap in bytes between samples of data read during iteration.
 static const int kReadBytesPeriod = 1048576;
 
+// Compactions copy the live values of a blob file to a new blob file once
+// at least this fraction of the file is garbage, so that the old file can
+// be deleted.
+static const double kBlobGarbageRatioForRelocation = 0.5;
+
 }  // namespace config
 
 class InternalKey;
@@ -53,14 +58,21 @@ class InternalKey;
 // data structures.
 // 1字节大小，表示操作是delete还是put。
 // 若delete则操作的数据只有key，put操作则包含key和value
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+// kTypeBlobIndex entries are values whose contents live in a blob file;
+// the entry holds the encoded BlobIndex of the value.
+enum ValueType {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  kTypeMerge = 0x2,
+  kTypeBlobIndex = 0x3
+};
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeBlobIndex;
 
 // 序列号,64位无符号数
 typedef uint64_t SequenceNumber;
@@ -119,6 +131,7 @@ class InternalKeyComparator : public Comparator {
   void FindShortestSeparator(std::string* start,
                              const Slice& limit) const override;
   void FindShortSuccessor(std::string* key) const override;
+  Slice HashIndexKey(const Slice& key) const override;
 
   const Comparator* user_comparator() const { return user_comparator_; }
 
@@ -132,6 +145,7 @@ class InternalFilterPolicy : public FilterPolicy {
 
  public:
   explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) {}
+  const FilterPolicy* user_policy() const { return user_policy_; }
   const char* Name() const override;
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override;
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
@@ -188,7 +202,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<uint8_t>(kTypeValue));
+  return (c <= static_cast<uint8_t>(kTypeBlobIndex));
 }
 
 // A helper class useful for DBImpl::Get()
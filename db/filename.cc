@@ -6,6 +6,7 @@
 
 #include <cassert>
 #include <cstdio>
+#include <random>
 
 #include "db/dbformat.h"
 #include "leveldb/env.h"
@@ -40,6 +41,11 @@ std::string SSTTableFileName(const std::string& dbname, uint64_t number) {
   return MakeFileName(dbname, number, "sst");
 }
 
+std::string BlobFileName(const std::string& dbname, uint64_t number) {
+  assert(number > 0);
+  return MakeFileName(dbname, number, "blob");
+}
+
 std::string DescriptorFileName(const std::string& dbname, uint64_t number) {
   assert(number > 0);
   char buf[100];
@@ -59,6 +65,10 @@ std::string TempFileName(const std::string& dbname, uint64_t number) {
   return MakeFileName(dbname, number, "dbtmp");
 }
 
+std::string IdentityFileName(const std::string& dbname) {
+  return dbname + "/IDENTITY";
+}
+
 std::string InfoLogFileName(const std::string& dbname) {
   return dbname + "/LOG";
 }
@@ -70,6 +80,7 @@ std::string OldInfoLogFileName(const std::string& dbname) {
 
 // Owned filenames have the form:
 //    dbname/CURRENT
+//    dbname/IDENTITY
 //    dbname/LOCK
 //    dbname/LOG
 //    dbname/LOG.old
@@ -81,6 +92,9 @@ bool ParseFileName(const std::string& filename, uint64_t* number,
   if (rest == "CURRENT") {
     *number = 0;
     *type = kCurrentFile;
+  } else if (rest == "IDENTITY") {
+    *number = 0;
+    *type = kIdentityFile;
   } else if (rest == "LOCK") {
     *number = 0;
     *type = kDBLockFile;
@@ -112,6 +126,8 @@ bool ParseFileName(const std::string& filename, uint64_t* number,
       *type = kTableFile;
     } else if (suffix == Slice(".dbtmp")) {
       *type = kTempFile;
+    } else if (suffix == Slice(".blob")) {
+      *type = kBlobFile;
     } else {
       return false;
     }
@@ -138,4 +154,24 @@ Status SetCurrentFile(Env* env, const std::string& dbname,
   return s;
 }
 
+Status GetDBIdentity(Env* env, const std::string& dbname, bool create,
+                     std::string* identity) {
+  const std::string fname = IdentityFileName(dbname);
+  Status s = ReadFileToString(env, fname, identity);
+  if (s.ok() && identity->empty()) {
+    s = Status::Corruption(fname, "empty identity file");
+  }
+  if (!s.ok() && create) {
+    // 128 random bits in hex.  A torn write merely yields another
+    // identity next time.
+    std::random_device random;
+    char buf[33];
+    std::snprintf(buf, sizeof(buf), "%08x%08x%08x%08x", random(), random(),
+                  random(), random());
+    *identity = buf;
+    s = WriteStringToFileSync(env, *identity, fname);
+  }
+  return s;
+}
+
 }  // namespace leveldb
@@ -25,7 +25,9 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile  // Either the current one, or an old one
+  kInfoLogFile,  // Either the current one, or an old one
+  kBlobFile,
+  kIdentityFile
 };
 
 // Return the name of the log file with the specified number
@@ -43,6 +45,11 @@ std::string TableFileName(const std::string& dbname, uint64_t number);
 // "dbname".
 std::string SSTTableFileName(const std::string& dbname, uint64_t number);
 
+// Return the name of the blob file with the specified number
+// in the db named by "dbname".  The result will be prefixed with
+// "dbname".
+std::string BlobFileName(const std::string& dbname, uint64_t number);
+
 // Return the name of the descriptor file for the db named by
 // "dbname" and the specified incarnation number.  The result will be
 // prefixed with "dbname".
@@ -61,6 +68,10 @@ std::string LockFileName(const std::string& dbname);
 // The result will be prefixed with "dbname".
 std::string TempFileName(const std::string& dbname, uint64_t number);
 
+// Return the name of the identity file for "dbname".  It holds a random
+// string that tells this DB apart from every other one.
+std::string IdentityFileName(const std::string& dbname);
+
 // Return the name of the info log file for "dbname".
 std::string InfoLogFileName(const std::string& dbname);
 
@@ -78,6 +89,11 @@ bool ParseFileName(const std::string& filename, uint64_t* number,
 Status SetCurrentFile(Env* env, const std::string& dbname,
                       uint64_t descriptor_number);
 
+// Store the identity of the db named "dbname" in *identity, creating the
+// identity file first if it is missing and "create" is set.
+Status GetDBIdentity(Env* env, const std::string& dbname, bool create,
+                     std::string* identity);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_FILENAME_H_
@@ -21,9 +21,23 @@ enum RecordType {
   // For fragments
   kFirstType = 2,
   kMiddleType = 3,
-  kLastType = 4
+  kLastType = 4,
+
+  // Types of records written to log files that may be reused: the header
+  // also holds the log number, so that a reader can tell records of the
+  // current log from stale ones left by an earlier use of the file.
+  kRecyclableFullType = 5,
+  kRecyclableFirstType = 6,
+  kRecyclableMiddleType = 7,
+  kRecyclableLastType = 8
 };
-static const int kMaxRecordType = kLastType;
+
+// Set in the type of every fragment of a record whose payload was
+// compressed as a whole (see Options::wal_compression).  The compressed
+// payload is followed by one byte holding its CompressionType.
+static const int kCompressedFlag = 0x10;
+
+static const int kMaxRecordType = kRecyclableLastType | kCompressedFlag;
 
 // 日志读取时的Block大小，32KB
 static const int kBlockSize = 32768;
@@ -31,6 +45,11 @@ static const int kBlockSize = 32768;
 // Header is checksum (4 bytes), length (2 bytes), type (1 byte).
 static const int kHeaderSize = 4 + 2 + 1;
 
+// Header of recyclable records is checksum (4 bytes), length (2 bytes),
+// type (1 byte), log number (4 bytes).  The checksum covers the type, the
+// log number and the payload.
+static const int kRecyclableHeaderSize = kHeaderSize + 4;
+
 }  // namespace log
 }  // namespace leveldb
 
@@ -7,6 +7,8 @@
 #include <cstdio>
 
 #include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -16,7 +18,7 @@ namespace log {
 Reader::Reporter::~Reporter() = default;
 
 Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-               uint64_t initial_offset)
+               uint64_t initial_offset, uint64_t log_number)
     : file_(file),
       reporter_(reporter),
       checksum_(checksum),
@@ -26,7 +28,9 @@ Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
       last_record_offset_(0),
       end_of_buffer_offset_(0),
       initial_offset_(initial_offset),
-      resyncing_(initial_offset > 0) {}
+      resyncing_(initial_offset > 0),
+      log_number_(static_cast<uint32_t>(log_number)),
+      recycled_(false) {}
 
 Reader::~Reader() { delete[] backing_store_; }
 
@@ -63,19 +67,32 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
   scratch->clear();
   record->clear();
   bool in_fragmented_record = false;
+  bool compressed_record = false;  // Of the fragmented record
   // Record offset of the logical record that we're reading
   // 0 is a dummy value to make compilers happy
   uint64_t prospective_record_offset = 0;
 
   Slice fragment;
   while (true) {
-    const unsigned int record_type = ReadPhysicalRecord(&fragment);
+    unsigned int record_type = ReadPhysicalRecord(&fragment);
+    bool compressed = false;
+    if (record_type <= kMaxRecordType && (record_type & kCompressedFlag)) {
+      compressed = true;
+      record_type &= ~kCompressedFlag;
+    }
+    int header_size = kHeaderSize;
+    if (record_type >= kRecyclableFullType &&
+        record_type <= kRecyclableLastType) {
+      // Recyclable records are assembled like their plain counterparts.
+      header_size = kRecyclableHeaderSize;
+      record_type -= kRecyclableFullType - kFullType;
+    }
 
     // ReadPhysicalRecord may have only had an empty trailer remaining in its
     // internal buffer. Calculate the offset of the next physical record now
     // that it has returned, properly accounting for its header size.
     uint64_t physical_record_offset =
-        end_of_buffer_offset_ - buffer_.size() - kHeaderSize - fragment.size();
+        end_of_buffer_offset_ - buffer_.size() - header_size - fragment.size();
 
     if (resyncing_) {
       if (record_type == kMiddleType) {
@@ -102,6 +119,10 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         prospective_record_offset = physical_record_offset;
         scratch->clear();
         *record = fragment;
+        if (compressed && !Uncompress(record)) {
+          ReportCorruption(fragment.size(), "bad compressed record");
+          break;
+        }
         last_record_offset_ = prospective_record_offset;
         return true;
 
@@ -118,6 +139,7 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         prospective_record_offset = physical_record_offset;
         scratch->assign(fragment.data(), fragment.size());
         in_fragmented_record = true;
+        compressed_record = compressed;
         break;
 
       case kMiddleType:
@@ -136,6 +158,12 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         } else {
           scratch->append(fragment.data(), fragment.size());
           *record = Slice(*scratch);
+          if (compressed_record && !Uncompress(record)) {
+            ReportCorruption(scratch->size(), "bad compressed record");
+            in_fragmented_record = false;
+            scratch->clear();
+            break;
+          }
           last_record_offset_ = prospective_record_offset;
           return true;
         }
@@ -175,6 +203,30 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
 
 uint64_t Reader::LastRecordOffset() { return last_record_offset_; }
 
+bool Reader::Uncompress(Slice* record) {
+  if (record->empty()) {
+    return false;
+  }
+  const char* data = record->data();
+  const size_t n = record->size() - 1;
+  switch (data[n]) {
+    case kSnappyCompression: {
+      size_t ulength = 0;
+      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+        return false;
+      }
+      uncompressed_.resize(ulength);
+      if (!port::Snappy_Uncompress(data, n, &uncompressed_[0])) {
+        return false;
+      }
+      *record = Slice(uncompressed_);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
 void Reader::ReportCorruption(uint64_t bytes, const char* reason) {
   ReportDrop(bytes, Status::Corruption(reason));
 }
@@ -219,9 +271,18 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
     const unsigned int type = header[6];
     const uint32_t length = a | (b << 8);
-    if (kHeaderSize + length > buffer_.size()) {
+    const unsigned int base_type = type & ~kCompressedFlag;
+    const bool recyclable = (base_type >= kRecyclableFullType &&
+                             base_type <= kRecyclableLastType);
+    const int header_size = recyclable ? kRecyclableHeaderSize : kHeaderSize;
+    if (header_size + length > buffer_.size()) {
       size_t drop_size = buffer_.size();
       buffer_.clear();
+      if (recycled_) {
+        // Most likely the stale tail of a reused file.
+        eof_ = true;
+        return kEof;
+      }
       if (!eof_) {
         ReportCorruption(drop_size, "bad record length");
         return kBadRecord;
@@ -240,11 +301,27 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
       return kBadRecord;
     }
 
+    if (recyclable) {
+      if (DecodeFixed32(header + kHeaderSize) != log_number_) {
+        // A record left by an earlier use of the file: the log ends here.
+        buffer_.clear();
+        eof_ = true;
+        return kEof;
+      }
+    }
+
     // Check crc
     if (checksum_) {
       uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(header));
-      uint32_t actual_crc = crc32c::Value(header + 6, 1 + length);
+      uint32_t actual_crc = crc32c::Value(header + 6, header_size - 6 + length);
       if (actual_crc != expected_crc) {
+        if (recycled_) {
+          // Most likely a stale record of a reused file that was partly
+          // overwritten: the log ends here.
+          buffer_.clear();
+          eof_ = true;
+          return kEof;
+        }
         // Drop the rest of the buffer since "length" itself may have
         // been corrupted and if we trust it, we could find some
         // fragment of a real log record that just happens to look
@@ -256,16 +333,19 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
       }
     }
 
-    buffer_.remove_prefix(kHeaderSize + length);
+    buffer_.remove_prefix(header_size + length);
+    if (recyclable) {
+      recycled_ = true;
+    }
 
     // Skip physical record that started before initial_offset_
-    if (end_of_buffer_offset_ - buffer_.size() - kHeaderSize - length <
+    if (end_of_buffer_offset_ - buffer_.size() - header_size - length <
         initial_offset_) {
       result->clear();
       return kBadRecord;
     }
 
-    *result = Slice(header + kHeaderSize, length);
+    *result = Slice(header + header_size, length);
     return type;
   }
 }
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_LOG_READER_H_
 
 #include <cstdint>
+#include <string>
 
 #include "db/log_format.h"
 #include "leveldb/slice.h"
@@ -41,8 +42,12 @@ class Reader {
   //
   // The Reader will start reading at the first record located at physical
   // position >= initial_offset within the file.
+  //
+  // "log_number" is the number of the log file.  Recyclable records (see
+  // kRecyclableFullType) written with another number are stale contents
+  // of a reused file and mark the end of the log.
   Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-         uint64_t initial_offset);
+         uint64_t initial_offset, uint64_t log_number = 0);
 
   Reader(const Reader&) = delete;
   Reader& operator=(const Reader&) = delete;
@@ -81,6 +86,11 @@ class Reader {
   // Return type, or one of the preceding special values
   unsigned int ReadPhysicalRecord(Slice* result);
 
+  // Replace *record, a payload written with kCompressedFlag, by its
+  // uncompressed contents, which are stored in uncompressed_.  Returns
+  // false if the payload cannot be decompressed.
+  bool Uncompress(Slice* record);
+
   // Reports dropped bytes to the reporter.
   // buffer_ must be updated to remove the dropped bytes prior to invocation.
   void ReportCorruption(uint64_t bytes, const char* reason);
@@ -105,6 +115,16 @@ class Reader {
   // particular, a run of kMiddleType and kLastType records can be silently
   // skipped in this mode
   bool resyncing_;
+
+  // Low 32 bits of the log number that recyclable records must carry.
+  uint32_t const log_number_;
+
+  // True once a recyclable record of this log has been read.  The file
+  // may then be a reused one, whose stale tail is not a corruption.
+  bool recycled_;
+
+  // Contents of the last compressed record returned by ReadRecord.
+  std::string uncompressed_;
 };
 
 }  // namespace log
@@ -6,6 +6,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/random.h"
@@ -31,6 +32,12 @@ static std::string NumberString(int n) {
   return std::string(buf);
 }
 
+static bool SnappyCompressionSupported() {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  return port::Snappy_Compress(in.data(), in.size(), &out);
+}
+
 // Return a skewed potentially long string
 static std::string RandomSkewedString(int i, Random* rnd) {
   return BigString(NumberString(i), rnd->Skewed(17));
@@ -54,6 +61,26 @@ class LogTest : public testing::Test {
     writer_ = new Writer(&dest_, dest_.contents_.size());
   }
 
+  // Append and read from now on in the recyclable format of log
+  // "log_number".
+  void UseRecyclableFormat(uint64_t log_number) {
+    delete writer_;
+    writer_ = new Writer(&dest_, dest_.contents_.size(), log_number);
+    delete reader_;
+    reader_ = new Reader(&source_, &report_, true /*checksum*/,
+                         0 /*initial_offset*/, log_number);
+  }
+
+  // Reuse the file for log "log_number": later writes overwrite the
+  // current contents from the start, and the rest is left in place.
+  void ReuseFile(uint64_t log_number) {
+    stale_.swap(dest_.contents_);
+    dest_.contents_.clear();
+    UseRecyclableFormat(log_number);
+  }
+
+  void UseCompression() { writer_->SetCompression(kSnappyCompression); }
+
   void Write(const std::string& msg) {
     ASSERT_TRUE(!reading_) << "Write() after starting to read";
     writer_->AddRecord(Slice(msg));
@@ -64,6 +91,10 @@ class LogTest : public testing::Test {
   std::string Read() {
     if (!reading_) {
       reading_ = true;
+      if (stale_.size() > dest_.contents_.size()) {
+        dest_.contents_.append(stale_, dest_.contents_.size(),
+                               std::string::npos);
+      }
       source_.contents_ = Slice(dest_.contents_);
     }
     std::string scratch;
@@ -228,6 +259,7 @@ class LogTest : public testing::Test {
   static int num_initial_offset_records_;
 
   StringDest dest_;
+  std::string stale_;  // Contents before ReuseFile()
   StringSource source_;
   ReportCollector report_;
   bool reading_;
@@ -554,5 +586,126 @@ TEST_F(LogTest, ReadEnd) { CheckOffsetPastEndReturnsNoRecords(0); }
 
 TEST_F(LogTest, ReadPastEnd) { CheckOffsetPastEndReturnsNoRecords(5); }
 
+TEST_F(LogTest, RecyclableReadWrite) {
+  UseRecyclableFormat(7);
+  Write("foo");
+  Write("");
+  Write(BigString("bar", 3 * kBlockSize));
+  Write("baz");
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ(BigString("bar", 3 * kBlockSize), Read());
+  ASSERT_EQ("baz", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST_F(LogTest, RecyclableAfterPlainRecords) {
+  Write("hello");
+  UseRecyclableFormat(3);
+  Write("world");
+  ASSERT_EQ("hello", Read());
+  ASSERT_EQ("world", Read());
+  ASSERT_EQ("EOF", Read());
+}
+
+TEST_F(LogTest, ReusedFileEndsAtStaleRecords) {
+  UseRecyclableFormat(1);
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    Write(NumberString(i));
+  }
+  ReuseFile(2);
+  Write("foo");
+  Write("bar");
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+  ASSERT_EQ("", ReportMessage());
+}
+
+TEST_F(LogTest, ReusedFileEndsInsideStaleRecord) {
+  UseRecyclableFormat(1);
+  Write(BigString("old", 2 * kBlockSize));
+  ReuseFile(2);
+  Write(BigString("new", 1000));
+  ASSERT_EQ(BigString("new", 1000), Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+  ASSERT_EQ("", ReportMessage());
+}
+
+TEST_F(LogTest, UnwrittenReusedFileIsEmpty) {
+  UseRecyclableFormat(1);
+  Write("foo");
+  ReuseFile(2);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST_F(LogTest, RecyclableChecksumMismatch) {
+  UseRecyclableFormat(1);
+  Write("foo");
+  IncrementByte(0, 10);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(14, DroppedBytes());
+  ASSERT_EQ("OK", MatchError("checksum mismatch"));
+}
+
+TEST_F(LogTest, CompressedReadWrite) {
+  // Without a codec the records are written uncompressed.
+  UseCompression();
+  Write("foo");
+  Write("");
+  Write(std::string(3 * kBlockSize, 'x'));
+  Write("baz");
+  if (SnappyCompressionSupported()) {
+    ASSERT_LT(WrittenBytes(), kBlockSize);
+  }
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ(std::string(3 * kBlockSize, 'x'), Read());
+  ASSERT_EQ("baz", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST_F(LogTest, CompressedFragmentedRecord) {
+  if (!SnappyCompressionSupported())
+    GTEST_SKIP() << "skipping compression tests";
+
+  // Compresses to more than a block.
+  Random rnd(301);
+  std::string record;
+  while (record.size() < 10 * kBlockSize) {
+    record.append(4 + rnd.Uniform(16), 'a' + rnd.Uniform(26));
+  }
+  UseRecyclableFormat(1);
+  UseCompression();
+  Write(record);
+  Write("foo");
+  ASSERT_GT(WrittenBytes(), kBlockSize);
+  ASSERT_LT(WrittenBytes(), record.size());
+  ASSERT_EQ(record, Read());
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST_F(LogTest, BadCompressedRecord) {
+  if (!SnappyCompressionSupported())
+    GTEST_SKIP() << "skipping compression tests";
+
+  UseCompression();
+  Write(std::string(1000, 'x'));
+  const int length = WrittenBytes() - kHeaderSize;
+  SetByte(kHeaderSize + length - 1, 0x7f);  // Unknown compression type
+  FixChecksum(0, length);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(length, DroppedBytes());
+  ASSERT_EQ("OK", MatchError("bad compressed record"));
+}
+
 }  // namespace log
 }  // namespace leveldb
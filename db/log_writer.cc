@@ -7,6 +7,7 @@
 #include <cstdint>
 
 #include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -20,12 +21,33 @@ static void InitTypeCrc(uint32_t* type_crc) {
   }
 }
 
-Writer::Writer(WritableFile* dest) : dest_(dest), block_offset_(0) {
+Writer::Writer(WritableFile* dest)
+    : dest_(dest),
+      block_offset_(0),
+      recyclable_(false),
+      log_number_(0),
+      manual_flush_(false),
+      compression_(kNoCompression) {
   InitTypeCrc(type_crc_);
 }
 
 Writer::Writer(WritableFile* dest, uint64_t dest_length)
-    : dest_(dest), block_offset_(dest_length % kBlockSize) {
+    : dest_(dest),
+      block_offset_(dest_length % kBlockSize),
+      recyclable_(false),
+      log_number_(0),
+      manual_flush_(false),
+      compression_(kNoCompression) {
+  InitTypeCrc(type_crc_);
+}
+
+Writer::Writer(WritableFile* dest, uint64_t dest_length, uint64_t log_number)
+    : dest_(dest),
+      block_offset_(dest_length % kBlockSize),
+      recyclable_(true),
+      log_number_(static_cast<uint32_t>(log_number)),
+      manual_flush_(false),
+      compression_(kNoCompression) {
   InitTypeCrc(type_crc_);
 }
 
@@ -33,33 +55,48 @@ Writer::~Writer() = default;
 
 // 写Record至文件中。保证按BlockSize(32KB)对其
 Status Writer::AddRecord(const Slice& slice) {
-  const char* ptr = slice.data();
-  size_t left = slice.size();
+  // Compress the record as a whole, so that its fragments need not be
+  // decompressed one by one.
+  Slice payload = slice;
+  int flags = 0;
+  if (compression_ == kSnappyCompression &&
+      port::Snappy_Compress(slice.data(), slice.size(), &compressed_) &&
+      compressed_.size() + 1 < slice.size() - (slice.size() / 8u)) {
+    compressed_.push_back(static_cast<char>(kSnappyCompression));
+    payload = compressed_;
+    flags = kCompressedFlag;
+  }
+
+  const char* ptr = payload.data();
+  size_t left = payload.size();
 
   // Fragment the record if necessary and emit it.  Note that if slice
   // is empty, we still want to iterate once to emit a single
   // zero-length record
   Status s;
   bool begin = true;
+  const int header_size = recyclable_ ? kRecyclableHeaderSize : kHeaderSize;
   do {
     const int leftover = kBlockSize - block_offset_;
     assert(leftover >= 0);
-    if (leftover < kHeaderSize) {
+    if (leftover < header_size) {
       // 当一个 32KB的block中剩余的空间 小于 日志的header大小(定义为7Bytes)时，
       // 填充剩余空间，并选择新的block
       // Switch to a new block
       if (leftover > 0) {
-        // Fill the trailer (literal below relies on kHeaderSize being 7)
-        static_assert(kHeaderSize == 7, "");
-        dest_->Append(Slice("\x00\x00\x00\x00\x00\x00", leftover));
+        // Fill the trailer (literal below relies on kRecyclableHeaderSize
+        // being 11)
+        static_assert(kRecyclableHeaderSize == 11, "");
+        dest_->Append(Slice("\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+                            leftover));
       }
       block_offset_ = 0;
     }
 
-    // Invariant: we never leave < kHeaderSize bytes in a block.
-    assert(kBlockSize - block_offset_ - kHeaderSize >= 0);
+    // Invariant: we never leave < header_size bytes in a block.
+    assert(kBlockSize - block_offset_ - header_size >= 0);
 
-    const size_t avail = kBlockSize - block_offset_ - kHeaderSize;
+    const size_t avail = kBlockSize - block_offset_ - header_size;
     // 用于对数据进行可能的分段(比较数据大小与block中剩余可用的空间大小)
     const size_t fragment_length = (left < avail) ? left : avail;
 
@@ -67,14 +104,15 @@ Status Writer::AddRecord(const Slice& slice) {
     const bool end = (left == fragment_length);
     // 日志数据在block中存储的不同类型
     if (begin && end) {
-      type = kFullType;
+      type = recyclable_ ? kRecyclableFullType : kFullType;
     } else if (begin) {
-      type = kFirstType;
+      type = recyclable_ ? kRecyclableFirstType : kFirstType;
     } else if (end) {
-      type = kLastType;
+      type = recyclable_ ? kRecyclableLastType : kLastType;
     } else {
-      type = kMiddleType;
+      type = recyclable_ ? kRecyclableMiddleType : kMiddleType;
     }
+    type = static_cast<RecordType>(type | flags);
     // 将日志分段后，调用EmitPhysicalRecord()向文件中写入一段日志，并刷新
     s = EmitPhysicalRecord(type, ptr, fragment_length);
     ptr += fragment_length;
@@ -87,35 +125,41 @@ Status Writer::AddRecord(const Slice& slice) {
 //触发日志的物理记录
 Status Writer::EmitPhysicalRecord(RecordType t, const char* ptr,
                                   size_t length) {
+  const int header_size = recyclable_ ? kRecyclableHeaderSize : kHeaderSize;
   assert(length <= 0xffff);  // Must fit in two bytes
-  assert(block_offset_ + kHeaderSize + length <= kBlockSize);
+  assert(block_offset_ + header_size + length <= kBlockSize);
 
   // Format the header
   // 构建header信息,前4字节存储CRC32校验值，后面存储长度和Record类型
-  char buf[kHeaderSize];
+  char buf[kRecyclableHeaderSize];
   buf[4] = static_cast<char>(length & 0xff);
   buf[5] = static_cast<char>(length >> 8);
   buf[6] = static_cast<char>(t);
 
-  // Compute the crc of the record type and the payload.
+  // Compute the crc of the record type, the log number and the payload.
   // 根据日志在block的分布类型，计算crc校验
-  uint32_t crc = crc32c::Extend(type_crc_[t], ptr, length);
+  uint32_t crc = type_crc_[t];
+  if (recyclable_) {
+    EncodeFixed32(buf + kHeaderSize, log_number_);
+    crc = crc32c::Extend(crc, buf + kHeaderSize, 4);
+  }
+  crc = crc32c::Extend(crc, ptr, length);
   crc = crc32c::Mask(crc);  // Adjust for storage
   EncodeFixed32(buf, crc);
 
   // Write the header and the payload
   // 向文件中写入header和payload
-  Status s = dest_->Append(Slice(buf, kHeaderSize));
+  Status s = dest_->Append(Slice(buf, header_size));
   if (s.ok()) {
     // 向文件中写入操作数据
     s = dest_->Append(Slice(ptr, length));
-    if (s.ok()) {
+    if (s.ok() && !manual_flush_) {
       // 进行Flush()
       s = dest_->Flush();
     }
   }
   // 修改块内偏移
-  block_offset_ += kHeaderSize + length;
+  block_offset_ += header_size + length;
   return s;
 }
 
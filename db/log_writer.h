@@ -6,8 +6,10 @@
 #define STORAGE_LEVELDB_DB_LOG_WRITER_H_
 
 #include <cstdint>
+#include <string>
 
 #include "db/log_format.h"
+#include "leveldb/options.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 
@@ -30,6 +32,13 @@ class Writer {
   // "*dest" must remain live while this Writer is in use.
   Writer(WritableFile* dest, uint64_t dest_length);
 
+  // Create a writer that will append data to "*dest" using the recyclable
+  // record format, which tags every record with "log_number" (see
+  // kRecyclableFullType).  "*dest" may hold stale records from an earlier
+  // use; they are overwritten from offset "dest_length" on.
+  // "*dest" must remain live while this Writer is in use.
+  Writer(WritableFile* dest, uint64_t dest_length, uint64_t log_number);
+
   Writer(const Writer&) = delete;
   Writer& operator=(const Writer&) = delete;
 
@@ -39,11 +48,24 @@ class Writer {
   // 会被DB::Write()调用
   Status AddRecord(const Slice& slice);
 
+  // If "manual" is true, AddRecord() leaves records in the buffer of
+  // "*dest" and the owner of "*dest" is responsible for flushing it.
+  void SetManualFlush(bool manual) { manual_flush_ = manual; }
+
+  // Compress records with "type" from now on.  Records that do not shrink
+  // by at least 12.5% are stored uncompressed.
+  void SetCompression(CompressionType type) { compression_ = type; }
+
  private:
   Status EmitPhysicalRecord(RecordType type, const char* ptr, size_t length);
 
   WritableFile* dest_;
   int block_offset_;  // Current offset in block
+  const bool recyclable_;
+  const uint32_t log_number_;  // Low 32 bits; only used if recyclable_
+  bool manual_flush_;
+  CompressionType compression_;
+  std::string compressed_;  // Buffer for the compressed record
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
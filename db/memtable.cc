@@ -4,6 +4,7 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/merge_helper.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -104,12 +105,19 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   table_.Insert(buf);
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+static void UnrefMemTable(void* arg1, void* arg2) {
+  reinterpret_cast<MemTable*>(arg1)->Unref();
+}
+
+bool MemTable::Get(const LookupKey& key, PinnableSlice* value, Status* s,
+                   MergeContext* merge_context) {
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   // 通过迭代器，从跳表中查询需要的MemTableKey
   iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  // Entries for the same user key are ordered from newest to oldest, so
+  // keep walking while we only see merge operands.
+  for (; iter.Valid(); iter.Next()) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -125,19 +133,41 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
-          return true;
+            Slice(key_ptr, key_length - 8), key.user_key()) != 0) {
+      break;
+    }
+    // Correct user key
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    switch (static_cast<ValueType>(tag & 0xff)) {
+      case kTypeValue: {
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        if (merge_context->empty()) {
+          value->PinSlice(v);
+          Ref();
+          value->RegisterCleanup(&UnrefMemTable, this, nullptr);
+        } else {
+          *s = merge_context->Finish(key.user_key(), &v, value->GetSelf());
+          value->PinSelf();
         }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
+        return true;
       }
+      case kTypeDeletion:
+        if (merge_context->empty()) {
+          *s = Status::NotFound(Slice());
+        } else {
+          *s = merge_context->Finish(key.user_key(), nullptr,
+                                     value->GetSelf());
+          value->PinSelf();
+        }
+        return true;
+      case kTypeMerge:
+        merge_context->AddOlderOperand(
+            GetLengthPrefixedSlice(key_ptr + key_length));
+        break;
+      case kTypeBlobIndex:
+        // Values are only moved to blob files when tables are built.
+        *s = Status::Corruption("unexpected blob index in memtable");
+        return true;
     }
   }
   return false;
@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
 #include <string>
 
 #include "db/dbformat.h"
@@ -16,6 +17,7 @@ namespace leveldb {
 
 class InternalKeyComparator;
 class MemTableIterator;
+class MergeContext;
 
 // 内存数据库
 class MemTable {
@@ -31,14 +33,14 @@ class MemTable {
 
   // Increase reference count.
   // 增加引用计数
-  void Ref() { ++refs_; }
+  void Ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
 
   // Drop reference count.  Delete if no more references exist.
   // 减少引用计数
   void Unref() {
-    --refs_;
-    assert(refs_ >= 0);
-    if (refs_ <= 0) {
+    const int refs = refs_.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    assert(refs >= 0);
+    if (refs <= 0) {
       delete this;
     }
   }
@@ -65,11 +67,18 @@ class MemTable {
            const Slice& value);
 
   // If memtable contains a value for key, store it in *value and return true.
+  // The value is pinned in place: *value holds a reference to this
+  // memtable until it is released.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
+  // Merge operands found for key are added to *merge_context; if they
+  // end at a value or a deletion in this memtable, the merged result is
+  // stored in *value (or the merge error in *status) and true is returned.
   // Else, return false.
+  // REQUIRES: !value->IsPinned()
   // 读接口
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  bool Get(const LookupKey& key, PinnableSlice* value, Status* s,
+           MergeContext* merge_context);
 
  private:
   friend class MemTableIterator;
@@ -88,7 +97,9 @@ class MemTable {
   ~MemTable();  // Private since only Unref() should be used to delete it
 
   KeyComparator comparator_;  // 比较器
-  int refs_;                  // 引用计数
+  // 引用计数.  Atomic since values pinned by Get() release their
+  // reference without holding the DB mutex.
+  std::atomic<int> refs_;
   Arena arena_;               // 内存池
   Table table_;               // 跳表
 };
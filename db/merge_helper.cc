@@ -0,0 +1,60 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+Status MergeContext::Finish(const Slice& user_key, const Slice* existing_value,
+                            std::string* value) const {
+  if (merge_operator_ == nullptr) {
+    return Status::NotSupported("merge operand found but no merge operator",
+                                user_key);
+  }
+
+  // Build the result in a separate buffer since existing_value may
+  // point into *value.
+  std::string result;
+  Slice current;
+  const Slice* base = existing_value;
+  for (const std::string& operand : operands_) {
+    std::string merged;
+    if (!merge_operator_->Merge(user_key, base, operand, &merged)) {
+      return Status::Corruption("merge operator failed for key", user_key);
+    }
+    result.swap(merged);
+    current = result;
+    base = &current;
+  }
+  if (base == existing_value) {
+    // No operands: the result is the existing value itself.
+    if (existing_value != nullptr) {
+      result.assign(existing_value->data(), existing_value->size());
+    }
+  }
+  value->swap(result);
+  return Status::OK();
+}
+
+bool MergeContext::PartialMerge(const Slice& user_key,
+                                std::string* operand) const {
+  if (merge_operator_ == nullptr || operands_.empty()) {
+    return false;
+  }
+  std::string result = operands_.front();
+  for (size_t i = 1; i < operands_.size(); i++) {
+    std::string merged;
+    if (!merge_operator_->PartialMerge(user_key, result, operands_[i],
+                                       &merged)) {
+      return false;
+    }
+    result.swap(merged);
+  }
+  operand->swap(result);
+  return true;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <deque>
+#include <string>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class MergeOperator;
+
+// MergeContext collects the merge operands found for a single user key
+// while a read walks the memtables and sstables, and folds them into the
+// base value (if any) once that has been located.
+class MergeContext {
+ public:
+  // "merge_operator" may be nullptr, in which case Finish() fails.
+  explicit MergeContext(const MergeOperator* merge_operator)
+      : merge_operator_(merge_operator) {}
+
+  MergeContext(const MergeContext&) = delete;
+  MergeContext& operator=(const MergeContext&) = delete;
+
+  bool empty() const { return operands_.empty(); }
+  size_t size() const { return operands_.size(); }
+
+  // Record an operand that is older than all operands recorded so far.
+  void AddOlderOperand(const Slice& operand) {
+    operands_.emplace_front(operand.data(), operand.size());
+  }
+
+  // Record an operand that is newer than all operands recorded so far.
+  void AddNewerOperand(const Slice& operand) {
+    operands_.emplace_back(operand.data(), operand.size());
+  }
+
+  void Clear() { operands_.clear(); }
+
+  // Apply all recorded operands, oldest first, to "existing_value"
+  // (nullptr if the key has no value) and store the result in *value.
+  // "existing_value" may point into *value.
+  Status Finish(const Slice& user_key, const Slice* existing_value,
+                std::string* value) const;
+
+  // Try to combine all recorded operands into a single operand using
+  // MergeOperator::PartialMerge().  Stores the result in *operand and
+  // returns true on success.
+  bool PartialMerge(const Slice& user_key, std::string* operand) const;
+
+ private:
+  const MergeOperator* const merge_operator_;
+  std::deque<std::string> operands_;  // Oldest first
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
@@ -14,6 +14,8 @@
 //        all tables (see 2c)
 //      - compaction pointers are cleared
 //      - every table file is added at level 0
+//      - tables added by DB::IngestExternalFile keep the global sequence
+//        number recorded for them in the old descriptors
 //
 // Possible optimization 1:
 //   (a) Compute total size and use to pick appropriate max-level M
@@ -24,6 +26,8 @@
 //   Store per-table metadata (smallest, largest, largest-seq#, ...)
 //   in the table's meta section to speed up ScanTable.
 
+#include <map>
+
 #include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -70,6 +74,7 @@ class Repairer {
   Status Run() {
     Status status = FindFiles();
     if (status.ok()) {
+      FindIngestedFiles();
       ConvertLogFilesToTables();
       ExtractMetaData();
       status = WriteDescriptor();
@@ -118,19 +123,99 @@ class Repairer {
           if (type == kLogFile) {
             logs_.push_back(number);
           } else if (type == kTableFile) {
-            table_numbers_.push_back(number);
+            // Found below with the other table paths
+          } else if (type == kBlobFile) {
+            blob_numbers_.push_back(number);
           } else {
             // Ignore other files
           }
         }
       }
     }
+
+    if (options_.wal_dir != dbname_) {
+      // Only log files are expected in the separate log directory.  It
+      // may not exist if the database never got to create it.
+      env_->GetChildren(options_.wal_dir, &filenames);  // Ignoring errors
+      for (size_t i = 0; i < filenames.size(); i++) {
+        if (ParseFileName(filenames[i], &number, &type) &&
+            type == kLogFile) {
+          if (number + 1 > next_file_number_) {
+            next_file_number_ = number + 1;
+          }
+          logs_.push_back(number);
+        }
+      }
+    }
+
+    // Tables are looked for in each of the table paths.
+    for (uint32_t path_id = 0; path_id < options_.db_paths.size();
+         path_id++) {
+      const std::string& dir = options_.db_paths[path_id].path;
+      bool seen = false;
+      for (uint32_t p = 0; p < path_id; p++) {
+        seen = seen || options_.db_paths[p].path == dir;
+      }
+      if (seen || !env_->GetChildren(dir, &filenames).ok()) {
+        continue;
+      }
+      for (size_t i = 0; i < filenames.size(); i++) {
+        if (ParseFileName(filenames[i], &number, &type) &&
+            type == kTableFile) {
+          if (number + 1 > next_file_number_) {
+            next_file_number_ = number + 1;
+          }
+          table_numbers_.push_back(std::make_pair(number, path_id));
+        }
+      }
+    }
     return status;
   }
 
+  // Ingested tables hold user keys, and only the descriptor that added
+  // them knows the sequence number their entries are read with.  Collect
+  // those from whatever can still be read of the old descriptors.
+  void FindIngestedFiles() {
+    struct LogReporter : public log::Reader::Reporter {
+      Logger* info_log;
+      std::string fname;
+      void Corruption(size_t bytes, const Status& s) override {
+        Log(info_log, "%s: dropping %d bytes; %s", fname.c_str(),
+            static_cast<int>(bytes), s.ToString().c_str());
+      }
+    };
+
+    for (size_t i = 0; i < manifests_.size(); i++) {
+      std::string fname = dbname_ + "/" + manifests_[i];
+      SequentialFile* file;
+      if (!env_->NewSequentialFile(fname, &file).ok()) {
+        continue;
+      }
+      LogReporter reporter;
+      reporter.info_log = options_.info_log;
+      reporter.fname = fname;
+      log::Reader reader(file, &reporter, true /*checksum*/,
+                         0 /*initial_offset*/);
+      Slice record;
+      std::string scratch;
+      while (reader.ReadRecord(&record, &scratch)) {
+        VersionEdit edit;
+        if (!edit.DecodeFrom(record).ok()) {
+          continue;
+        }
+        for (const auto& entry : edit.new_files()) {
+          if (entry.second.global_seqno != 0) {
+            ingested_[entry.second.number] = entry.second.global_seqno;
+          }
+        }
+      }
+      delete file;
+    }
+  }
+
   void ConvertLogFilesToTables() {
     for (size_t i = 0; i < logs_.size(); i++) {
-      std::string logname = LogFileName(dbname_, logs_[i]);
+      std::string logname = LogFileName(options_.wal_dir, logs_[i]);
       Status status = ConvertLogToTable(logs_[i]);
       if (!status.ok()) {
         Log(options_.info_log, "Log #%llu: ignoring conversion error: %s",
@@ -154,7 +239,7 @@ class Repairer {
     };
 
     // Open the log file
-    std::string logname = LogFileName(dbname_, log);
+    std::string logname = LogFileName(options_.wal_dir, log);
     SequentialFile* lfile;
     Status status = env_->NewSequentialFile(logname, &lfile);
     if (!status.ok()) {
@@ -171,7 +256,7 @@ class Repairer {
     // propagating bad information (like overly large sequence
     // numbers).
     log::Reader reader(lfile, &reporter, false /*do not checksum*/,
-                       0 /*initial_offset*/);
+                       0 /*initial_offset*/, log);
 
     // Read all the records and add to a memtable
     std::string scratch;
@@ -203,13 +288,14 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta,
+                        nullptr);
     delete iter;
     mem->Unref();
     mem = nullptr;
     if (status.ok()) {
       if (meta.file_size > 0) {
-        table_numbers_.push_back(meta.number);
+        table_numbers_.push_back(std::make_pair(meta.number, meta.path_id));
       }
     }
     Log(options_.info_log, "Log #%llu: %d ops saved to Table #%llu %s",
@@ -220,7 +306,7 @@ class Repairer {
 
   void ExtractMetaData() {
     for (size_t i = 0; i < table_numbers_.size(); i++) {
-      ScanTable(table_numbers_[i]);
+      ScanTable(table_numbers_[i].first, table_numbers_[i].second);
     }
   }
 
@@ -229,25 +315,33 @@ class Repairer {
     // on checksum verification.
     ReadOptions r;
     r.verify_checksums = options_.paranoid_checks;
-    return table_cache_->NewIterator(r, meta.number, meta.file_size);
+    return table_cache_->NewIterator(r, meta.number, meta.path_id,
+                                     meta.file_size, meta.global_seqno);
   }
 
-  void ScanTable(uint64_t number) {
+  void ScanTable(uint64_t number, uint32_t path_id) {
     TableInfo t;
     t.meta.number = number;
-    std::string fname = TableFileName(dbname_, number);
+    t.meta.path_id = path_id;
+    std::map<uint64_t, SequenceNumber>::const_iterator ingested =
+        ingested_.find(number);
+    if (ingested != ingested_.end()) {
+      t.meta.global_seqno = ingested->second;
+    }
+    const std::string& dir = options_.db_paths[path_id].path;
+    std::string fname = TableFileName(dir, number);
     Status status = env_->GetFileSize(fname, &t.meta.file_size);
     if (!status.ok()) {
       // Try alternate file name.
-      fname = SSTTableFileName(dbname_, number);
+      fname = SSTTableFileName(dir, number);
       Status s2 = env_->GetFileSize(fname, &t.meta.file_size);
       if (s2.ok()) {
         status = Status::OK();
       }
     }
     if (!status.ok()) {
-      ArchiveFile(TableFileName(dbname_, number));
-      ArchiveFile(SSTTableFileName(dbname_, number));
+      ArchiveFile(TableFileName(dir, number));
+      ArchiveFile(SSTTableFileName(dir, number));
       Log(options_.info_log, "Table #%llu: dropped: %s",
           (unsigned long long)t.meta.number, status.ToString().c_str());
       return;
@@ -296,7 +390,8 @@ class Repairer {
     // new table over the source.
 
     // Create builder.
-    std::string copy = TableFileName(dbname_, next_file_number_++);
+    const std::string& dir = options_.db_paths[t.meta.path_id].path;
+    std::string copy = TableFileName(dir, next_file_number_++);
     WritableFile* file;
     Status s = env_->NewWritableFile(copy, &file);
     if (!s.ok()) {
@@ -313,6 +408,9 @@ class Repairer {
     }
     delete iter;
 
+    // The copy holds internal keys like any other table.
+    t.meta.global_seqno = 0;
+
     ArchiveFile(src);
     if (counter == 0) {
       builder->Abandon();  // Nothing to save
@@ -332,7 +430,7 @@ class Repairer {
     file = nullptr;
 
     if (counter > 0 && s.ok()) {
-      std::string orig = TableFileName(dbname_, t.meta.number);
+      std::string orig = TableFileName(dir, t.meta.number);
       s = env_->RenameFile(copy, orig);
       if (s.ok()) {
         Log(options_.info_log, "Table #%llu: %d entries repaired",
@@ -369,7 +467,19 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+                    t.meta.largest, t.meta.global_seqno, t.meta.path_id);
+    }
+
+    // We do not know which values in the blob files are still referenced,
+    // so keep all of them.
+    for (size_t i = 0; i < blob_numbers_.size(); i++) {
+      uint64_t file_size;
+      if (env_->GetFileSize(BlobFileName(dbname_, blob_numbers_[i]),
+                            &file_size)
+              .ok() &&
+          file_size > 0) {
+        edit_.AddBlobFile(blob_numbers_[i], file_size);
+      }
     }
 
     // std::fprintf(stderr,
@@ -436,8 +546,10 @@ class Repairer {
   VersionEdit edit_;
 
   std::vector<std::string> manifests_;
-  std::vector<uint64_t> table_numbers_;
+  std::vector<std::pair<uint64_t, uint32_t>> table_numbers_;  // (number, path)
+  std::vector<uint64_t> blob_numbers_;
   std::vector<uint64_t> logs_;
+  std::map<uint64_t, SequenceNumber> ingested_;  // Table number -> seqno
   std::vector<TableInfo> tables_;
   uint64_t next_file_number_;
 };
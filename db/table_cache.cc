@@ -4,15 +4,19 @@
 
 #include "db/table_cache.h"
 
+#include <algorithm>
+
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
+#include "port/thread_annotations.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
 struct TableAndFile {
-  RandomAccessFile* file;
+  RandomAccessFile* file;  // Null if the file is kept in the file cache
   Table* table;
 };
 
@@ -23,24 +27,171 @@ static void DeleteEntry(const Slice& key, void* value) {
   delete tf;
 }
 
+static void DeleteCachedFile(const Slice& key, void* value) {
+  delete reinterpret_cast<RandomAccessFile*>(value);
+}
+
 static void UnrefEntry(void* arg1, void* arg2) {
   Cache* cache = reinterpret_cast<Cache*>(arg1);
   Cache::Handle* h = reinterpret_cast<Cache::Handle*>(arg2);
   cache->Release(h);
 }
 
+namespace {
+
+// Tag that every entry of an ingested table carries in its internal key.
+uint64_t IngestedTag(SequenceNumber global_seqno) {
+  return (global_seqno << 8) | kTypeValue;
+}
+
+// Presents the user keys of an ingested table as internal keys that carry
+// the table's global sequence number.
+class IngestedTableIterator : public Iterator {
+ public:
+  IngestedTableIterator(Iterator* iter, const Comparator* ucmp,
+                        SequenceNumber global_seqno)
+      : iter_(iter), ucmp_(ucmp), tag_(IngestedTag(global_seqno)) {}
+
+  ~IngestedTableIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    SaveKey();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    SaveKey();
+  }
+  void Seek(const Slice& target) override {
+    // Each user key appears once in the table, so the entry for the
+    // target's user key sorts before "target" only if its tag is larger.
+    const Slice user_key = ExtractUserKey(target);
+    iter_->Seek(user_key);
+    if (iter_->Valid() && ucmp_->Compare(iter_->key(), user_key) == 0 &&
+        tag_ > DecodeFixed64(target.data() + target.size() - 8)) {
+      iter_->Next();
+    }
+    SaveKey();
+  }
+  void Next() override {
+    iter_->Next();
+    SaveKey();
+  }
+  void Prev() override {
+    iter_->Prev();
+    SaveKey();
+  }
+  Slice key() const override {
+    assert(Valid());
+    return key_;
+  }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  void SaveKey() {
+    if (iter_->Valid()) {
+      Slice k = iter_->key();
+      key_.assign(k.data(), k.size());
+      PutFixed64(&key_, tag_);
+    }
+  }
+
+  Iterator* const iter_;
+  const Comparator* const ucmp_;
+  const uint64_t tag_;
+  std::string key_;
+};
+
+struct IngestedGetState {
+  uint64_t tag;
+  uint64_t target_tag;
+  std::string key;
+  void* arg;
+  void (*handle_result)(void*, const Slice&, const Slice&);
+};
+
+void HandleIngestedEntry(void* arg, const Slice& k, const Slice& v) {
+  IngestedGetState* state = reinterpret_cast<IngestedGetState*>(arg);
+  if (state->tag > state->target_tag) {
+    // Entry is newer than the lookup; the table holds nothing older.
+    return;
+  }
+  state->key.assign(k.data(), k.size());
+  PutFixed64(&state->key, state->tag);
+  (*state->handle_result)(state->arg, state->key, v);
+}
+
+}  // namespace
+
 TableCache::TableCache(const std::string& dbname, const Options& options,
                        int entries)
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {}
+      ingested_options_(options),
+      cache_(NewLRUCache(options.table_metadata_cache_size > 0
+                             ? options.table_metadata_cache_size
+                             : entries)),
+      file_cache_(options.table_metadata_cache_size > 0 ? NewLRUCache(entries)
+                                                        : nullptr) {
+  // "options" has been sanitized by the DB, so its comparator and filter
+  // policy wrap the user's.
+  ingested_options_.comparator =
+      static_cast<const InternalKeyComparator*>(options.comparator)
+          ->user_comparator();
+  if (options.filter_policy != nullptr) {
+    ingested_options_.filter_policy =
+        static_cast<const InternalFilterPolicy*>(options.filter_policy)
+            ->user_policy();
+  }
+}
 
-TableCache::~TableCache() { delete cache_; }
+TableCache::~TableCache() {
+  delete cache_;
+  delete file_cache_;
+}
+
+Status TableCache::OpenFile(uint64_t file_number, uint32_t path_id,
+                            RandomAccessFile** file) {
+  if (path_id >= options_.db_paths.size()) {
+    return Status::InvalidArgument("table in a path missing from db_paths",
+                                   TableFileName(dbname_, file_number));
+  }
+  const std::string& dir = options_.db_paths[path_id].path;
+  std::string fname = TableFileName(dir, file_number);
+  Status s = env_->NewRandomAccessFile(fname, file);
+  if (!s.ok()) {
+    std::string old_fname = SSTTableFileName(dir, file_number);
+    if (env_->NewRandomAccessFile(old_fname, file).ok()) {
+      s = Status::OK();
+    }
+  }
+  return s;
+}
+
+Status TableCache::FindFile(uint64_t file_number, uint32_t path_id,
+                            Cache::Handle** handle) {
+  char buf[sizeof(file_number)];
+  EncodeFixed64(buf, file_number);
+  Slice key(buf, sizeof(buf));
+  *handle = file_cache_->Lookup(key);
+  if (*handle == nullptr) {
+    RandomAccessFile* file;
+    Status s = OpenFile(file_number, path_id, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    *handle = file_cache_->Insert(key, file, 1, &DeleteCachedFile);
+  }
+  return Status::OK();
+}
 
 //  TableCache::FindTable 中会根据 file_number 构建缓存的 Key，
 // 首先尝试在缓存中查找，如果找不到则手动的打开文件、构造 Table
-Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
+Status TableCache::FindTable(uint64_t file_number, uint32_t path_id,
+                             uint64_t file_size, SequenceNumber global_seqno,
                              Cache::Handle** handle) {
   Status s;
   char buf[sizeof(file_number)];
@@ -48,51 +199,112 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
   Slice key(buf, sizeof(buf));
   *handle = cache_->Lookup(key);
   if (*handle == nullptr) {
-    std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = nullptr;
+    Cache::Handle* file_handle = nullptr;
     Table* table = nullptr;
-    s = env_->NewRandomAccessFile(fname, &file);
-    if (!s.ok()) {
-      std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
-        s = Status::OK();
+    if (file_cache_ != nullptr) {
+      s = FindFile(file_number, path_id, &file_handle);
+      if (s.ok()) {
+        file = reinterpret_cast<RandomAccessFile*>(
+            file_cache_->Value(file_handle));
       }
+    } else {
+      s = OpenFile(file_number, path_id, &file);
     }
     if (s.ok()) {
-      s = Table::Open(options_, file, file_size, &table);
+      std::string persistent_cache_key_prefix;
+      if (!db_identity_.empty()) {
+        // A file number can be reused after a crash, so the file size is
+        // part of the prefix as well.
+        persistent_cache_key_prefix = db_identity_;
+        PutFixed64(&persistent_cache_key_prefix, file_number);
+        PutFixed64(&persistent_cache_key_prefix, file_size);
+      }
+      s = Table::Open(global_seqno == 0 ? options_ : ingested_options_, file,
+                      file_size, persistent_cache_key_prefix, &table);
     }
 
     if (!s.ok()) {
       assert(table == nullptr);
-      delete file;
+      if (file_handle == nullptr) {
+        delete file;
+      }
       // We do not cache error results so that if the error is transient,
       // or somebody repairs the file, we recover automatically.
+    } else if (file_handle != nullptr) {
+      // The table does not refer to the file, which stays in file_cache_
+      // and may be evicted from there at any time.
+      table->ForgetFile();
+      TableAndFile* tf = new TableAndFile;
+      tf->file = nullptr;
+      tf->table = table;
+      *handle = cache_->Insert(key, tf, table->ApproximateMemoryUsage(),
+                               &DeleteEntry);
     } else {
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
+    if (file_handle != nullptr) {
+      file_cache_->Release(file_handle);
+    }
+  }
+  return s;
+}
+
+Status TableCache::FindTableAndFile(uint64_t file_number, uint32_t path_id,
+                                    uint64_t file_size,
+                                    SequenceNumber global_seqno,
+                                    Cache::Handle** handle,
+                                    Cache::Handle** file_handle,
+                                    RandomAccessFile** file) {
+  *file_handle = nullptr;
+  Status s = FindTable(file_number, path_id, file_size, global_seqno, handle);
+  if (!s.ok()) {
+    return s;
+  }
+  *file = reinterpret_cast<TableAndFile*>(cache_->Value(*handle))->file;
+  if (*file == nullptr) {
+    s = FindFile(file_number, path_id, file_handle);
+    if (!s.ok()) {
+      cache_->Release(*handle);
+      return s;
+    }
+    *file = reinterpret_cast<RandomAccessFile*>(
+        file_cache_->Value(*file_handle));
   }
   return s;
 }
 
 Iterator* TableCache::NewIterator(const ReadOptions& options,
-                                  uint64_t file_number, uint64_t file_size,
+                                  uint64_t file_number, uint32_t path_id,
+                                  uint64_t file_size,
+                                  SequenceNumber global_seqno,
                                   Table** tableptr) {
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
 
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Cache::Handle* file_handle;
+  RandomAccessFile* file;
+  Status s = FindTableAndFile(file_number, path_id, file_size, global_seqno,
+                              &handle, &file_handle, &file);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
 
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-  Iterator* result = table->NewIterator(options);
+  Iterator* result = table->NewIterator(options, file);
+  if (global_seqno != 0) {
+    result = new IngestedTableIterator(
+        result, ingested_options_.comparator, global_seqno);
+  }
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  if (file_handle != nullptr) {
+    result->RegisterCleanup(&UnrefEntry, file_cache_, file_handle);
+  }
   if (tableptr != nullptr) {
     *tableptr = table;
   }
@@ -100,23 +312,100 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 }
 
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
-                       uint64_t file_size, const Slice& k, void* arg,
+                       uint32_t path_id, uint64_t file_size,
+                       SequenceNumber global_seqno, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
+                                             const Slice&),
+                       PinnableSlice* pinned) {
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Cache::Handle* file_handle;
+  RandomAccessFile* file;
+  Status s = FindTableAndFile(file_number, path_id, file_size, global_seqno,
+                              &handle, &file_handle, &file);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
-    cache_->Release(handle);
+    if (global_seqno == 0) {
+      s = t->InternalGet(options, file, k, arg, handle_result, pinned);
+    } else {
+      IngestedGetState state;
+      state.tag = IngestedTag(global_seqno);
+      state.target_tag = DecodeFixed64(k.data() + k.size() - 8);
+      state.arg = arg;
+      state.handle_result = handle_result;
+      s = t->InternalGet(options, file, ExtractUserKey(k), &state,
+                         &HandleIngestedEntry, pinned);
+    }
+    if (pinned != nullptr && pinned->IsPinned()) {
+      // The value may point into the table itself (e.g. an mmap-ed file).
+      pinned->RegisterCleanup(&UnrefEntry, cache_, handle);
+      if (file_handle != nullptr) {
+        pinned->RegisterCleanup(&UnrefEntry, file_cache_, file_handle);
+      }
+    } else {
+      cache_->Release(handle);
+      if (file_handle != nullptr) {
+        file_cache_->Release(file_handle);
+      }
+    }
   }
   return s;
 }
 
+struct TableCache::LoadState {
+  LoadState(TableCache* cache, const std::vector<FileMetaData*>& files)
+      : cache(cache), files(files), cv(&mu), next(0), running(0) {}
+
+  TableCache* const cache;
+  const std::vector<FileMetaData*>& files;
+  port::Mutex mu;
+  port::CondVar cv;
+  size_t next GUARDED_BY(mu);  // Index of the next file to open
+  int running GUARDED_BY(mu);  // Number of threads still opening files
+};
+
+void TableCache::LoadThread(void* arg) {
+  LoadState* state = reinterpret_cast<LoadState*>(arg);
+  MutexLock l(&state->mu);
+  while (state->next < state->files.size()) {
+    const FileMetaData* f = state->files[state->next++];
+    state->mu.Unlock();
+    Cache::Handle* handle;
+    if (state->cache->FindTable(f->number, f->path_id, f->file_size,
+                                f->global_seqno, &handle)
+            .ok()) {
+      state->cache->cache_->Release(handle);
+    }
+    state->mu.Lock();
+  }
+  if (--state->running == 0) {
+    state->cv.SignalAll();
+  }
+}
+
+void TableCache::LoadTables(const std::vector<FileMetaData*>& files,
+                            int threads) {
+  LoadState state(this, files);
+  MutexLock l(&state.mu);
+  state.running = std::max(1, std::min<int>(threads, files.size()));
+  for (int i = 1; i < state.running; i++) {
+    env_->StartThread(&TableCache::LoadThread, &state);
+  }
+  // This thread opens files too rather than wait idly.
+  state.mu.Unlock();
+  LoadThread(&state);
+  state.mu.Lock();
+  while (state.running > 0) {
+    state.cv.Wait();
+  }
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   cache_->Erase(Slice(buf, sizeof(buf)));
+  if (file_cache_ != nullptr) {
+    file_cache_->Erase(Slice(buf, sizeof(buf)));
+  }
 }
 
 }  // namespace leveldb
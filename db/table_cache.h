@@ -9,9 +9,12 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
+#include "db/version_edit.h"
 #include "leveldb/cache.h"
+#include "leveldb/options.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 
@@ -30,32 +33,89 @@ class TableCache {
 
   ~TableCache();
 
-  // Return an iterator for the specified file number (the corresponding
-  // file length must be exactly "file_size" bytes).  If "tableptr" is
+  // Return an iterator for the specified file number, which lives in
+  // options.db_paths[path_id] (the corresponding
+  // file length must be exactly "file_size" bytes).  A non-zero
+  // "global_seqno" marks an ingested table whose keys are user keys; its
+  // entries are returned as internal keys with that sequence number (see
+  // FileMetaData::global_seqno).  If "tableptr" is
   // non-null, also sets "*tableptr" to point to the Table object
   // underlying the returned iterator, or to nullptr if no Table object
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
-                        uint64_t file_size, Table** tableptr = nullptr);
+                        uint32_t path_id, uint64_t file_size,
+                        SequenceNumber global_seqno,
+                        Table** tableptr = nullptr);
 
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
+  //
+  // If "pinned" is non-null, handle_result may call
+  // pinned->PinSlice(found_value) to keep the value without copying it;
+  // the table and block holding it then stay pinned until *pinned
+  // releases them.
+  // REQUIRES: pinned == nullptr || !pinned->IsPinned()
   Status Get(const ReadOptions& options, uint64_t file_number,
-             uint64_t file_size, const Slice& k, void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             uint32_t path_id, uint64_t file_size,
+             SequenceNumber global_seqno, const Slice& k, void* arg,
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             PinnableSlice* pinned = nullptr);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Open "files" and load them into the cache, using up to "threads"
+  // threads.  Files that cannot be opened are skipped: the error is
+  // reported again when they are used.
+  void LoadTables(const std::vector<FileMetaData*>& files, int threads);
+
+  // Keep the blocks of the tables opened from now on in
+  // options.persistent_cache, under keys derived from "db_identity" (see
+  // GetDBIdentity()), the file number and the file size.
+  // REQUIRES: No table has been opened yet.
+  void SetDBIdentity(const std::string& db_identity) {
+    db_identity_ = db_identity;
+  }
+
  private:
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status OpenFile(uint64_t file_number, uint32_t path_id,
+                  RandomAccessFile** file);
+
+  // Find the open file for "file_number" in file_cache_, opening it if
+  // needed.  REQUIRES: file_cache_ != nullptr
+  Status FindFile(uint64_t file_number, uint32_t path_id,
+                  Cache::Handle** handle);
+
+  struct LoadState;
+  static void LoadThread(void* arg);
+
+  Status FindTable(uint64_t file_number, uint32_t path_id,
+                   uint64_t file_size, SequenceNumber global_seqno,
+                   Cache::Handle**);
+
+  // Find the table and the file to read it from.  *file_handle is set to
+  // the handle in file_cache_ that holds the file, or nullptr if the
+  // table's entry holds it.
+  Status FindTableAndFile(uint64_t file_number, uint32_t path_id,
+                          uint64_t file_size, SequenceNumber global_seqno,
+                          Cache::Handle** handle,
+                          Cache::Handle** file_handle,
+                          RandomAccessFile** file);
 
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
+  Options ingested_options_;  // options_ with user comparator and filter
+  std::string db_identity_;   // Empty unless SetDBIdentity() was called
+
+  // Tables by file number.  If options_.table_metadata_cache_size is set,
+  // entries are charged by the memory of the tables, and their files are
+  // kept in file_cache_, which holds up to "entries" open files.
+  // Otherwise each entry holds its table's file and file_cache_ is null.
   Cache* cache_;
+  Cache* file_cache_;
 };
 
 }  // namespace leveldb
@@ -20,7 +20,11 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  kNewBlobFile = 10,
+  kBlobGarbage = 11,
+  kIngestedFile = 12,
+  kTablePath = 13
 };
 
 void VersionEdit::Clear() {
@@ -37,6 +41,8 @@ void VersionEdit::Clear() {
   compact_pointers_.clear();
   deleted_files_.clear();
   new_files_.clear();
+  new_blob_files_.clear();
+  blob_garbage_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
@@ -75,12 +81,35 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    PutVarint32(dst, f.global_seqno == 0 ? kNewFile : kIngestedFile);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (f.global_seqno != 0) {
+      PutVarint64(dst, f.global_seqno);
+    }
+    if (f.path_id != 0) {
+      // Tables in the first path are written as before, so that older
+      // versions can read their MANIFEST.
+      PutVarint32(dst, kTablePath);
+      PutVarint64(dst, f.number);
+      PutVarint32(dst, f.path_id);
+    }
+  }
+
+  for (size_t i = 0; i < new_blob_files_.size(); i++) {
+    const BlobFileMetaData& f = new_blob_files_[i];
+    PutVarint32(dst, kNewBlobFile);
+    PutVarint64(dst, f.number);
+    PutVarint64(dst, f.file_size);
+  }
+
+  for (size_t i = 0; i < blob_garbage_.size(); i++) {
+    PutVarint32(dst, kBlobGarbage);
+    PutVarint64(dst, blob_garbage_[i].first);   // file number
+    PutVarint64(dst, blob_garbage_[i].second);  // bytes
   }
 }
 
@@ -113,6 +142,9 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   int level;
   uint64_t number;
   FileMetaData f;
+  BlobFileMetaData blob;
+  uint64_t bytes;
+  uint32_t path_id;
   Slice str;
   InternalKey key;
 
@@ -180,12 +212,54 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.global_seqno = 0;
+          f.path_id = 0;
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
         }
         break;
 
+      case kIngestedFile:
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.global_seqno) && f.global_seqno != 0) {
+          f.path_id = 0;
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "ingested-file entry";
+        }
+        break;
+
+      case kTablePath:
+        // Follows the entry of the file it applies to.
+        if (GetVarint64(&input, &number) && GetVarint32(&input, &path_id) &&
+            !new_files_.empty() && new_files_.back().second.number == number) {
+          new_files_.back().second.path_id = path_id;
+        } else {
+          msg = "table path";
+        }
+        break;
+
+      case kNewBlobFile:
+        if (GetVarint64(&input, &blob.number) &&
+            GetVarint64(&input, &blob.file_size)) {
+          new_blob_files_.push_back(blob);
+        } else {
+          msg = "new-blob-file entry";
+        }
+        break;
+
+      case kBlobGarbage:
+        if (GetVarint64(&input, &number) && GetVarint64(&input, &bytes)) {
+          blob_garbage_.push_back(std::make_pair(number, bytes));
+        } else {
+          msg = "blob garbage entry";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -250,6 +324,27 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.global_seqno != 0) {
+      r.append(" @ ");
+      AppendNumberTo(&r, f.global_seqno);
+    }
+    if (f.path_id != 0) {
+      r.append(" path ");
+      AppendNumberTo(&r, f.path_id);
+    }
+  }
+  for (size_t i = 0; i < new_blob_files_.size(); i++) {
+    const BlobFileMetaData& f = new_blob_files_[i];
+    r.append("\n  AddBlobFile: ");
+    AppendNumberTo(&r, f.number);
+    r.append(" ");
+    AppendNumberTo(&r, f.file_size);
+  }
+  for (size_t i = 0; i < blob_garbage_.size(); i++) {
+    r.append("\n  BlobGarbage: ");
+    AppendNumberTo(&r, blob_garbage_[i].first);
+    r.append(" ");
+    AppendNumberTo(&r, blob_garbage_[i].second);
   }
   r.append("\n}\n");
   return r;
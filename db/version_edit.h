@@ -18,7 +18,12 @@ class VersionSet;
 // FileMetaData 记录了 .ldb 文件的元信息，
 // 包括允许查找的次数、文件编号 number 和大小 file_size 以及最小和最大的 Key
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        global_seqno(0),
+        path_id(0) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -26,6 +31,25 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+
+  // Zero for tables written by the DB.  Tables added by
+  // DB::IngestExternalFile hold user keys instead of internal keys, and
+  // every entry in them is read as a value with this sequence number.
+  SequenceNumber global_seqno;
+
+  // Index in Options::db_paths of the directory holding the table.
+  uint32_t path_id;
+};
+
+// BlobFileMetaData tracks how much of a blob file is still referenced.
+// Once every value in the file has been overwritten or deleted the file
+// is dropped from the version and deleted.
+struct BlobFileMetaData {
+  BlobFileMetaData() : number(0), file_size(0), garbage_size(0) {}
+
+  uint64_t number;
+  uint64_t file_size;     // File size in bytes
+  uint64_t garbage_size;  // Bytes of records that are no longer referenced
 };
 
 class VersionEdit {
@@ -62,13 +86,20 @@ class VersionEdit {
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
   // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  // REQUIRES: "global_seqno" is zero unless the file was ingested (see
+  // FileMetaData::global_seqno)
+  // REQUIRES: "path_id" is the index in Options::db_paths of the
+  // directory holding the file
   void AddFile(int level, uint64_t file, uint64_t file_size,
-               const InternalKey& smallest, const InternalKey& largest) {
+               const InternalKey& smallest, const InternalKey& largest,
+               SequenceNumber global_seqno = 0, uint32_t path_id = 0) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.global_seqno = global_seqno;
+    f.path_id = path_id;
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -77,11 +108,30 @@ class VersionEdit {
     deleted_files_.insert(std::make_pair(level, file));
   }
 
+  // Add the specified blob file.
+  void AddBlobFile(uint64_t file, uint64_t file_size) {
+    BlobFileMetaData f;
+    f.number = file;
+    f.file_size = file_size;
+    new_blob_files_.push_back(f);
+  }
+
+  // Record that "bytes" more bytes of the specified blob file are no
+  // longer referenced.
+  void AddBlobGarbage(uint64_t file, uint64_t bytes) {
+    blob_garbage_.push_back(std::make_pair(file, bytes));
+  }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(const Slice& src);
 
   std::string DebugString() const;
 
+  // The files added by this edit, with their levels.
+  const std::vector<std::pair<int, FileMetaData>>& new_files() const {
+    return new_files_;
+  }
+
  private:
   friend class VersionSet;
 
@@ -101,6 +151,8 @@ class VersionEdit {
   std::vector<std::pair<int, InternalKey>> compact_pointers_;
   DeletedFileSet deleted_files_;    // 删除的文件，记录了level和文件号
   std::vector<std::pair<int, FileMetaData>> new_files_; // 新增的文件，记录了level和FileMetaData
+  std::vector<BlobFileMetaData> new_blob_files_;
+  std::vector<std::pair<uint64_t, uint64_t>> blob_garbage_;  // (file, bytes)
 };
 
 }  // namespace leveldb
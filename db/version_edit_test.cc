@@ -27,8 +27,17 @@ TEST(VersionEditTest, EncodeDecode) {
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
                  InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+    edit.AddFile(5, kBig + 1500 + i, kBig + 1600 + i,
+                 InternalKey("bar", kBig + 1700 + i, kTypeValue),
+                 InternalKey("baz", kBig + 1700 + i, kTypeValue),
+                 kBig + 1700 + i);
+    edit.AddFile(2, kBig + 1800 + i, kBig + 1900 + i,
+                 InternalKey("qux", kBig + 2000 + i, kTypeValue),
+                 InternalKey("quz", kBig + 2100 + i, kTypeValue), 0, i);
     edit.RemoveFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
+    edit.AddBlobFile(kBig + 1100 + i, kBig + 1200 + i);
+    edit.AddBlobGarbage(kBig + 1300 + i, kBig + 1400 + i);
   }
 
   edit.SetComparatorName("foo");
@@ -7,10 +7,12 @@
 #include <algorithm>
 #include <cstdio>
 
+#include "db/blob_cache.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -199,6 +201,8 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_ + 8, (*flist_)[index_]->file_size);
+    EncodeFixed64(value_buf_ + 16, (*flist_)[index_]->global_seqno);
+    EncodeFixed32(value_buf_ + 24, (*flist_)[index_]->path_id);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   Status status() const override { return Status::OK(); }
@@ -208,19 +212,22 @@ class Version::LevelFileNumIterator : public Iterator {
   const std::vector<FileMetaData*>* const flist_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size, global
+  // sequence number and path id.
+  mutable char value_buf_[28];
 };
 
 static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 28) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options, DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed32(file_value.data() + 24),
+                              DecodeFixed64(file_value.data() + 8),
+                              DecodeFixed64(file_value.data() + 16));
   }
 }
 
@@ -238,7 +245,8 @@ void Version::AddIterators(const ReadOptions& options,
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
     iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+        options, files_[0][i]->number, files_[0][i]->path_id,
+        files_[0][i]->file_size, files_[0][i]->global_seqno));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -260,6 +268,7 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerging,
 };
 // Saver 负责记录输入的比较器和 user_key，
 // 以及输出的 SaverState 和查找得到的 value
@@ -267,7 +276,10 @@ struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
-  std::string* value;
+  PinnableSlice* value;  // Pinned to the table's memory when found
+  MergeContext* merge_context;
+  SequenceNumber sequence;  // Sequence of the entry that was found
+  bool is_blob_index;       // *value holds a BlobIndex, not the value
 };
 }  // namespace
 // SaveValue 作为查找操作的回调函数，将会在 Seek 操作完成后执行，
@@ -280,9 +292,21 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+      s->sequence = parsed_key.sequence;
+      switch (parsed_key.type) {
+        case kTypeValue:
+        case kTypeBlobIndex:
+          s->state = kFound;
+          s->is_blob_index = (parsed_key.type == kTypeBlobIndex);
+          s->value->PinSlice(v);
+          break;
+        case kTypeDeletion:
+          s->state = kDeleted;
+          break;
+        case kTypeMerge:
+          s->state = kMerging;
+          s->merge_context->AddOlderOperand(v);
+          break;
       }
     }
   }
@@ -325,22 +349,25 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
     if (num_files == 0) continue;
 
     // Binary search to find earliest index whose largest key >= internal_key.
-    uint32_t index = FindFile(vset_->icmp_, files_[level], internal_key);
-    if (index < num_files) {
+    // Entries for user_key may continue into the following files of
+    // the level, so keep going while func asks for more.
+    for (uint32_t index = FindFile(vset_->icmp_, files_[level], internal_key);
+         index < num_files; index++) {
       FileMetaData* f = files_[level][index];
       if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
         // All of "f" is past any data for user_key
-      } else {
-        if (!(*func)(arg, level, f)) {
-          return;
-        }
+        break;
+      }
+      if (!(*func)(arg, level, f)) {
+        return;
       }
     }
   }
 }
 
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    PinnableSlice* value, GetStats* stats,
+                    MergeContext* merge_context) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
@@ -349,6 +376,7 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
     GetStats* stats;
     const ReadOptions* options;
     Slice ikey;
+    std::string merge_key;  // Backing store for ikey while merging
     FileMetaData* last_file_read;
     int last_file_read_level;
 
@@ -369,31 +397,44 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
-      state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
-      if (!state->s.ok()) {
-        state->found = true;
-        return false;
-      }
-      switch (state->saver.state) {
-        case kNotFound:
-          return true;  // Keep searching in other files
-        case kFound:
-          state->found = true;
-          return false;
-        case kDeleted:
-          return false;
-        case kCorrupt:
-          state->s =
-              Status::Corruption("corrupted key for ", state->saver.user_key);
+      while (true) {
+        state->s = state->vset->table_cache_->Get(
+            *state->options, f->number, f->path_id, f->file_size,
+            f->global_seqno, state->ikey, &state->saver, SaveValue,
+            state->saver.value);
+        if (!state->s.ok()) {
           state->found = true;
           return false;
+        }
+        switch (state->saver.state) {
+          case kNotFound:
+            return true;  // Keep searching in other files
+          case kFound:
+            state->found = true;
+            return false;
+          case kDeleted:
+            return false;
+          case kCorrupt:
+            state->s =
+                Status::Corruption("corrupted key for ", state->saver.user_key);
+            state->found = true;
+            return false;
+          case kMerging:
+            // Look for older entries of the same user key, first in the
+            // rest of this file and then in older files.
+            state->saver.state = kNotFound;
+            if (state->saver.sequence == 0) {
+              return true;
+            }
+            state->merge_key.clear();
+            AppendInternalKey(&state->merge_key,
+                              ParsedInternalKey(state->saver.user_key,
+                                                state->saver.sequence - 1,
+                                                kValueTypeForSeek));
+            state->ikey = state->merge_key;
+            break;
+        }
       }
-
-      // Not reached. Added to avoid false compilation warnings of
-      // "control reaches end of non-void function".
-      return false;
     }
   };
 
@@ -411,7 +452,9 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
-  
+  state.saver.merge_context = merge_context;
+  state.saver.is_blob_index = false;
+
   //  Version::ForEachOverlapping 会根据 
   // smallest_key 和 largest_key 筛选出要查找的文件，
   // 再通过回调函数调用 table_cache_->Get 进行查找，
@@ -419,6 +462,29 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   // 如果回调得到的结果是 kFound，就可以提前返回了
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 
+  if (state.found && !state.s.ok()) {
+    return state.s;
+  }
+  if (state.found && state.saver.is_blob_index) {
+    Status s = vset_->blob_cache_->Get(*value, value->GetSelf());
+    if (!s.ok()) {
+      return s;
+    }
+    value->PinSelf();
+  }
+  if (!merge_context->empty()) {
+    // Apply the operands to the value we found, or to nothing if the key
+    // was deleted or never written.
+    Slice existing;
+    if (state.found) {
+      existing = *value;
+    }
+    Status s = merge_context->Finish(state.saver.user_key,
+                                     state.found ? &existing : nullptr,
+                                     value->GetSelf());
+    value->PinSelf();
+    return s;
+  }
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
@@ -444,9 +510,16 @@ bool Version::RecordReadSample(Slice internal_key) {
   struct State {
     GetStats stats;  // Holds first matching file
     int matches;
+    int last_level;  // Level of the last counted match
 
     static bool Match(void* arg, int level, FileMetaData* f) {
       State* state = reinterpret_cast<State*>(arg);
+      // Count at most one file per level above level-0, even when the
+      // entries for the key continue into the next file of the level.
+      if (level > 0 && level == state->last_level) {
+        return true;
+      }
+      state->last_level = level;
       state->matches++;
       if (state->matches == 1) {
         // Remember first match.
@@ -460,6 +533,7 @@ bool Version::RecordReadSample(Slice internal_key) {
 
   State state;
   state.matches = 0;
+  state.last_level = -1;
   ForEachOverlapping(ikey.user_key, internal_key, &state, &State::Match);
 
   // Must have at least two matches since we want to merge across
@@ -583,6 +657,22 @@ std::string Version::DebugString() const {
       r.append("]\n");
     }
   }
+  if (!blob_files_.empty()) {
+    // E.g.,
+    //   --- blob files ---
+    //   12:4096(1024)
+    r.append("--- blob files ---\n");
+    for (const auto& kvp : blob_files_) {
+      const BlobFileMetaData& f = kvp.second;
+      r.push_back(' ');
+      AppendNumberTo(&r, f.number);
+      r.push_back(':');
+      AppendNumberTo(&r, f.file_size);
+      r.push_back('(');
+      AppendNumberTo(&r, f.garbage_size);
+      r.append(")\n");
+    }
+  }
   return r;
 }
 
@@ -620,10 +710,12 @@ class VersionSet::Builder {
   Version* base_;     // 基础版本
   //  levels_ 则储存所有 Level 的 LevelState
   LevelState levels_[config::kNumLevels];
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
 
  public:
   // Initialize a builder with the files from *base and other info from *vset
-  Builder(VersionSet* vset, Version* base) : vset_(vset), base_(base) {
+  Builder(VersionSet* vset, Version* base)
+      : vset_(vset), base_(base), blob_files_(base->blob_files_) {
     base_->Ref();
     BySmallestKey cmp;
     cmp.internal_comparator = &vset_->icmp_;
@@ -696,6 +788,18 @@ class VersionSet::Builder {
       levels_[level].deleted_files.erase(f->number);
       levels_[level].added_files->insert(f);
     }
+
+    // Add new blob files and account for their garbage
+    for (size_t i = 0; i < edit->new_blob_files_.size(); i++) {
+      const BlobFileMetaData& f = edit->new_blob_files_[i];
+      blob_files_[f.number] = f;
+    }
+    for (size_t i = 0; i < edit->blob_garbage_.size(); i++) {
+      auto it = blob_files_.find(edit->blob_garbage_[i].first);
+      if (it != blob_files_.end()) {
+        it->second.garbage_size += edit->blob_garbage_[i].second;
+      }
+    }
   }
 
   // Save the current state in *v.
@@ -744,6 +848,13 @@ class VersionSet::Builder {
       }
 #endif
     }
+
+    // Blob files that hold no live values are dropped
+    for (const auto& kvp : blob_files_) {
+      if (kvp.second.garbage_size < kvp.second.file_size) {
+        v->blob_files_.insert(kvp);
+      }
+    }
   }
 
   void MaybeAddFile(Version* v, int level, FileMetaData* f) {
@@ -772,12 +883,13 @@ class VersionSet::Builder {
  * 也就是在双向链表的尾部插入版本 v，并且将 current_ 指向这个最新的版本
  */
 VersionSet::VersionSet(const std::string& dbname, const Options* options,
-                       TableCache* table_cache,
+                       TableCache* table_cache, BlobCache* blob_cache,
                        const InternalKeyComparator* cmp)
     : env_(options->env),
       dbname_(dbname),
       options_(options),
       table_cache_(table_cache),
+      blob_cache_(blob_cache),
       icmp_(*cmp),
       next_file_number_(2),
       manifest_file_number_(0),  // Filled by Recover()
@@ -786,6 +898,7 @@ VersionSet::VersionSet(const std::string& dbname, const Options* options,
       prev_log_number_(0),
       descriptor_file_(nullptr),
       descriptor_log_(nullptr),
+      manifest_size_(0),
       dummy_versions_(this),
       current_(nullptr) {
   AppendVersion(new Version(this));
@@ -817,70 +930,168 @@ void VersionSet::AppendVersion(Version* v) {
   v->next_->prev_ = v;
 }
 
+// A call to LogAndApply() waiting for its edit to be written.
+struct VersionSet::ManifestWriter {
+  ManifestWriter(VersionEdit* edit, port::Mutex* mu)
+      : edit(edit), done(false), cv(mu) {}
+
+  VersionEdit* const edit;
+  Status status;
+  bool done;
+  port::CondVar cv;
+};
+
 // 核心接口 LogAndApply 会根据当前版本 current_ 和修订部分 edit，
 // 合成一个新版本 v，而后将修订的记录写入 Manifest 文件中，
 // 最后将新版本 AppendVersion 到版本集中作为新的 current_，
 // 这样就完成了一个新版本的构建
 Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
-  if (edit->has_log_number_) {
-    assert(edit->log_number_ >= log_number_);
-    assert(edit->log_number_ < next_file_number_);
-  } else {
-    edit->SetLogNumber(log_number_);
+  ManifestWriter w(edit, mu);
+  manifest_writers_.push_back(&w);
+  while (!w.done && &w != manifest_writers_.front()) {
+    w.cv.Wait();
+  }
+  if (w.done) {
+    return w.status;
+  }
+
+  // Write the edits queued behind this one along with it, so that they
+  // share a single MANIFEST sync.
+  std::vector<VersionEdit*> edits;
+  for (ManifestWriter* writer : manifest_writers_) {
+    edits.push_back(writer->edit);
+  }
+  ManifestWriter* last_writer = manifest_writers_.back();
+  Status s = WriteEdits(edits, mu);
+
+  while (true) {
+    ManifestWriter* ready = manifest_writers_.front();
+    manifest_writers_.pop_front();
+    if (ready != &w) {
+      ready->status = s;
+      ready->done = true;
+      ready->cv.Signal();
+    }
+    if (ready == last_writer) break;
   }
 
-  if (!edit->has_prev_log_number_) {
-    edit->SetPrevLogNumber(prev_log_number_);
+  // Notify new head of write queue
+  if (!manifest_writers_.empty()) {
+    manifest_writers_.front()->cv.Signal();
   }
+  return s;
+}
 
-  edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
+Status VersionSet::WriteEdits(const std::vector<VersionEdit*>& edits,
+                              port::Mutex* mu) {
+  // Each edit carries the log numbers left by the edits before it.
+  uint64_t log_number = log_number_;
+  uint64_t prev_log_number = prev_log_number_;
+  for (VersionEdit* edit : edits) {
+    if (edit->has_log_number_) {
+      assert(edit->log_number_ >= log_number);
+      assert(edit->log_number_ < next_file_number_);
+    } else {
+      edit->SetLogNumber(log_number);
+    }
+    if (!edit->has_prev_log_number_) {
+      edit->SetPrevLogNumber(prev_log_number);
+    }
+    log_number = edit->log_number_;
+    prev_log_number = edit->prev_log_number_;
+  }
+
+  // Start a new descriptor file if there is none yet, or if the current
+  // one has grown too big to be replayed quickly on recovery.
+  uint64_t new_manifest_number = 0;
+  if (descriptor_log_ == nullptr) {
+    assert(descriptor_file_ == nullptr);
+    new_manifest_number = manifest_file_number_;
+  } else if (options_->max_manifest_file_size > 0 &&
+             manifest_size_ >= options_->max_manifest_file_size) {
+    new_manifest_number = NewFileNumber();
+  }
 
   Version* v = new Version(this);
   {
     Builder builder(this, current_);
-    builder.Apply(edit);
+    for (VersionEdit* edit : edits) {
+      edit->SetNextFile(next_file_number_);
+      edit->SetLastSequence(last_sequence_);
+      builder.Apply(edit);
+    }
     builder.SaveTo(v);
   }
   Finalize(v);
 
-  // Initialize new descriptor log file if necessary by creating
-  // a temporary file that contains a snapshot of the current version.
+  // The new descriptor file starts with a snapshot of the current
+  // version, followed by the edits.
+  std::string snapshot;
+  if (new_manifest_number != 0) {
+    WriteSnapshot(&snapshot);
+  }
+  std::vector<std::string> records(edits.size());
+  uint64_t records_size = 0;
+  for (size_t i = 0; i < edits.size(); i++) {
+    edits[i]->EncodeTo(&records[i]);
+    records_size += records[i].size();
+  }
+
   std::string new_manifest_file;
+  WritableFile* new_file = nullptr;
+  log::Writer* new_log = nullptr;
   Status s;
-  if (descriptor_log_ == nullptr) {
-    // No reason to unlock *mu here since we only hit this path in the
-    // first call to LogAndApply (when opening the database).
-    assert(descriptor_file_ == nullptr);
-    new_manifest_file = DescriptorFileName(dbname_, manifest_file_number_);
-    s = env_->NewWritableFile(new_manifest_file, &descriptor_file_);
-    if (s.ok()) {
-      descriptor_log_ = new log::Writer(descriptor_file_);
-      s = WriteSnapshot(descriptor_log_);
-    }
-  }
 
   // Unlock during expensive MANIFEST log write
   {
     mu->Unlock();
 
-    // Write new record to MANIFEST log
-    if (s.ok()) {
-      std::string record;
-      edit->EncodeTo(&record);
-      s = descriptor_log_->AddRecord(record);
+    if (new_manifest_number != 0) {
+      new_manifest_file = DescriptorFileName(dbname_, new_manifest_number);
+      s = env_->NewWritableFile(new_manifest_file, &new_file);
       if (s.ok()) {
-        s = descriptor_file_->Sync();
+        new_log = new log::Writer(new_file);
+        s = new_log->AddRecord(snapshot);
+      }
+      for (size_t i = 0; s.ok() && i < records.size(); i++) {
+        s = new_log->AddRecord(records[i]);
+      }
+      if (s.ok()) {
+        s = new_file->Sync();
+      }
+      // Install the new descriptor file by writing a new CURRENT file
+      // that points to it.
+      if (s.ok()) {
+        s = SetCurrentFile(env_, dbname_, new_manifest_number);
       }
       if (!s.ok()) {
-        Log(options_->info_log, "MANIFEST write: %s\n", s.ToString().c_str());
+        Log(options_->info_log, "MANIFEST #%llu: %s\n",
+            static_cast<unsigned long long>(new_manifest_number),
+            s.ToString().c_str());
+        delete new_log;
+        delete new_file;
+        new_log = nullptr;
+        new_file = nullptr;
+        env_->RemoveFile(new_manifest_file);
+        new_manifest_file.clear();
+        if (descriptor_log_ != nullptr) {
+          // CURRENT still names the old descriptor file; keep using it.
+          s = Status::OK();
+        }
       }
     }
 
-    // If we just created a new descriptor file, install it by writing a
-    // new CURRENT file that points to it.
-    if (s.ok() && !new_manifest_file.empty()) {
-      s = SetCurrentFile(env_, dbname_, manifest_file_number_);
+    // Write new records to the old MANIFEST log
+    if (s.ok() && new_log == nullptr) {
+      for (size_t i = 0; s.ok() && i < records.size(); i++) {
+        s = descriptor_log_->AddRecord(records[i]);
+      }
+      if (s.ok()) {
+        s = descriptor_file_->Sync();
+      }
+      if (!s.ok()) {
+        Log(options_->info_log, "MANIFEST write: %s\n", s.ToString().c_str());
+      }
     }
 
     mu->Lock();
@@ -889,17 +1100,23 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   // Install the new version
   if (s.ok()) {
     AppendVersion(v);
-    log_number_ = edit->log_number_;
-    prev_log_number_ = edit->prev_log_number_;
-  } else {
-    delete v;
-    if (!new_manifest_file.empty()) {
+    log_number_ = log_number;
+    prev_log_number_ = prev_log_number;
+    if (new_log != nullptr) {
+      if (descriptor_log_ != nullptr) {
+        Log(options_->info_log, "MANIFEST rolled over to #%llu\n",
+            static_cast<unsigned long long>(new_manifest_number));
+      }
       delete descriptor_log_;
       delete descriptor_file_;
-      descriptor_log_ = nullptr;
-      descriptor_file_ = nullptr;
-      env_->RemoveFile(new_manifest_file);
+      descriptor_log_ = new_log;
+      descriptor_file_ = new_file;
+      manifest_file_number_ = new_manifest_number;
+      manifest_size_ = snapshot.size();
     }
+    manifest_size_ += records_size;
+  } else {
+    delete v;
   }
 
   return s;
@@ -944,7 +1161,10 @@ Status VersionSet::Recover(bool* save_manifest) {
   uint64_t last_sequence = 0;
   uint64_t log_number = 0;
   uint64_t prev_log_number = 0;
-  Builder builder(this, current_);
+  // The MANIFEST describes the whole state, so start from an empty version
+  // rather than current_.  This lets read-only instances call Recover()
+  // again to pick up changes made by the process that owns the database.
+  Builder builder(this, new Version(this));
   int read_records = 0;
 
   {
@@ -1067,6 +1287,7 @@ bool VersionSet::ReuseManifest(const std::string& dscname,
   Log(options_->info_log, "Reusing MANIFEST %s\n", dscname.c_str());
   descriptor_log_ = new log::Writer(descriptor_file_, manifest_size);
   manifest_file_number_ = manifest_number;
+  manifest_size_ = manifest_size;
   return true;
 }
 
@@ -1116,7 +1337,7 @@ void VersionSet::Finalize(Version* v) {
   v->compaction_score_ = best_score;
 }
 
-Status VersionSet::WriteSnapshot(log::Writer* log) {
+void VersionSet::WriteSnapshot(std::string* record) {
   // TODO: Break up into multiple records to reduce memory usage on recovery?
 
   // Save metadata
@@ -1137,13 +1358,21 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->global_seqno, f->path_id);
+    }
+  }
+
+  // Save blob files
+  for (const auto& kvp : current_->blob_files_) {
+    const BlobFileMetaData& f = kvp.second;
+    edit.AddBlobFile(f.number, f.file_size);
+    if (f.garbage_size > 0) {
+      edit.AddBlobGarbage(f.number, f.garbage_size);
     }
   }
 
-  std::string record;
-  edit.EncodeTo(&record);
-  return log->AddRecord(record);
+  edit.EncodeTo(record);
 }
 
 int VersionSet::NumLevelFiles(int level) const {
@@ -1185,9 +1414,12 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // approximate offset of "ikey" within the table.
         Table* tableptr;
         Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+            ReadOptions(), files[i]->number, files[i]->path_id,
+            files[i]->file_size, files[i]->global_seqno, &tableptr);
         if (tableptr != nullptr) {
-          result += tableptr->ApproximateOffsetOf(ikey.Encode());
+          // Ingested tables are keyed by user key.
+          result += tableptr->ApproximateOffsetOf(
+              files[i]->global_seqno == 0 ? ikey.Encode() : ikey.user_key());
         }
         delete iter;
       }
@@ -1205,6 +1437,35 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
         live->insert(files[i]->number);
       }
     }
+    for (const auto& kvp : v->blob_files_) {
+      live->insert(kvp.first);
+    }
+  }
+  // Files added by edits that are being written to the MANIFEST
+  for (const ManifestWriter* writer : manifest_writers_) {
+    for (const auto& kvp : writer->edit->new_files_) {
+      live->insert(kvp.second.number);
+    }
+    for (const BlobFileMetaData& f : writer->edit->new_blob_files_) {
+      live->insert(f.number);
+    }
+  }
+}
+
+uint32_t VersionSet::PathIdForLevel(int level) const {
+  // Fill the paths with the size limits of the levels, in order.
+  const std::vector<DbPath>& paths = options_->db_paths;
+  uint32_t p = 0;
+  double room = paths[0].target_size;
+  for (int l = 0;; l++) {
+    const double level_bytes = MaxBytesForLevel(options_, l);
+    while (room < level_bytes && p + 1 < paths.size()) {
+      room = paths[++p].target_size;
+    }
+    if (l == level) {
+      return p;
+    }
+    room -= level_bytes;
   }
 }
 
@@ -1282,8 +1543,9 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] = table_cache_->NewIterator(
+              options, files[i]->number, files[i]->path_id,
+              files[i]->file_size, files[i]->global_seqno);
         }
       } else {
         // Create concatenating iterator for the files from this level
@@ -1636,6 +1898,18 @@ bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   }
 }
 
+bool Compaction::ShouldRelocateBlobFile(uint64_t file_number) const {
+  const std::map<uint64_t, BlobFileMetaData>& blob_files =
+      input_version_->blob_files_;
+  auto it = blob_files.find(file_number);
+  if (it == blob_files.end()) {
+    return false;
+  }
+  const BlobFileMetaData& f = it->second;
+  return f.garbage_size >=
+         f.file_size * config::kBlobGarbageRatioForRelocation;
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != nullptr) {
     input_version_->Unref();
@@ -6,8 +6,9 @@
 // newest version is called "current".  Older versions may be kept
 // around to provide a consistent view to live iterators.
 //
-// Each Version keeps track of a set of Table files per level.  The
-// entire set of versions is maintained in a VersionSet.
+// Each Version keeps track of a set of Table files per level, and of the
+// blob files their entries refer to.  The entire set of versions is
+// maintained in a VersionSet.
 //
 // Version,VersionSet are thread-compatible, but require external
 // synchronization on all accesses.
@@ -15,6 +16,8 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
+#include <deque>
 #include <map>
 #include <set>
 #include <vector>
@@ -30,9 +33,11 @@ namespace log {
 class Writer;
 }
 
+class BlobCache;
 class Compaction;
 class Iterator;
 class MemTable;
+class MergeContext;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -71,9 +76,14 @@ class Version {
 
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
+  // Values are pinned in the table cache rather than copied when
+  // possible.
+  // Merge operands already collected for key (e.g. from the memtables)
+  // are passed in *merge_context and applied to the value found here.
   // REQUIRES: lock is not held
-  Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+  // REQUIRES: !val->IsPinned()
+  Status Get(const ReadOptions&, const LookupKey& key, PinnableSlice* val,
+             GetStats* stats, MergeContext* merge_context);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -111,6 +121,8 @@ class Version {
 
   int NumFiles(int level) const { return files_[level].size(); }
 
+  int NumBlobFiles() const { return blob_files_.size(); }
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
@@ -153,6 +165,9 @@ class Version {
   // List of files per level
   std::vector<FileMetaData*> files_[config::kNumLevels];
 
+  // Blob files referenced by the tables above, keyed by file number
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
+
   // Next file to compact based on seek stats.
   FileMetaData* file_to_compact_; // 准备合并的文件
   int file_to_compact_level_;     // 准备合并的文件的level
@@ -167,7 +182,8 @@ class Version {
 class VersionSet {
  public:
   VersionSet(const std::string& dbname, const Options* options,
-             TableCache* table_cache, const InternalKeyComparator*);
+             TableCache* table_cache, BlobCache* blob_cache,
+             const InternalKeyComparator*);
   VersionSet(const VersionSet&) = delete;
   VersionSet& operator=(const VersionSet&) = delete;
 
@@ -176,12 +192,16 @@ class VersionSet {
   // Apply *edit to the current version to form a new descriptor that
   // is both saved to persistent state and installed as the new
   // current version.  Will release *mu while actually writing to the file.
+  // Edits passed by concurrent callers are queued, and written and
+  // synced together once the write in progress is done.
   // REQUIRES: *mu is held on entry.
-  // REQUIRES: no other thread concurrently calls LogAndApply()
+  // REQUIRES: every caller passes the same *mu
   Status LogAndApply(VersionEdit* edit, port::Mutex* mu)
       EXCLUSIVE_LOCKS_REQUIRED(mu);
 
-  // Recover the last saved descriptor from persistent storage.
+  // Recover the last saved descriptor from persistent storage.  May be
+  // called again to replace the current version with the one described
+  // by the latest descriptor.
   Status Recover(bool* save_manifest);
 
   // Return the current version.
@@ -208,13 +228,20 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
-  // Return the last sequence number.
-  uint64_t LastSequence() const { return last_sequence_; }
+  // Return the index in options.db_paths of the directory for new tables
+  // of the specified level.
+  uint32_t PathIdForLevel(int level) const;
+
+  // Return the last sequence number.  May be called without the DB
+  // mutex; the entries up to the returned sequence number are visible.
+  uint64_t LastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
 
   // Set the last sequence number to s.
   void SetLastSequence(uint64_t s) {
-    assert(s >= last_sequence_);
-    last_sequence_ = s;
+    assert(s >= last_sequence_.load(std::memory_order_relaxed));
+    last_sequence_.store(s, std::memory_order_release);
   }
 
   // Mark the specified file number as used.
@@ -254,7 +281,8 @@ class VersionSet {
     return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
   }
 
-  // Add all files listed in any live version to *live.
+  // Add all files listed in any live version, or added by an edit that
+  // is being written to the MANIFEST, to *live.
   // May also mutate some internal state.
   void AddLiveFiles(std::set<uint64_t>* live);
 
@@ -271,6 +299,7 @@ class VersionSet {
 
  private:
   class Builder;
+  struct ManifestWriter;
 
   friend class Compaction;
   friend class Version;
@@ -288,8 +317,13 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
-  // Save current contents to *log
-  Status WriteSnapshot(log::Writer* log);
+  // Apply "edits" in order, write them to the MANIFEST and install the
+  // resulting version.  Will release *mu while writing to the file.
+  Status WriteEdits(const std::vector<VersionEdit*>& edits, port::Mutex* mu)
+      EXCLUSIVE_LOCKS_REQUIRED(mu);
+
+  // Encode the current contents as a single edit into *record
+  void WriteSnapshot(std::string* record);
 
   void AppendVersion(Version* v);
 
@@ -297,16 +331,19 @@ class VersionSet {
   const std::string dbname_;
   const Options* const options_;
   TableCache* const table_cache_;
+  BlobCache* const blob_cache_;
   const InternalKeyComparator icmp_;
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
-  uint64_t last_sequence_;
+  std::atomic<uint64_t> last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
   // Opened lazily
   WritableFile* descriptor_file_;
   log::Writer* descriptor_log_;
+  uint64_t manifest_size_;  // Bytes of records in descriptor_file_
+  std::deque<ManifestWriter*> manifest_writers_;  // Queued LogAndApply calls
   Version dummy_versions_;  // Head of circular doubly-linked list of versions.
   Version* current_;        // == dummy_versions_.prev_
 
@@ -353,6 +390,11 @@ class Compaction {
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
 
+  // Returns true if the values this compaction keeps from the specified
+  // blob file should be copied to a new blob file, because enough of the
+  // file is garbage that it is worth freeing the rest of it.
+  bool ShouldRelocateBlobFile(uint64_t file_number) const;
+
   // Release the input version for the compaction, once the compaction
   // is successful.
   void ReleaseInputs();
@@ -4,8 +4,15 @@
 
 #include "db/version_set.h"
 
+#include <atomic>
+
 #include "gtest/gtest.h"
+#include "db/blob_cache.h"
+#include "db/table_cache.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 #include "util/testutil.h"
 
 namespace leveldb {
@@ -328,4 +335,156 @@ TEST_F(AddBoundaryInputsTest, TestDisjoinFilePointers) {
   ASSERT_EQ(f3, compaction_files_[2]);
 }
 
+// Counts MANIFEST syncs, and holds them back while hold_syncs() is set.
+class ManifestSyncEnv : public EnvWrapper {
+ public:
+  ManifestSyncEnv()
+      : EnvWrapper(Env::Default()),
+        cv_(&mu_),
+        hold_(false),
+        syncs_(0),
+        held_(0) {}
+
+  void HoldSyncs(bool hold) {
+    MutexLock l(&mu_);
+    hold_ = hold;
+    cv_.SignalAll();
+  }
+
+  // Wait until a sync is being held back.
+  void WaitForHeldSync() {
+    MutexLock l(&mu_);
+    while (held_ == 0) {
+      cv_.Wait();
+    }
+  }
+
+  int syncs() {
+    MutexLock l(&mu_);
+    return syncs_;
+  }
+
+  Status NewWritableFile(const std::string& f, WritableFile** r) override {
+    class ManifestFile : public WritableFile {
+     public:
+      ManifestFile(ManifestSyncEnv* env, WritableFile* base)
+          : env_(env), base_(base) {}
+      ~ManifestFile() override { delete base_; }
+      Status Append(const Slice& data) override { return base_->Append(data); }
+      Status Close() override { return base_->Close(); }
+      Status Flush() override { return base_->Flush(); }
+      Status Sync() override {
+        env_->BeforeSync();
+        return base_->Sync();
+      }
+
+     private:
+      ManifestSyncEnv* const env_;
+      WritableFile* const base_;
+    };
+
+    Status s = target()->NewWritableFile(f, r);
+    if (s.ok() && f.find("MANIFEST") != std::string::npos) {
+      *r = new ManifestFile(this, *r);
+    }
+    return s;
+  }
+
+ private:
+  void BeforeSync() {
+    MutexLock l(&mu_);
+    syncs_++;
+    held_++;
+    cv_.SignalAll();
+    while (hold_) {
+      cv_.Wait();
+    }
+    held_--;
+  }
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  bool hold_ GUARDED_BY(mu_);
+  int syncs_ GUARDED_BY(mu_);
+  int held_ GUARDED_BY(mu_);
+};
+
+struct LogAndApplyState {
+  VersionSet* vset;
+  port::Mutex* mu;
+  VersionEdit edit;
+  Status status;
+  std::atomic<bool> done;
+};
+
+static void LogAndApplyBody(void* arg) {
+  LogAndApplyState* state = reinterpret_cast<LogAndApplyState*>(arg);
+  state->mu->Lock();
+  state->status = state->vset->LogAndApply(&state->edit, state->mu);
+  state->mu->Unlock();
+  state->done.store(true, std::memory_order_release);
+}
+
+TEST(VersionSetTest, GroupCommit) {
+  ManifestSyncEnv env;
+  const std::string dbname = testing::TempDir() + "version_set_test";
+  Options options;
+  options.env = &env;
+  DestroyDB(dbname, options);
+  options.create_if_missing = true;
+  DB* db;
+  ASSERT_LEVELDB_OK(DB::Open(options, dbname, &db));
+  delete db;
+
+  InternalKeyComparator icmp(BytewiseComparator());
+  TableCache table_cache(dbname, options, 10);
+  BlobCache blob_cache(dbname, options, 10);
+  VersionSet* vset =
+      new VersionSet(dbname, &options, &table_cache, &blob_cache, &icmp);
+  bool save_manifest;
+  ASSERT_LEVELDB_OK(vset->Recover(&save_manifest));
+
+  port::Mutex mu;
+  const int kEdits = 3;
+  LogAndApplyState state[kEdits];
+  for (int i = 0; i < kEdits; i++) {
+    std::string key(1, 'a' + i);
+    state[i].vset = vset;
+    state[i].mu = &mu;
+    state[i].edit.AddFile(0, vset->NewFileNumber(), 100,
+                          InternalKey(key, 1, kTypeValue),
+                          InternalKey(key, 1, kTypeValue));
+    state[i].done.store(false, std::memory_order_release);
+  }
+
+  // While the first edit is being synced, the other two queue up behind it
+  // and are then written with a single sync.
+  env.HoldSyncs(true);
+  env.StartThread(LogAndApplyBody, &state[0]);
+  env.WaitForHeldSync();
+  const int syncs = env.syncs();
+  for (int i = 1; i < kEdits; i++) {
+    env.StartThread(LogAndApplyBody, &state[i]);
+  }
+  env.SleepForMicroseconds(100000);
+  env.HoldSyncs(false);
+  for (int i = 0; i < kEdits; i++) {
+    while (!state[i].done.load(std::memory_order_acquire)) {
+      env.SleepForMicroseconds(1000);
+    }
+    ASSERT_LEVELDB_OK(state[i].status);
+  }
+  ASSERT_EQ(syncs + 1, env.syncs());
+  ASSERT_EQ(kEdits, vset->NumLevelFiles(0));
+  delete vset;
+
+  // The MANIFEST holds all three edits.
+  vset = new VersionSet(dbname, &options, &table_cache, &blob_cache, &icmp);
+  ASSERT_LEVELDB_OK(vset->Recover(&save_manifest));
+  ASSERT_EQ(kEdits, vset->NumLevelFiles(0));
+  delete vset;
+
+  DestroyDB(dbname, options);
+}
+
 }  // namespace leveldb
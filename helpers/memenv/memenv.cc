@@ -286,6 +286,13 @@ class InMemoryEnv : public EnvWrapper {
     return Status::OK();
   }
 
+  Status ReuseWritableFile(const std::string& fname,
+                           const std::string& old_fname,
+                           WritableFile** result) override {
+    // Files hold no preallocated storage, so rename and truncate them.
+    return Env::ReuseWritableFile(fname, old_fname, result);
+  }
+
   bool FileExists(const std::string& fname) override {
     MutexLock lock(&mutex_);
     return file_map_.find(fname) != file_map_.end();
@@ -10,10 +10,11 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
-// they want something more sophisticated (like scan-resistance, a
-// custom eviction policy, variable cache sizing, etc.)
+// Builtin cache implementations with least-recently-used (optionally
+// scan-resistant) and CLOCK eviction policies are provided.  Clients may
+// use their own implementations if they want something more
+// sophisticated (like a custom eviction policy, variable cache sizing,
+// etc.)
 
 #ifndef STORAGE_LEVELDB_INCLUDE_CACHE_H_
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
@@ -35,6 +36,34 @@ class LEVELDB_EXPORT Cache;
 //默认采用LRU替换策略
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but the cache is split into
+// 2^num_shard_bits shards (16 by default), each with its own lock and an
+// equal part of the capacity.  More shards reduce lock contention
+// between threads; fewer shards make better use of the capacity when
+// entries are large.
+// REQUIRES: 0 <= num_shard_bits <= 20
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, int num_shard_bits);
+
+// Like NewLRUCache(capacity, num_shard_bits), but scan-resistant.  Entries
+// enter the LRU list at a midpoint, as the newest entries of its "old"
+// part, and only move to the "young" part when they are looked up again.
+// The young part holds up to young_ratio of the capacity; its overflow is
+// demoted to the midpoint.  Entries that are used once, such as the
+// blocks read by a long scan, are therefore evicted before any young
+// entry.  A young_ratio of 0 gives plain LRU; 0.5 is a reasonable choice.
+// REQUIRES: 0 <= young_ratio < 1
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                                  double young_ratio);
+
+// Create a new cache with a fixed size capacity, split into
+// 2^num_shard_bits shards.  This implementation approximates LRU with the
+// CLOCK algorithm: a Lookup() that hits only takes its shard's lock in
+// shared mode and marks the entry as recently used, so that concurrent
+// hits do not serialize.  Prefer it to NewLRUCache() when many threads
+// read through the same cache.
+// REQUIRES: 0 <= num_shard_bits <= 20
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, int num_shard_bits);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -52,6 +52,16 @@ class LEVELDB_EXPORT Comparator {
   // Simple comparator implementations may return with *key unchanged,
   // i.e., an implementation of this method that does nothing is correct.
   virtual void FindShortSuccessor(std::string* key) const = 0;
+
+  // Return the part of "key" that identifies it for point lookups, or an
+  // empty slice if "key" should not be hashed.  Keys that compare equal
+  // must have equal such parts, and keys with the same non-empty part must
+  // be adjacent in the ordering.  Used to build and probe the hash index
+  // of data blocks (see Options::data_block_hash_index) and of plain
+  // tables; lookups of keys with an empty part fall back to binary search.
+  // The default returns an empty slice, which is correct for any
+  // comparator; BytewiseComparator() returns "key".
+  virtual Slice HashIndexKey(const Slice& key) const;
 };
 
 // Return a builtin comparator that uses lexicographic byte-wise
@@ -7,10 +7,13 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 
 namespace leveldb {
 
@@ -53,6 +56,21 @@ class LEVELDB_EXPORT DB {
   static Status Open(const Options& options, const std::string& name,
                      DB** dbptr);
 
+  // Open the existing database with the specified "name" for reading
+  // only.  No lock is taken and nothing in the database directory is
+  // modified, so this may be used while another process has the database
+  // open.  The returned instance sees the database as it was when opened;
+  // writes fail with a NotSupported status and no compactions are run.
+  // Entries still in the log files are held in memory.
+  static Status OpenForReadOnly(const Options& options,
+                                const std::string& name, DB** dbptr);
+
+  // Like OpenForReadOnly(), but the returned instance can follow the
+  // changes made by the process that has the database open for writing
+  // (the primary) by calling TryCatchUpWithPrimary().
+  static Status OpenAsSecondary(const Options& options,
+                                const std::string& name, DB** dbptr);
+
   DB() = default;
 
   DB(const DB&) = delete;
@@ -72,6 +90,14 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Record "value" as a merge operand for "key".  Reads combine the
+  // operands with the existing value of "key" using the merge operator
+  // supplied in Options::merge_operator.  Returns OK on success, and a
+  // non-OK status on error.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options, const Slice& key,
+                       const Slice& value);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -87,6 +113,14 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Like Get() above, but instead of copying the value into a string,
+  // *value may refer directly to the memtable or block cache entry that
+  // holds it.  That memory stays pinned until value->Reset() is called
+  // or *value is destroyed, which must happen before the DB is deleted.
+  // Anything *value held before the call is released first.
+  virtual Status Get(const ReadOptions& options, const Slice& key,
+                     PinnableSlice* value);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -145,6 +179,43 @@ class LEVELDB_EXPORT DB {
   // Therefore the following call will compact the entire database:
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  // Add the tables named by "paths" to the database without rewriting
+  // their contents.  Each file must have been written by TableBuilder using
+  // this database's Options::comparator, must hold at least one entry, and
+  // must not overlap the key range of any other file in "paths".  The
+  // entries become visible atomically as values newer than every earlier
+  // write.  The files are copied into the database; the originals are
+  // left in place.
+  //
+  // Returns OK on success, and a non-OK status on error.  The default
+  // implementation returns NotSupported.
+  virtual Status IngestExternalFile(const std::vector<std::string>& paths);
+
+  // Refresh the view of an instance opened with OpenAsSecondary() by
+  // replaying the primary's current MANIFEST and log files.  Existing
+  // iterators keep their view.  Snapshots taken earlier may stop seeing
+  // entries that the primary has since compacted away, and reads may fail
+  // for files the primary deleted after they were last seen until this
+  // is called again.
+  //
+  // Returns NotSupported for instances not opened with OpenAsSecondary().
+  virtual Status TryCatchUpWithPrimary();
+
+  // Write the log records buffered because of Options::manual_wal_flush
+  // to the log file, and if "sync" is true, sync the log file as well so
+  // that every earlier write survives a crash of the machine.
+  //
+  // Returns OK on success, and a non-OK status on error.  The default
+  // implementation returns NotSupported.
+  virtual Status FlushWAL(bool sync);
+
+  // Write the contents of the memtable to a table file and wait until
+  // that is done, so that earlier writes, including those made with
+  // WriteOptions::disable_wal, survive a crash.
+  //
+  // Returns OK on success, and a non-OK status on error.
+  virtual Status Flush();
 };
 
 // Destroy the contents of the specified database.
@@ -110,6 +110,22 @@ class LEVELDB_EXPORT Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Rename the existing file "old_fname" to "fname" and create an object
+  // that writes to it from the beginning, overwriting the old contents
+  // instead of truncating them, so that the storage already allocated to
+  // the file is reused.  Bytes beyond the end of the new contents keep
+  // their old values.  On success, stores a pointer to the new file in
+  // *result and returns OK.  On failure stores nullptr in *result and
+  // returns non-OK.
+  //
+  // The returned file will only be accessed by one thread at a time.
+  //
+  // The default implementation renames the file and opens it with
+  // NewWritableFile, which truncates it.
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -287,6 +303,12 @@ class LEVELDB_EXPORT WritableFile {
   virtual Status Close() = 0;
   virtual Status Flush() = 0;
   virtual Status Sync() = 0;
+
+  // Reserve storage for the first "size" bytes of the file without
+  // changing its size, so that appending to it later does not have to
+  // allocate blocks.  This is only a hint: the default implementation
+  // does nothing and returns OK.
+  virtual Status Preallocate(uint64_t size);
 };
 
 // An interface for writing log messages.
@@ -355,6 +377,10 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status NewAppendableFile(const std::string& f, WritableFile** r) override {
     return target_->NewAppendableFile(f, r);
   }
+  Status ReuseWritableFile(const std::string& f, const std::string& old_f,
+                           WritableFile** r) override {
+    return target_->ReuseWritableFile(f, old_f, r);
+  }
   bool FileExists(const std::string& f) override {
     return target_->FileExists(f);
   }
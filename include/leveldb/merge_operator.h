@@ -0,0 +1,55 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator lets a client express read-modify-write updates (e.g.
+// counters or append-only lists) as "merge operands" that are written
+// with DB::Merge() or WriteBatch::Merge() without first reading the
+// current value.  The operands are combined with the value they apply to
+// lazily: by DB::Get(), by iterators, and by compactions.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Slice;
+
+class LEVELDB_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // The name of the merge operator.  Used only for logging.
+  virtual const char* Name() const = 0;
+
+  // Apply "operand" to the current value of "key" and store the result
+  // in *new_value.  "existing_value" is nullptr if "key" has no value,
+  // either because it was never written or because it has been deleted.
+  // When several operands exist for a key they are applied one at a
+  // time, in the order in which they were written.
+  //
+  // Returns false if the operand cannot be applied.  Reads that need the
+  // merged value then fail with a Corruption status, and compactions
+  // keep the unmerged operands.
+  virtual bool Merge(const Slice& key, const Slice* existing_value,
+                     const Slice& operand, std::string* new_value) const = 0;
+
+  // Combine two successive operands for "key" into a single operand that
+  // has the same effect as applying "older_operand" followed by
+  // "newer_operand", and store it in *new_operand.  Compactions use this
+  // to shrink runs of operands whose base value lives in a deeper level.
+  //
+  // Return false if the operands cannot be combined without knowing the
+  // value they apply to.  The default implementation always returns false.
+  virtual bool PartialMerge(const Slice& key, const Slice& older_operand,
+                            const Slice& newer_operand,
+                            std::string* new_operand) const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -6,6 +6,9 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 
@@ -16,6 +19,8 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
+class PersistentCache;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -29,6 +34,26 @@ enum CompressionType {
   kSnappyCompression = 0x1
 };
 
+// Layout used for newly written table files.  Readers recognize either
+// layout, so tables of both kinds can coexist in one database.
+enum TableFormat {
+  // Blocks of prefix-compressed entries with an index block (the default)
+  kBlockTableFormat = 0,
+  // Uncompressed entries with a hash index, kept fully in memory; see
+  // Options::table_format.
+  kPlainTableFormat = 1
+};
+
+// A directory for table files and the number of bytes of tables it is
+// meant to hold (see Options::db_paths).
+struct LEVELDB_EXPORT DbPath {
+  DbPath() = default;
+  DbPath(const std::string& p, uint64_t t) : path(p), target_size(t) {}
+
+  std::string path;
+  uint64_t target_size = 0;
+};
+
 //Option记录了leveldb中参数信息
 // Options to control the behavior of a database (passed to DB::Open)
 struct LEVELDB_EXPORT Options {
@@ -82,11 +107,38 @@ struct LEVELDB_EXPORT Options {
   // the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // If true, full write buffers are written out by a thread of their own
+  // instead of the compaction thread, so that writers waiting for room
+  // in the memtable do not wait for a compaction to reach a point where
+  // it can yield.  Version changes made by both threads at the same
+  // time are written to the MANIFEST together.  The tables are always
+  // placed in level-0, since a compaction may be writing to the levels
+  // below.
+  //
+  // Default: false
+  bool separate_flush_thread = false;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
   int max_open_files = 1000;
 
+  // If non-zero, the parsed metadata of tables (index blocks and filters)
+  // is cached separately from their open files, using up to this many
+  // bytes.  Closing a file to stay within max_open_files then keeps the
+  // metadata, so reopening the file does not read the footer, index and
+  // filter again.  The metadata is copied to the heap rather than read
+  // in place from mmap-ed files.  If zero, a table's metadata is dropped
+  // together with its file.
+  size_t table_metadata_cache_size = 0;
+
+  // If positive, DB::Open opens the tables of the DB before returning,
+  // using this many threads, so that their footers, index blocks and
+  // filters are not read by the first requests.  Tables are opened level
+  // by level, starting at level-0, until the table cache is full.  If
+  // zero, each table is opened when it is first used.
+  int max_file_opening_threads = 0;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
@@ -94,6 +146,25 @@ struct LEVELDB_EXPORT Options {
   // If null, leveldb will automatically create and use an 8MB internal cache.
   Cache* block_cache = nullptr;
 
+  // If non-null, blocks dropped from block_cache are compressed and moved
+  // to this cache, which is consulted before a block is read from disk.
+  // A block held here costs about its compressed size in memory, plus the
+  // time to uncompress it when it is read again.  Blocks are compressed
+  // with Snappy when it is available, by jobs run with env->Schedule();
+  // blocks dropped faster than those jobs keep up with are discarded.
+  // Must not be block_cache itself, and must outlive the DB (or the
+  // Tables) using it; it may be shared.
+  Cache* compressed_block_cache = nullptr;
+
+  // If non-null, blocks dropped from block_cache are also stored in this
+  // cache, which keeps them in local files across restarts.  It is
+  // consulted after compressed_block_cache and before the table file,
+  // which is useful when tables live on slower (e.g. network) storage.
+  // Blocks are compressed as for compressed_block_cache.  Must outlive
+  // the DB.  The DB then keeps a random identity in its IDENTITY
+  // file so that its blocks cannot be confused with those of other DBs.
+  PersistentCache* persistent_cache = nullptr;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -131,16 +202,154 @@ struct LEVELDB_EXPORT Options {
   // efficiently detect that and will switch to uncompressed mode.
   CompressionType compression = kSnappyCompression;
 
+  // Number of threads a TableBuilder uses to compress and checksum data
+  // blocks.  With more than one, finished blocks are handed to background
+  // threads while the caller keeps adding entries, and are written to the
+  // file in order once ready, so the table is the same either way.  Mostly
+  // useful for bulk table builds and large compactions.  A DB starts these
+  // threads once and shares them between all the tables it writes.
+  //
+  // Default: 1 (blocks are compressed by the thread that adds entries)
+  int compression_threads = 1;
+
+  // If true, each data block ends with a small hash index that maps keys
+  // to the restart interval holding them, so point lookups (Get) skip the
+  // binary search over restart points and can stop early when the key is
+  // absent.  Costs a little over one byte per distinct key.  Only keys
+  // with a non-empty Comparator::HashIndexKey() are indexed, which by
+  // default means only keys ordered by BytewiseComparator().
+  //
+  // Tables written with this option cannot be read by versions of leveldb
+  // that predate it.  Tables written without it remain readable either way.
+  //
+  // Default: false
+  bool data_block_hash_index = false;
+
+  // Layout of the table files written by flushes and compactions.
+  // kPlainTableFormat suits small, hot datasets that fit in memory: each
+  // table is loaded whole when it is opened (or served directly from the
+  // mapping when the Env memory-maps table files), entries are stored
+  // uncompressed, and Get() finds keys through a hash index without
+  // decoding blocks or touching the block cache.  block_size,
+  // block_restart_interval, compression, filter_policy and block_cache
+  // have no effect on plain tables, and plain tables are limited to 4GB.
+  // Key equality has the same requirement as for data_block_hash_index.
+  //
+  // Default: kBlockTableFormat
+  TableFormat table_format = kBlockTableFormat;
+
+  // If non-zero, values of at least this many bytes are written to
+  // separate append-only blob files when the memtable is flushed, and the
+  // sstables only hold a small reference to them.  Compactions then move
+  // just the key and the reference instead of rewriting the value at every
+  // level, which greatly reduces write amplification for large values at
+  // the cost of an extra read when the value is fetched.  Blob files are
+  // deleted once none of their values are live anymore.
+  //
+  // Default: 0 (all values are stored in the sstables)
+  size_t min_blob_size = 0;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
   // Default: currently false, but may become true later.
   bool reuse_logs = false;
 
+  // If non-zero, start a new MANIFEST file once the current one holds
+  // this many bytes.  The new file begins with a snapshot of the current
+  // state, so that opening the DB does not have to replay every version
+  // change made since it was last opened.  Otherwise a new MANIFEST is
+  // only started when the DB is opened.
+  //
+  // Default: 0
+  uint64_t max_manifest_file_size = 0;
+
+  // If non-empty, keep the log files in this directory instead of the
+  // database directory, e.g. on a separate device with low sync latency.
+  // The directory is created if it is missing and should hold no other
+  // files.  Every instance that opens, repairs or destroys the database
+  // must use the same value; to change it, move the log files of the
+  // closed database to the new directory.
+  std::string wal_dir;
+
+  // Directories that hold the table files, with the number of bytes of
+  // tables each is meant to hold.  Levels are placed in order, starting
+  // at level-0 on the first path: a level goes to the first path whose
+  // remaining target size still holds its whole size limit, or to the
+  // last path.  E.g. a small fast device first and a large slow one
+  // last keep the upper levels on the fast device.  Target sizes are
+  // not enforced, and a table stays where it was written until it is
+  // compacted.  The directories are created if they are missing; paths
+  // other than the database directory should hold no other files.
+  // Paths may be appended, but not removed or reordered, once tables
+  // have been written.
+  //
+  // Default: empty (all tables in the database directory)
+  std::vector<DbPath> db_paths;
+
+  // Number of threads used to replay log files when the DB is opened.
+  // With more than one, records are read and checksummed by the opening
+  // thread and handed to background threads in chunks of about
+  // write_buffer_size bytes.  Each chunk is inserted into its own
+  // memtable and written to a level-0 table concurrently with the other
+  // chunks.  All recovered data then goes to level-0 tables, so
+  // reuse_logs has no effect.
+  //
+  // Default: 1 (logs are replayed by the opening thread)
+  int wal_recovery_threads = 1;
+
+  // If non-zero, keep up to this many obsolete log files and reuse them for
+  // new logs instead of creating new files.  Overwriting a file that
+  // already has its blocks allocated makes syncing the log cheaper.  New
+  // log files are also preallocated to hold a full write buffer.  Logs
+  // are then written in a format that older versions of leveldb cannot
+  // read.  Disables reuse_logs.
+  size_t recycle_log_file_num = 0;
+
+  // If non-zero, a sync write that is about to write and sync the log for
+  // its group of writers first waits up to this many microseconds for more
+  // writers to join the group, so that one log sync serves them all.  The
+  // wait is half the average time a log sync has taken recently, capped
+  // at this value, and is skipped while sync writes do not overlap.
+  // Groups of sync writes may also grow larger when many writers are
+  // queued.  Raises the throughput of concurrent sync writes at the cost
+  // of some latency.
+  uint64_t group_commit_window_micros = 0;
+
+  // If true, writes that are not sync leave their log records in the
+  // write buffer of the log file instead of flushing it to the operating
+  // system after every write group.  The records reach the file when the
+  // buffer fills up, when a sync write or DB::FlushWAL() is issued, when
+  // the log is switched or the database is closed, and every
+  // wal_flush_interval_micros if that is non-zero.  Records still buffered
+  // are lost if the process crashes.
+  bool manual_wal_flush = false;
+
+  // If non-zero and manual_wal_flush is true, a background thread calls
+  // FlushWAL(true) this often, which bounds how much recent data a crash
+  // of the process or machine can lose.
+  uint64_t wal_flush_interval_micros = 0;
+
+  // Compress log records with the specified compression algorithm.
+  // Each write group is compressed as a whole, and kept uncompressed if
+  // that does not save at least 12.5%.  Reduces log IO for compressible
+  // values at the cost of some CPU.  Logs written with compression
+  // cannot be read by older versions of leveldb.
+  CompressionType wal_compression = kNoCompression;
+
   // If non-null, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If non-null, use the specified merge operator to combine the operands
+  // written by DB::Merge() and WriteBatch::Merge() with the value they
+  // apply to.  Operands are combined lazily by reads and collapsed by
+  // compactions.
+  //
+  // REQUIRES: A DB that contains merge operands must be opened with a
+  // merge operator that interprets them the same way every time.
+  const MergeOperator* merge_operator = nullptr;
 };
 
 // Options that control read operations
@@ -179,6 +388,14 @@ struct LEVELDB_EXPORT WriteOptions {
   // with sync==true has similar crash semantics to a "write()"
   // system call followed by "fsync()".
   bool sync = false;
+
+  // If true, the write is not added to the log and "sync" is ignored.
+  // The write is only durable once the memtable holding it has been
+  // written to a table file, which happens when it fills up or when
+  // DB::Flush() is called.  Until then it is lost if the process
+  // crashes or the database is closed.  Suits bulk loads that can be
+  // redone after a failure.
+  bool disable_wal = false;
 };
 
 }  // namespace leveldb
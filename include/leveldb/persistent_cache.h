@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PersistentCache maps keys to values like a Cache, but keeps them in
+// files so that they survive restarts.  It is meant to hold table blocks
+// on a fast local device in front of slower storage: see
+// Options::persistent_cache.
+//
+// A PersistentCache is thread-safe.  Entries are best-effort: the cache
+// may drop inserts and forget entries at any time.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+
+class LEVELDB_EXPORT PersistentCache {
+ public:
+  PersistentCache() = default;
+
+  PersistentCache(const PersistentCache&) = delete;
+  PersistentCache& operator=(const PersistentCache&) = delete;
+
+  // Entries that are still held in memory are written out first, so that
+  // the next instance using the same files finds them.
+  virtual ~PersistentCache();
+
+  // Store "value" under "key".  Has no effect if "key" is already present.
+  // Does not wait for the value to reach the device.
+  virtual void Insert(const Slice& key, const Slice& value) = 0;
+
+  // If the cache holds "key", store its value in *value and return true.
+  // Otherwise return false.
+  virtual bool Lookup(const Slice& key, std::string* value) = 0;
+};
+
+// Open a persistent cache that keeps up to "capacity" bytes in files under
+// the directory "path", creating the directory if it is missing.  Entries
+// left there by an earlier cache are recovered.  Only one cache at a time
+// may use "path", and nothing else should store files there.
+//
+// On success stores the cache in *cache and returns OK; the caller should
+// delete it when it is no longer needed.  Otherwise stores nullptr in
+// *cache and returns a non-OK status.
+LEVELDB_EXPORT Status NewPersistentCache(Env* env, const std::string& path,
+                                         uint64_t capacity,
+                                         PersistentCache** cache);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
@@ -0,0 +1,91 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PinnableSlice is a Slice that can keep the memory it refers to alive.
+// DB::Get() uses it to return values without copying them: the slice may
+// point directly into a memtable or a block cache entry, which stays
+// pinned until the PinnableSlice is reset or destroyed.  Values that
+// cannot be pinned are copied into a buffer owned by the PinnableSlice.
+//
+// Multiple threads can invoke const methods on a PinnableSlice without
+// external synchronization, but if any of the threads may call a
+// non-const method, all threads accessing the same PinnableSlice must use
+// external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+#define STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT PinnableSlice : public Slice {
+ public:
+  // Create an empty slice that copies into an internal buffer.
+  PinnableSlice();
+
+  // Create an empty slice that copies into "*buf" instead of an internal
+  // buffer.  "*buf" must outlive the PinnableSlice.
+  explicit PinnableSlice(std::string* buf);
+
+  PinnableSlice(const PinnableSlice&) = delete;
+  PinnableSlice& operator=(const PinnableSlice&) = delete;
+
+  // Releases any pinned memory.
+  ~PinnableSlice();
+
+  // Refer to "s", whose memory is kept alive by the cleanup functions
+  // that the caller then registers with RegisterCleanup().  Releases
+  // anything pinned before.
+  void PinSlice(const Slice& s);
+
+  // Copy "s" into the buffer and refer to the copy.  "s" may point into
+  // memory pinned by this slice.
+  void PinSelf(const Slice& s);
+
+  // Refer to the current contents of the buffer (see GetSelf()).
+  // Releases anything pinned before.
+  void PinSelf();
+
+  // Return the buffer that copied values are stored in.  Callers may
+  // fill it and then call PinSelf().
+  std::string* GetSelf() { return buf_; }
+
+  // Return true iff the slice refers to pinned memory rather than to
+  // its buffer.
+  bool IsPinned() const { return pinned_; }
+
+  // Release any pinned memory and make the slice empty.
+  void Reset();
+
+  // Register a function/arg1/arg2 triple that will be invoked when the
+  // memory pinned by the last PinSlice() call is released.
+  using CleanupFunction = void (*)(void* arg1, void* arg2);
+  void RegisterCleanup(CleanupFunction function, void* arg1, void* arg2);
+
+ private:
+  // Run and clear the cleanup functions.
+  void ReleasePinned();
+
+  // Cleanup functions are stored in a single-linked list.
+  // The list's head node is inlined in the slice.
+  struct CleanupNode {
+    CleanupFunction function;
+    void* arg1;
+    void* arg2;
+    CleanupNode* next;
+  };
+
+  std::string self_space_;
+  std::string* const buf_;
+  bool pinned_;
+  CleanupNode cleanup_head_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_TABLE_H_
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
+#include <cstddef>
 #include <cstdint>
 
 #include "leveldb/export.h"
@@ -16,6 +17,7 @@ class Block;
 class BlockHandle;
 class Footer;
 struct Options;
+class PinnableSlice;
 class RandomAccessFile;
 struct ReadOptions;
 class TableCache;
@@ -40,6 +42,15 @@ class LEVELDB_EXPORT Table {
   static Status Open(const Options& options, RandomAccessFile* file,
                      uint64_t file_size, Table** table);
 
+  // Like Open(), but if options.persistent_cache is set the blocks of the
+  // table are kept there under keys that start with
+  // "persistent_cache_key_prefix".  The prefix must identify the file's
+  // contents across restarts: no other file may ever use it.  An empty
+  // prefix keeps the blocks out of the persistent cache.
+  static Status Open(const Options& options, RandomAccessFile* file,
+                     uint64_t file_size,
+                     const Slice& persistent_cache_key_prefix, Table** table);
+
   Table(const Table&) = delete;
   Table& operator=(const Table&) = delete;
 
@@ -65,14 +76,51 @@ class LEVELDB_EXPORT Table {
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Like BlockReader, but reads from the file in a TableFile (see
+  // table.cc) instead of the file the table was opened with.
+  static Iterator* FileBlockReader(void*, const ReadOptions&, const Slice&);
+
+  // Like BlockReader, but reads from "file".  If "get_target" is non-null
+  // the returned iterator is positioned for a point lookup of *get_target,
+  // using the block's hash index if it has one.
+  static Iterator* BlockReader(const Table* table, RandomAccessFile* file,
+                               const ReadOptions&, const Slice&,
+                               const Slice* get_target);
+
   explicit Table(Rep* rep) : rep_(rep) {}
 
+  // Like NewIterator(), but data blocks are read from "file", which must
+  // hold the same contents as the file the table was opened with.  Lets
+  // TableCache close a table's file while keeping the table.
+  // REQUIRES: "file" remains live while the iterator is in use.
+  Iterator* NewIterator(const ReadOptions&, RandomAccessFile* file) const;
+
+  // Drop the table's pointer to the file it was opened with, which the
+  // caller may close from then on.  Afterwards the table must only be
+  // read through the methods that take a file.
+  void ForgetFile();
+
+  // Approximate memory used by the table itself, not counting the blocks
+  // in the block cache.
+  size_t ApproximateMemoryUsage() const;
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
+  // to Seek(key).  May not make such a call, or may make it with some
+  // other entry, if the filter policy or the block's hash index says
   // that key is not present.
-  Status InternalGet(const ReadOptions&, const Slice& key, void* arg,
+  //
+  // Data blocks are read from "file" (see NewIterator(options, file)).
+  //
+  // If "pinned" is non-null, handle_result may call pinned->PinSlice(v);
+  // the block holding v is then kept alive until *pinned releases it.
+  // Values of plain tables point into the table itself, and values of
+  // uncached blocks may point into "file"; the caller must keep those
+  // alive instead.
+  Status InternalGet(const ReadOptions&, RandomAccessFile* file,
+                     const Slice& key, void* arg,
                      void (*handle_result)(void* arg, const Slice& k,
-                                           const Slice& v));
+                                           const Slice& v),
+                     PinnableSlice* pinned = nullptr);
 
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
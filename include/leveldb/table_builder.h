@@ -23,6 +23,7 @@ namespace leveldb {
 
 class BlockBuilder;
 class BlockHandle;
+class CompressionPool;
 class WritableFile;
 
 class LEVELDB_EXPORT TableBuilder {
@@ -32,6 +33,14 @@ class LEVELDB_EXPORT TableBuilder {
   // caller to close the file after calling Finish().
   TableBuilder(const Options& options, WritableFile* file);
 
+  // Like the above, but if options.compression_threads is greater than
+  // one, compresses data blocks on the threads of "pool" instead of
+  // starting threads of its own.  Used by the DB to share one pool
+  // between all the tables it builds.  "pool" may be nullptr, and must
+  // otherwise outlive the builder.
+  TableBuilder(const Options& options, WritableFile* file,
+               CompressionPool* pool);
+
   TableBuilder(const TableBuilder&) = delete;
   TableBuilder& operator=(const TableBuilder&) = delete;
 
@@ -76,13 +85,19 @@ class LEVELDB_EXPORT TableBuilder {
   uint64_t NumEntries() const;
 
   // Size of the file generated so far.  If invoked after a successful
-  // Finish() call, returns the size of the final generated file.
+  // Finish() call, returns the size of the final generated file.  Blocks
+  // still being compressed by Options::compression_threads are counted
+  // at their uncompressed size.
   uint64_t FileSize() const;
 
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void AppendBlock(const Slice& data, const char* trailer, BlockHandle* handle);
+  void AddPendingIndexEntry();
+  void ScheduleDataBlock();
+  void WritePendingBlocks(size_t max_pending);
 
   // Struct Rep定义在.cc文件中
   // pImpl范式(桥梁模式).
@@ -40,6 +40,10 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // Called for every merge operand in the batch.  The default
+    // implementation ignores the operand so that handlers written before
+    // merge operands existed keep working.
+    virtual void Merge(const Slice& key, const Slice& value);
   };
 
   WriteBatch();
@@ -57,6 +61,10 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Record "value" as a merge operand for "key".  The operand is combined
+  // with the existing value for "key" by the DB's Options::merge_operator.
+  void Merge(const Slice& key, const Slice& value);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
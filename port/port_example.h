@@ -51,6 +51,11 @@ class CondVar {
   // REQUIRES: this thread holds *mu
   void Wait();
 
+  // Like Wait(), but also returns once "micros" microseconds have passed.
+  // May return early for no reason, like Wait().
+  // REQUIRES: this thread holds *mu
+  void TimedWait(uint64_t micros);
+
   // If there are some threads waiting, wake up at least one of them.
   void Signal();
 
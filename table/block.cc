@@ -13,6 +13,7 @@
 #include "leveldb/comparator.h"
 #include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 #include "util/logging.h"
 
 namespace leveldb {
@@ -20,26 +21,43 @@ namespace leveldb {
 // 因为 BlockBuilder类中提到，Block的组织格式
 // Block的尾部是Trailer，Trailer由uint32_t[]与uint32_t组成，
 // 分别存储每一个restart pointer与restart pointer的总数量
-inline uint32_t Block::NumRestarts() const {
-  assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
-}
-
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      restart_offset_(0),
+      num_restarts_(0),
+      hash_buckets_(nullptr),
+      num_hash_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+  num_restarts_ = DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  size_t trailer_size = sizeof(uint32_t);
+  if ((num_restarts_ & kBlockHashIndexFlag) != 0) {
+    num_restarts_ &= ~kBlockHashIndexFlag;
+    if (size_ < 2 * sizeof(uint32_t)) {
       size_ = 0;
-    } else {
-      // 存储restart pointer数组的起始位置
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
     }
+    num_hash_buckets_ = DecodeFixed32(data_ + size_ - 2 * sizeof(uint32_t));
+    if (num_hash_buckets_ == 0 ||
+        num_hash_buckets_ > size_ - 2 * sizeof(uint32_t)) {
+      size_ = 0;
+      return;
+    }
+    trailer_size += sizeof(uint32_t) + num_hash_buckets_;
+    hash_buckets_ =
+        reinterpret_cast<const uint8_t*>(data_ + size_ - trailer_size);
+  }
+  size_t max_restarts_allowed = (size_ - trailer_size) / sizeof(uint32_t);
+  if (num_restarts_ > max_restarts_allowed) {
+    // The size is too small for num_restarts_
+    size_ = 0;
+  } else {
+    // 存储restart pointer数组的起始位置
+    restart_offset_ = size_ - trailer_size - num_restarts_ * sizeof(uint32_t);
   }
 }
 
@@ -147,6 +165,34 @@ class Block::Iter : public Iterator {
     assert(num_restarts_ > 0);
   }
 
+  // Position at the first entry >= target, starting from the restart
+  // interval that the hash index maps "target" to.  See
+  // Block::NewIteratorForGet().
+  void SeekForGet(const Slice& target, const uint8_t* buckets,
+                  uint32_t num_buckets) {
+    const Slice hash_key = comparator_->HashIndexKey(target);
+    if (hash_key.empty()) {
+      Seek(target);
+      return;
+    }
+    const uint32_t h =
+        Hash(hash_key.data(), hash_key.size(), kBlockHashIndexSeed);
+    const uint8_t bucket = buckets[h % num_buckets];
+    if (bucket == kBlockHashIndexNoEntry) {
+      // No entry for the key; leave the iterator !Valid().
+      return;
+    }
+    if (bucket == kBlockHashIndexCollision || bucket >= num_restarts_) {
+      Seek(target);
+      return;
+    }
+    // Every entry for the key is in this restart interval, so the scan
+    // stops within it or at the first entry of the next one.
+    SeekToRestartPoint(bucket);
+    while (ParseNextKey() && Compare(key_, target) < 0) {
+    }
+  }
+
   bool Valid() const override { return current_ < restarts_; }
   Status status() const override { return status_; }
   Slice key() const override {
@@ -309,12 +355,24 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
-  const uint32_t num_restarts = NumRestarts();
-  if (num_restarts == 0) {
+  if (num_restarts_ == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    return new Iter(comparator, data_, restart_offset_, num_restarts_);
+  }
+}
+
+Iterator* Block::NewIteratorForGet(const Comparator* comparator,
+                                   const Slice& target) {
+  if (size_ < sizeof(uint32_t) || num_restarts_ == 0 ||
+      hash_buckets_ == nullptr) {
+    Iterator* iter = NewIterator(comparator);
+    iter->Seek(target);
+    return iter;
   }
+  Iter* iter = new Iter(comparator, data_, restart_offset_, num_restarts_);
+  iter->SeekForGet(target, hash_buckets_, num_hash_buckets_);
+  return iter;
 }
 
 }  // namespace leveldb
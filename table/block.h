@@ -14,6 +14,7 @@ namespace leveldb {
 
 struct BlockContents;
 class Comparator;
+class Slice;
 
 class Block {
  public:
@@ -26,18 +27,27 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
+  const char* data() const { return data_; }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Return an iterator positioned for a point lookup of "target".  It is
+  // at the first entry >= target, except that if the block's hash index
+  // shows that no entry has the same Comparator::HashIndexKey() as
+  // "target", it may be positioned anywhere (including !Valid()).
+  Iterator* NewIteratorForGet(const Comparator* comparator,
+                              const Slice& target);
+
  private:
   // 核心 迭代器
   class Iter;
 
-  uint32_t NumRestarts() const;
-
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
-  bool owned_;               // Block owns data_[]
+  uint32_t num_restarts_;
+  const uint8_t* hash_buckets_;  // nullptr if the block has no hash index
+  uint32_t num_hash_buckets_;
+  bool owned_;                   // Block owns data_[]
 };
 
 }  // namespace leveldb
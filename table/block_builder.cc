@@ -25,6 +25,20 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// A data block with a hash index has this trailer instead:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | kBlockHashIndexFlag: uint32
+// Keys are hashed on Comparator::HashIndexKey().  The bucket for a key
+// holds the index of the restart interval that contains all of the
+// entries with that key, kBlockHashIndexNoEntry if the block contains
+// none, or kBlockHashIndexCollision if the bucket is shared by keys in
+// different restart intervals (or the key spans several of them), in
+// which case readers fall back to binary search.  Keys with an empty
+// HashIndexKey() are not hashed, and a block without hashed keys gets
+// no index.
 
 #include "table/block_builder.h"
 
@@ -33,13 +47,19 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
 // 见最上方注释
-BlockBuilder::BlockBuilder(const Options* options)
-    : options_(options), restarts_(), counter_(0), finished_(false) {
+BlockBuilder::BlockBuilder(const Options* options, bool hash_index)
+    : options_(options),
+      hash_index_(hash_index),
+      restarts_(),
+      counter_(0),
+      finished_(false) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);  // First restart point is at offset 0
 }
@@ -51,12 +71,14 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hashes_.clear();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
   return (buffer_.size() +                       // Raw data buffer
           restarts_.size() * sizeof(uint32_t) +  // Restart array
-          sizeof(uint32_t));                     // Restart array length
+          sizeof(uint32_t) +                     // Restart array length
+          (hash_index_ ? hashes_.size() * 4 / 3 + sizeof(uint32_t) : 0));
 }
 
 // 将所有的restart pointer的位置和restart pointer的数量写到buffer_里
@@ -65,11 +87,33 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  if (hash_index_ && !hashes_.empty() &&
+      restarts_.size() <= kBlockHashIndexMaxRestarts) {
+    AppendHashIndex();
+    PutFixed32(&buffer_, restarts_.size() | kBlockHashIndexFlag);
+  } else {
+    PutFixed32(&buffer_, restarts_.size());
+  }
   finished_ = true;
   return Slice(buffer_);
 }
 
+void BlockBuilder::AppendHashIndex() {
+  // Keep the load factor at about 0.75 so that few keys collide.
+  const uint32_t num_buckets = hashes_.size() * 4 / 3 + 1;
+  std::vector<uint8_t> buckets(num_buckets, kBlockHashIndexNoEntry);
+  for (const auto& entry : hashes_) {
+    uint8_t& bucket = buckets[entry.first % num_buckets];
+    if (bucket == kBlockHashIndexNoEntry) {
+      bucket = static_cast<uint8_t>(entry.second);
+    } else if (bucket != entry.second) {
+      bucket = kBlockHashIndexCollision;
+    }
+  }
+  buffer_.append(reinterpret_cast<const char*>(buckets.data()), num_buckets);
+  PutFixed32(&buffer_, num_buckets);
+}
+
 void BlockBuilder::Add(const Slice& key, const Slice& value) {
   Slice last_key_piece(last_key_);
   assert(!finished_);
@@ -90,6 +134,20 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   }
   const size_t non_shared = key.size() - shared;
 
+  if (hash_index_) {
+    const Comparator* cmp = options_->comparator;
+    const Slice hash_key = cmp->HashIndexKey(key);
+    const uint32_t restart_index = restarts_.size() - 1;
+    // Versions of the same key only need one entry per restart interval.
+    if (!hash_key.empty() &&
+        (hashes_.empty() || hashes_.back().second != restart_index ||
+         cmp->HashIndexKey(last_key_piece) != hash_key)) {
+      hashes_.emplace_back(
+          Hash(hash_key.data(), hash_key.size(), kBlockHashIndexSeed),
+          restart_index);
+    }
+  }
+
   // Add "<shared><non_shared><value_size>" to buffer_
   PutVarint32(&buffer_, shared);
   PutVarint32(&buffer_, non_shared);
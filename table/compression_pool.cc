@@ -0,0 +1,108 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/compression_pool.h"
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+void CompressBlock(const Slice& raw, CompressionType* type,
+                   std::string* compressed, Slice* contents) {
+  // TODO(postrelease): Support more compression options: zlib?
+  switch (*type) {
+    case kNoCompression:
+      *contents = raw;
+      break;
+
+    case kSnappyCompression: {
+      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
+          compressed->size() < raw.size() - (raw.size() / 8u)) {
+        *contents = *compressed;
+      } else {
+        // Snappy not supported, or compressed less than 12.5%, so just
+        // store uncompressed form
+        *contents = raw;
+        *type = kNoCompression;
+      }
+      break;
+    }
+  }
+}
+
+void EncodeBlockTrailer(const Slice& contents, CompressionType type,
+                        char* trailer) {
+  trailer[0] = type;
+  uint32_t crc = crc32c::Value(contents.data(), contents.size());
+  crc = crc32c::Extend(crc, trailer, 1);  // Extend crc to cover block type
+  EncodeFixed32(trailer + 1, crc32c::Mask(crc));
+}
+
+CompressionPool::CompressionPool(Env* env, int threads)
+    : threads_(threads),
+      work_cv_(&mu_),
+      done_cv_(&mu_),
+      live_threads_(threads),
+      shutting_down_(false) {
+  for (int i = 0; i < threads; i++) {
+    env->StartThread(&CompressionPool::ThreadMain, this);
+  }
+}
+
+CompressionPool::~CompressionPool() {
+  MutexLock l(&mu_);
+  shutting_down_ = true;
+  work_cv_.SignalAll();
+  while (live_threads_ > 0) {
+    done_cv_.Wait();
+  }
+}
+
+void CompressionPool::Schedule(CompressionTask* task) {
+  MutexLock l(&mu_);
+  task->done = false;
+  queue_.push_back(task);
+  work_cv_.Signal();
+}
+
+void CompressionPool::WaitFor(CompressionTask* task) {
+  MutexLock l(&mu_);
+  while (!task->done) {
+    done_cv_.Wait();
+  }
+}
+
+void CompressionPool::ThreadMain(void* arg) {
+  reinterpret_cast<CompressionPool*>(arg)->Run();
+}
+
+void CompressionPool::Run() {
+  MutexLock l(&mu_);
+  while (true) {
+    while (!shutting_down_ && queue_.empty()) {
+      work_cv_.Wait();
+    }
+    if (shutting_down_) {
+      break;
+    }
+    CompressionTask* task = queue_.front();
+    queue_.pop_front();
+
+    mu_.Unlock();
+    CompressBlock(task->raw, &task->type, &task->compressed, &task->contents);
+    EncodeBlockTrailer(task->contents, task->type, task->trailer);
+    mu_.Lock();
+
+    task->done = true;
+    done_cv_.SignalAll();
+  }
+  live_threads_--;
+  done_cv_.SignalAll();
+}
+
+}  // namespace leveldb
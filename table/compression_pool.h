@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_TABLE_COMPRESSION_POOL_H_
+#define STORAGE_LEVELDB_TABLE_COMPRESSION_POOL_H_
+
+#include <deque>
+#include <string>
+
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "table/format.h"
+
+namespace leveldb {
+
+class Env;
+
+// Compress "raw" using *type.  Sets *contents to the bytes to store, which
+// point into either "raw" or *compressed, and *type to the compression that
+// was actually used.
+void CompressBlock(const Slice& raw, CompressionType* type,
+                   std::string* compressed, Slice* contents);
+
+// Fill in the trailer that follows "contents" in the file.
+void EncodeBlockTrailer(const Slice& contents, CompressionType type,
+                        char* trailer);
+
+// A block handed to a CompressionPool to be compressed and checksummed.
+struct CompressionTask {
+  std::string raw;  // Uncompressed block contents
+  std::string compressed;
+  Slice contents;  // Bytes to write: points into raw or compressed
+  CompressionType type;
+  char trailer[kBlockTrailerSize];
+  bool done;  // Protected by CompressionPool::mu_
+};
+
+// Threads that compress and checksum blocks for TableBuilders.  A pool is
+// meant to live as long as its owner (e.g. a DB) and to be shared by all
+// the tables it builds, including ones built at the same time.
+//
+// A CompressionPool is thread-safe.
+class CompressionPool {
+ public:
+  // Start "threads" threads with env->StartThread().
+  CompressionPool(Env* env, int threads);
+
+  CompressionPool(const CompressionPool&) = delete;
+  CompressionPool& operator=(const CompressionPool&) = delete;
+
+  // Waits for the threads to exit.  Tasks that have not been picked up
+  // by a thread are left unprocessed.
+  ~CompressionPool();
+
+  int threads() const { return threads_; }
+
+  void Schedule(CompressionTask* task);
+
+  // Block until "task" has been compressed and checksummed.
+  void WaitFor(CompressionTask* task);
+
+ private:
+  static void ThreadMain(void* arg);
+  void Run();
+
+  const int threads_;
+  port::Mutex mu_;
+  port::CondVar work_cv_;
+  port::CondVar done_cv_;
+  std::deque<CompressionTask*> queue_ GUARDED_BY(mu_);
+  int live_threads_ GUARDED_BY(mu_);
+  bool shutting_down_ GUARDED_BY(mu_);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_COMPRESSION_POOL_H_
@@ -4,6 +4,8 @@
 
 #include "table/format.h"
 
+#include <cstring>
+
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "table/block.h"
@@ -145,4 +147,33 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   return Status::OK();
 }
 
+Status UncompressBlock(const char* data, size_t n, BlockContents* result) {
+  char* buf;
+  switch (data[n]) {
+    case kNoCompression:
+      buf = new char[n];
+      std::memcpy(buf, data, n);
+      result->data = Slice(buf, n);
+      break;
+    case kSnappyCompression: {
+      size_t ulength = 0;
+      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      buf = new char[ulength];
+      if (!port::Snappy_Uncompress(data, n, buf)) {
+        delete[] buf;
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      result->data = Slice(buf, ulength);
+      break;
+    }
+    default:
+      return Status::Corruption("bad block type");
+  }
+  result->heap_allocated = true;
+  result->cachable = true;
+  return Status::OK();
+}
+
 }  // namespace leveldb
@@ -81,6 +81,17 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Data block hash index (see block_builder.cc).  The high bit of a block's
+// restart count is set when the block has a hash index.  Each bucket holds
+// the index of a restart interval, or one of the two markers below, so
+// blocks with more restart intervals than kBlockHashIndexMaxRestarts are
+// written without an index.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+static const uint8_t kBlockHashIndexNoEntry = 255;
+static const uint8_t kBlockHashIndexCollision = 254;
+static const uint32_t kBlockHashIndexMaxRestarts = 254;
+static const uint32_t kBlockHashIndexSeed = 0x6b9083d9;
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
@@ -92,6 +103,11 @@ struct BlockContents {
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result);
 
+// "data" holds n bytes of block contents followed by the one-byte block
+// type of the trailer.  Uncompress them into a heap-allocated *result.
+// On failure return non-OK.
+Status UncompressBlock(const char* data, size_t n, BlockContents* result);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
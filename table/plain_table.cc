@@ -0,0 +1,356 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/plain_table.h"
+
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+static const uint32_t kPlainTableHashSeed = 0x3f8a52c1;
+
+static uint32_t HashKey(const Slice& hash_key) {
+  return Hash(hash_key.data(), hash_key.size(), kPlainTableHashSeed);
+}
+
+PlainTableBuilder::PlainTableBuilder(const Options& options,
+                                     WritableFile* file)
+    : comparator_(options.comparator), file_(file), offset_(0), crc_(0) {}
+
+Status PlainTableBuilder::Append(const Slice& data) {
+  Status s = file_->Append(data);
+  if (s.ok()) {
+    crc_ = crc32c::Extend(crc_, data.data(), data.size());
+    offset_ += data.size();
+  }
+  return s;
+}
+
+Status PlainTableBuilder::Add(const Slice& key, const Slice& value) {
+  buffer_.clear();
+  PutVarint32(&buffer_, key.size());
+  PutVarint32(&buffer_, value.size());
+  const uint64_t entry_size = buffer_.size() + key.size() + value.size();
+  if (offset_ + entry_size > std::numeric_limits<uint32_t>::max()) {
+    return Status::NotSupported("plain table is too large");
+  }
+
+  const Slice hash_key = comparator_->HashIndexKey(key);
+  if (!hash_key.empty() &&
+      (offsets_.empty() || comparator_->HashIndexKey(last_key_) != hash_key)) {
+    hashes_.emplace_back(HashKey(hash_key), offsets_.size());
+  }
+  offsets_.push_back(offset_);
+  last_key_.assign(key.data(), key.size());
+
+  buffer_.append(key.data(), key.size());
+  buffer_.append(value.data(), value.size());
+  return Append(buffer_);
+}
+
+Status PlainTableBuilder::Finish() {
+  const uint32_t data_size = offset_;
+  buffer_.clear();
+  for (uint32_t offset : offsets_) {
+    PutFixed32(&buffer_, offset);
+  }
+
+  // Keep the load factor at about 0.5 so that probe sequences are short.
+  const uint32_t num_buckets = hashes_.empty() ? 0 : hashes_.size() * 2 + 1;
+  std::vector<uint32_t> buckets(num_buckets, 0);
+  for (const auto& entry : hashes_) {
+    uint32_t b = entry.first % num_buckets;
+    while (buckets[b] != 0) {
+      b = (b + 1 == num_buckets) ? 0 : b + 1;
+    }
+    buckets[b] = entry.second + 1;
+  }
+  for (uint32_t bucket : buckets) {
+    PutFixed32(&buffer_, bucket);
+  }
+
+  PutFixed32(&buffer_, data_size);
+  PutFixed32(&buffer_, offsets_.size());
+  PutFixed32(&buffer_, num_buckets);
+  const uint32_t crc = crc32c::Extend(crc_, buffer_.data(), buffer_.size());
+  PutFixed32(&buffer_, crc32c::Mask(crc));
+  PutFixed64(&buffer_, kPlainTableMagicNumber);
+  return Append(buffer_);
+}
+
+class PlainTable::Iter : public Iterator {
+ public:
+  explicit Iter(const PlainTable* table)
+      : table_(table), index_(table->num_entries_) {}
+
+  bool Valid() const override { return index_ < table_->num_entries_; }
+  Status status() const override { return status_; }
+  Slice key() const override {
+    assert(Valid());
+    return key_;
+  }
+  Slice value() const override {
+    assert(Valid());
+    return value_;
+  }
+
+  void Next() override {
+    assert(Valid());
+    index_++;
+    Load();
+  }
+
+  void Prev() override {
+    assert(Valid());
+    index_ = (index_ == 0) ? table_->num_entries_ : index_ - 1;
+    Load();
+  }
+
+  void Seek(const Slice& target) override {
+    status_ = table_->FindFirst(target, &index_);
+    if (!status_.ok()) {
+      index_ = table_->num_entries_;
+    }
+    Load();
+  }
+
+  void SeekToFirst() override {
+    index_ = 0;
+    Load();
+  }
+
+  void SeekToLast() override {
+    index_ = (table_->num_entries_ == 0) ? 0 : table_->num_entries_ - 1;
+    Load();
+  }
+
+ private:
+  void Load() {
+    if (Valid() && !table_->DecodeEntry(index_, &key_, &value_)) {
+      status_ = Status::Corruption("bad entry in plain table");
+      index_ = table_->num_entries_;
+    }
+  }
+
+  const PlainTable* const table_;
+  uint32_t index_;  // num_entries_ if !Valid()
+  Slice key_;
+  Slice value_;
+  Status status_;
+};
+
+Status PlainTable::Open(const Options& options, RandomAccessFile* file,
+                        uint64_t size, PlainTable** table) {
+  *table = nullptr;
+  if (size < kPlainTableFooterSize) {
+    return Status::Corruption("file is too short to be a plain table");
+  }
+  if (size > std::numeric_limits<size_t>::max()) {
+    return Status::NotSupported("plain table is too large");
+  }
+
+  // Read the footer first.  A file that hands out its own memory for it
+  // (e.g. an mmap-ed file) is expected to do the same for the whole file,
+  // in which case no heap copy is needed.
+  char footer_space[kPlainTableFooterSize];
+  Slice footer_input;
+  Status s = file->Read(size - kPlainTableFooterSize, kPlainTableFooterSize,
+                        &footer_input, footer_space);
+  if (!s.ok()) {
+    return s;
+  }
+  const bool file_owns_data = footer_input.data() != footer_space;
+
+  char* buf = nullptr;
+  if (!file_owns_data || options.table_metadata_cache_size > 0) {
+    buf = new char[size];
+  }
+  Slice contents;
+  s = file->Read(0, size, &contents, buf);
+  if (!s.ok()) {
+    delete[] buf;
+    return s;
+  }
+  if (contents.size() != size) {
+    delete[] buf;
+    return Status::Corruption("truncated plain table read");
+  }
+  if (contents.data() != buf) {
+    if (options.table_metadata_cache_size > 0) {
+      // The table may outlive the file.
+      std::memcpy(buf, contents.data(), size);
+      contents = Slice(buf, size);
+    } else {
+      // File implementation gave us pointer to some other data (e.g. an
+      // mmap-ed file), which stays valid while the file is open.
+      delete[] buf;
+      buf = nullptr;
+    }
+  }
+
+  const char* data = contents.data();
+  const char* footer = data + size - kPlainTableFooterSize;
+  const uint32_t data_size = DecodeFixed32(footer);
+  const uint32_t num_entries = DecodeFixed32(footer + 4);
+  const uint32_t num_buckets = DecodeFixed32(footer + 8);
+  const uint64_t expected_size = uint64_t{data_size} +
+                                 4 * (uint64_t{num_entries} + num_buckets) +
+                                 kPlainTableFooterSize;
+  if (!HasMagic(contents) || size != expected_size) {
+    s = Status::Corruption("bad plain table footer");
+  } else if (options.paranoid_checks) {
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(footer + 12));
+    if (crc32c::Value(data, footer + 12 - data) != crc) {
+      s = Status::Corruption("plain table checksum mismatch");
+    }
+  }
+  if (!s.ok()) {
+    delete[] buf;
+    return s;
+  }
+
+  *table = new PlainTable(options.comparator, data, buf, data_size,
+                          num_entries, num_buckets);
+  return s;
+}
+
+bool PlainTable::HasMagic(const Slice& footer) {
+  return footer.size() >= sizeof(uint64_t) &&
+         DecodeFixed64(footer.data() + footer.size() - sizeof(uint64_t)) ==
+             kPlainTableMagicNumber;
+}
+
+PlainTable::PlainTable(const Comparator* comparator, const char* data,
+                       char* owned, uint32_t data_size, uint32_t num_entries,
+                       uint32_t num_buckets)
+    : comparator_(comparator),
+      data_(data),
+      owned_(owned),
+      data_size_(data_size),
+      num_entries_(num_entries),
+      num_buckets_(num_buckets),
+      offsets_(data + data_size),
+      buckets_(offsets_ + 4 * num_entries) {}
+
+PlainTable::~PlainTable() { delete[] owned_; }
+
+bool PlainTable::DecodeEntry(uint32_t index, Slice* key, Slice* value) const {
+  assert(index < num_entries_);
+  const uint32_t offset = DecodeFixed32(offsets_ + 4 * index);
+  const char* limit = data_ + data_size_;
+  if (offset >= data_size_) {
+    return false;
+  }
+  uint32_t key_length, value_length;
+  const char* p = GetVarint32Ptr(data_ + offset, limit, &key_length);
+  if (p != nullptr) {
+    p = GetVarint32Ptr(p, limit, &value_length);
+  }
+  if (p == nullptr ||
+      static_cast<uint64_t>(limit - p) < uint64_t{key_length} + value_length) {
+    return false;
+  }
+  *key = Slice(p, key_length);
+  *value = Slice(p + key_length, value_length);
+  return true;
+}
+
+Status PlainTable::FindFirst(const Slice& target, uint32_t* index) const {
+  uint32_t left = 0;
+  uint32_t right = num_entries_;
+  while (left < right) {
+    const uint32_t mid = left + (right - left) / 2;
+    Slice key, value;
+    if (!DecodeEntry(mid, &key, &value)) {
+      return Status::Corruption("bad entry in plain table");
+    }
+    if (comparator_->Compare(key, target) < 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  *index = left;
+  return Status::OK();
+}
+
+Iterator* PlainTable::NewIterator() const { return new Iter(this); }
+
+Status PlainTable::Get(const Slice& k, void* arg,
+                       void (*handle_result)(void*, const Slice&,
+                                             const Slice&)) const {
+  const Slice hash_key = comparator_->HashIndexKey(k);
+  Slice key, value;
+  if (hash_key.empty()) {
+    // Not hashed; binary search instead.
+    uint32_t index;
+    Status s = FindFirst(k, &index);
+    if (s.ok() && index < num_entries_) {
+      if (!DecodeEntry(index, &key, &value)) {
+        return Status::Corruption("bad entry in plain table");
+      }
+      (*handle_result)(arg, key, value);
+    }
+    return s;
+  }
+  if (num_buckets_ == 0) {
+    return Status::OK();
+  }
+  uint32_t b = HashKey(hash_key) % num_buckets_;
+  for (uint32_t probes = 0; probes < num_buckets_; probes++) {
+    const uint32_t bucket = DecodeFixed32(buckets_ + 4 * b);
+    if (bucket == 0) {
+      return Status::OK();  // Not present
+    }
+    uint32_t index = bucket - 1;
+    if (index >= num_entries_ || !DecodeEntry(index, &key, &value)) {
+      return Status::Corruption("bad entry in plain table");
+    }
+    if (comparator_->HashIndexKey(key) == hash_key) {
+      // The entries for this key are adjacent, starting at "index".
+      while (comparator_->Compare(key, k) < 0) {
+        if (++index == num_entries_) {
+          return Status::OK();
+        }
+        if (!DecodeEntry(index, &key, &value)) {
+          return Status::Corruption("bad entry in plain table");
+        }
+        if (comparator_->HashIndexKey(key) != hash_key) {
+          return Status::OK();
+        }
+      }
+      (*handle_result)(arg, key, value);
+      return Status::OK();
+    }
+    b = (b + 1 == num_buckets_) ? 0 : b + 1;
+  }
+  return Status::OK();
+}
+
+uint64_t PlainTable::ApproximateOffsetOf(const Slice& key) const {
+  uint32_t index;
+  if (!FindFirst(key, &index).ok() || index == num_entries_) {
+    return data_size_;
+  }
+  return DecodeFixed32(offsets_ + 4 * index);
+}
+
+size_t PlainTable::ApproximateMemoryUsage() const {
+  if (owned_ == nullptr) {
+    return 0;
+  }
+  return data_size_ + 4 * (size_t{num_entries_} + num_buckets_) +
+         kPlainTableFooterSize;
+}
+
+}  // namespace leveldb
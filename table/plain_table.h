@@ -0,0 +1,156 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Plain tables are an alternative sstable layout for small datasets that
+// fit in memory (see Options::table_format).  The whole file is loaded, or
+// memory-mapped, when the table is opened, and entries are stored without
+// compression or key prefix sharing so that reads return slices pointing
+// straight into the file contents:
+//
+//    entries: entry[num_entries]
+//       entry :=
+//          key_length: varint32
+//          value_length: varint32
+//          key: char[key_length]
+//          value: char[value_length]
+//    offsets: fixed32[num_entries]  // Offset of each entry, in key order
+//    buckets: fixed32[num_buckets]  // Hash index
+//    footer:
+//       data_size: fixed32          // Size of the entries
+//       num_entries: fixed32
+//       num_buckets: fixed32
+//       checksum: fixed32           // Masked crc32c of all preceding bytes
+//       magic: fixed64              // kPlainTableMagicNumber
+//
+// The hash index is an open-addressing table keyed on
+// Comparator::HashIndexKey().  A non-zero bucket holds one plus the index
+// of the first entry with some key; lookups probe linearly from the
+// key's hash until they find that key or an empty bucket.  Keys with an
+// empty HashIndexKey() are not hashed and are looked up by binary search.
+
+#ifndef STORAGE_LEVELDB_TABLE_PLAIN_TABLE_H_
+#define STORAGE_LEVELDB_TABLE_PLAIN_TABLE_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "leveldb/iterator.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Comparator;
+struct Options;
+class RandomAccessFile;
+class WritableFile;
+
+// Arbitrary; distinct from kTableMagicNumber.
+static const uint64_t kPlainTableMagicNumber = 0x8d1e0a5f3c27b946ull;
+
+// Size of the footer at the end of every plain table.
+static const size_t kPlainTableFooterSize = 4 * sizeof(uint32_t) + 8;
+
+// Writes a plain table to a file.  Used by TableBuilder when
+// Options::table_format is kPlainTableFormat.
+class PlainTableBuilder {
+ public:
+  // "*file" must be initially empty and must remain live while this
+  // builder is in use.
+  PlainTableBuilder(const Options& options, WritableFile* file);
+
+  PlainTableBuilder(const PlainTableBuilder&) = delete;
+  PlainTableBuilder& operator=(const PlainTableBuilder&) = delete;
+
+  // REQUIRES: key is after any previously added key according to the
+  // comparator.
+  Status Add(const Slice& key, const Slice& value);
+
+  // Append the offsets, the hash index and the footer.
+  Status Finish();
+
+  // Number of bytes written so far.
+  uint64_t FileSize() const { return offset_; }
+
+ private:
+  Status Append(const Slice& data);
+
+  const Comparator* const comparator_;
+  WritableFile* const file_;
+  uint64_t offset_;
+  uint32_t crc_;  // crc32c of the bytes written so far
+  std::string last_key_;
+  std::string buffer_;
+  std::vector<uint32_t> offsets_;
+
+  // (hash, entry index) of the first entry for each distinct key
+  std::vector<std::pair<uint32_t, uint32_t>> hashes_;
+};
+
+// An open plain table.  Safe for concurrent use by multiple threads.
+class PlainTable {
+ public:
+  // Load the plain table stored in bytes [0..size) of "file".  On success
+  // stores the table in *table.  If "file" returns pointers into its own
+  // memory (e.g. an mmap-ed file), the table refers to it and "file" must
+  // remain live while the table is in use, unless
+  // options.table_metadata_cache_size is set.  Otherwise the contents are
+  // copied to the heap.  Whether "file" returns its own memory is judged
+  // from a read of the footer.
+  static Status Open(const Options& options, RandomAccessFile* file,
+                     uint64_t size, PlainTable** table);
+
+  // Return true iff "footer", the last bytes of a file, ends with the
+  // plain table magic number.
+  static bool HasMagic(const Slice& footer);
+
+  PlainTable(const PlainTable&) = delete;
+  PlainTable& operator=(const PlainTable&) = delete;
+
+  ~PlainTable();
+
+  Iterator* NewIterator() const;
+
+  // Calls (*handle_result)(arg, ...) with the first entry >= key, unless
+  // the hash index shows that the table has no entry with the same
+  // non-empty Comparator::HashIndexKey() as key.
+  Status Get(const Slice& key, void* arg,
+             void (*handle_result)(void* arg, const Slice& k,
+                                   const Slice& v)) const;
+
+  uint64_t ApproximateOffsetOf(const Slice& key) const;
+
+  // Heap memory holding the table's contents (zero if they are borrowed
+  // from the file).
+  size_t ApproximateMemoryUsage() const;
+
+ private:
+  class Iter;
+
+  PlainTable(const Comparator* comparator, const char* data, char* owned,
+             uint32_t data_size, uint32_t num_entries, uint32_t num_buckets);
+
+  // Decode the entry with index "index" into *key and *value.  Returns
+  // false if the entry is corrupt.
+  bool DecodeEntry(uint32_t index, Slice* key, Slice* value) const;
+
+  // Store in *index the index of the first entry >= target, or
+  // num_entries_ if there is none.
+  Status FindFirst(const Slice& target, uint32_t* index) const;
+
+  const Comparator* const comparator_;
+  const char* const data_;
+  char* const owned_;  // Heap copy of the file, or nullptr
+  const uint32_t data_size_;
+  const uint32_t num_entries_;
+  const uint32_t num_buckets_;
+  const char* const offsets_;
+  const char* const buckets_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_PLAIN_TABLE_H_
@@ -4,24 +4,130 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/pinnable_slice.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/plain_table.h"
 #include "table/two_level_iterator.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
+namespace {
+
+class DemotableBlock;
+
+// Where the blocks of one table go when the block cache drops them.  It is
+// shared by the table and by its cached blocks, which can outlive the
+// table; once the table is closed, dropped blocks are discarded.
+//
+// Dropped blocks wait in a queue of the table's own until a job scheduled
+// on the table's Env compresses them and stores them, so that neither the
+// block cache (whose deleters run with a shard locked) nor readers do
+// that work.
+class DemotionTarget {
+ public:
+  DemotionTarget(Env* env, Cache* compressed_cache,
+                 PersistentCache* persistent_cache)
+      : env_(env),
+        compressed_cache_(compressed_cache),
+        compressed_cache_id_(compressed_cache ? compressed_cache->NewId() : 0),
+        persistent_cache_(persistent_cache),
+        refs_(1),
+        closed_(false),
+        queued_bytes_(0),
+        scheduled_(false) {}
+
+  DemotionTarget(const DemotionTarget&) = delete;
+  DemotionTarget& operator=(const DemotionTarget&) = delete;
+
+  void Ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  void Unref() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  // Called when the table is destroyed.  Afterwards Demote() does nothing,
+  // so the caches only need to outlive the table.
+  void Close() {
+    MutexLock l(&mu_);
+    closed_.store(true, std::memory_order_release);
+  }
+  bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+  Cache* compressed_cache() const { return compressed_cache_; }
+
+  // Key of the block at "offset" in the compressed cache.  The id comes
+  // from the compressed cache itself, so tables that share it never
+  // collide, whatever block caches they use.
+  void EncodeCompressedKey(uint64_t offset, char* buf) const {
+    EncodeFixed64(buf, compressed_cache_id_);
+    EncodeFixed64(buf + 8, offset);
+  }
+
+  // Queue "block", which the block cache has dropped, to be demoted in the
+  // background.  Takes ownership of "block".
+  void Add(DemotableBlock* block);
+
+  // Store "compressed" (block contents followed by the block type) for
+  // the block at "offset".  Takes ownership of "compressed".
+  void Demote(uint64_t offset, const std::string& persistent_key,
+              std::string* compressed);
+
+ private:
+  // Blocks dropped while this many bytes wait to be demoted are discarded,
+  // so that the queue stays small when the background thread is busy.
+  static const size_t kMaxQueuedBytes = 1 << 20;
+
+  ~DemotionTarget() = default;
+
+  static void BGWork(void* arg);
+  void BackgroundDemote();
+
+  Env* const env_;
+  Cache* const compressed_cache_;             // May be null
+  const uint64_t compressed_cache_id_;
+  PersistentCache* const persistent_cache_;  // May be null
+  std::atomic<int> refs_;
+  port::Mutex mu_;  // Held while storing, so that Close() waits for it
+  std::atomic<bool> closed_;
+
+  port::Mutex queue_mu_;
+  std::vector<DemotableBlock*> queue_ GUARDED_BY(queue_mu_);
+  size_t queued_bytes_ GUARDED_BY(queue_mu_);
+  bool scheduled_ GUARDED_BY(queue_mu_);  // A BackgroundDemote() is pending
+};
+
+}  // namespace
+
 struct Table::Rep {
   ~Rep() {
     delete filter;
     delete[] filter_data;
     delete index_block;
+    delete plain;
+    if (demotion_target != nullptr) {
+      demotion_target->Close();
+      demotion_target->Unref();
+    }
   }
 
   Options options;
@@ -30,25 +136,74 @@ struct Table::Rep {
   uint64_t cache_id;
   FilterBlockReader* filter;
   const char* filter_data;
+  size_t filter_size;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+
+  PlainTable* plain;  // Non-null iff this is a plain table
+
+  // Prefix of the keys of the table's blocks in options.persistent_cache.
+  // Empty if the blocks are not kept there.
+  std::string persistent_cache_key_prefix;
+
+  // Non-null iff blocks dropped from the block cache are kept in the
+  // compressed or persistent cache.
+  DemotionTarget* demotion_target;
 };
 
+// With Options::table_metadata_cache_size set, a table may outlive the
+// file it was opened from, so it must not point into the file's memory
+// (e.g. an mmap-ed file).
+static void CopyToHeap(BlockContents* contents) {
+  if (!contents->heap_allocated) {
+    char* buf = new char[contents->data.size()];
+    std::memcpy(buf, contents->data.data(), contents->data.size());
+    contents->data = Slice(buf, contents->data.size());
+    contents->heap_allocated = true;
+  }
+}
+
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
+  return Open(options, file, size, Slice(), table);
+}
+
+Status Table::Open(const Options& options, RandomAccessFile* file,
+                   uint64_t size, const Slice& persistent_cache_key_prefix,
+                   Table** table) {
   *table = nullptr;
-  if (size < Footer::kEncodedLength) {
-    return Status::Corruption("file is too short to be an sstable");
-  }
 
   //读取文件尾部的Footer
+  const size_t footer_size = std::min<uint64_t>(size, Footer::kEncodedLength);
   char footer_space[Footer::kEncodedLength];
   Slice footer_input;
-  Status s = file->Read(size - Footer::kEncodedLength, Footer::kEncodedLength,
-                        &footer_input, footer_space);
+  Status s =
+      file->Read(size - footer_size, footer_size, &footer_input, footer_space);
   if (!s.ok()) return s;
 
+  if (PlainTable::HasMagic(footer_input)) {
+    PlainTable* plain;
+    s = PlainTable::Open(options, file, size, &plain);
+    if (s.ok()) {
+      Rep* rep = new Table::Rep;
+      rep->options = options;
+      rep->file = file;
+      rep->cache_id = 0;
+      rep->filter_data = nullptr;
+      rep->filter_size = 0;
+      rep->filter = nullptr;
+      rep->index_block = nullptr;
+      rep->plain = plain;
+      rep->demotion_target = nullptr;
+      *table = new Table(rep);
+    }
+    return s;
+  }
+  if (size < Footer::kEncodedLength) {
+    return Status::Corruption("file is too short to be an sstable");
+  }
+
   Footer footer;
   s = footer.DecodeFrom(&footer_input);
   if (!s.ok()) return s;
@@ -63,6 +218,9 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
 
   if (s.ok()) {
+    if (options.table_metadata_cache_size > 0) {
+      CopyToHeap(&index_block_contents);
+    }
     // We've successfully read the footer and the index block: we're
     // ready to serve requests.
     // 生成新的Block类实例、Rep类实例、Table类实例
@@ -74,7 +232,21 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
+    rep->filter_size = 0;
     rep->filter = nullptr;
+    rep->plain = nullptr;
+    if (options.persistent_cache != nullptr) {
+      rep->persistent_cache_key_prefix = persistent_cache_key_prefix.ToString();
+    }
+    rep->demotion_target = nullptr;
+    if (options.block_cache != nullptr &&
+        (options.compressed_block_cache != nullptr ||
+         !rep->persistent_cache_key_prefix.empty())) {
+      rep->demotion_target = new DemotionTarget(
+          options.env, options.compressed_block_cache,
+          rep->persistent_cache_key_prefix.empty() ? nullptr
+                                                   : options.persistent_cache);
+    }
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   }
@@ -128,6 +300,10 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
   }
+  if (rep_->options.table_metadata_cache_size > 0) {
+    CopyToHeap(&block);
+  }
+  rep_->filter_size = block.data.size();
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();  // Will need to delete later
   }
@@ -145,6 +321,161 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
+static void DeleteCompressedBlock(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+void DemotionTarget::Demote(uint64_t offset, const std::string& persistent_key,
+                            std::string* compressed) {
+  MutexLock l(&mu_);
+  if (closed()) {
+    delete compressed;
+    return;
+  }
+  if (persistent_cache_ != nullptr) {
+    persistent_cache_->Insert(persistent_key, *compressed);
+  }
+  if (compressed_cache_ != nullptr) {
+    char key[16];
+    EncodeCompressedKey(offset, key);
+    compressed_cache_->Release(
+        compressed_cache_->Insert(Slice(key, sizeof(key)), compressed,
+                                  compressed->size(), &DeleteCompressedBlock));
+  } else {
+    delete compressed;
+  }
+}
+
+namespace {
+
+// A block cached by a table with a DemotionTarget, to be moved there when
+// the block cache drops it.
+class DemotableBlock : public Block {
+ public:
+  DemotableBlock(const BlockContents& contents, DemotionTarget* target,
+                 uint64_t offset, const std::string& persistent_key)
+      : Block(contents),
+        target_(target),
+        offset_(offset),
+        persistent_key_(persistent_key) {
+    target_->Ref();
+  }
+
+  ~DemotableBlock() { target_->Unref(); }
+
+  DemotionTarget* target() const { return target_; }
+
+  // Compress the block and store it in the target's caches.  Entries of
+  // the compressed and persistent caches hold the block contents followed
+  // by the block type, as UncompressBlock() expects.  Blocks that Snappy
+  // cannot shrink by at least 12.5% (or all blocks, if Snappy is not
+  // available) are stored as-is.
+  void Demote() const {
+    std::string* compressed = new std::string;
+    if (port::Snappy_Compress(data(), size(), compressed) &&
+        compressed->size() < size() - (size() / 8u)) {
+      compressed->push_back(kSnappyCompression);
+    } else {
+      compressed->assign(data(), size());
+      compressed->push_back(kNoCompression);
+    }
+    target_->Demote(offset_, persistent_key_, compressed);
+  }
+
+ private:
+  DemotionTarget* const target_;
+  const uint64_t offset_;
+  const std::string persistent_key_;
+};
+
+}  // namespace
+
+void DemotionTarget::Add(DemotableBlock* block) {
+  bool queued = false;
+  bool schedule = false;
+  if (!closed()) {
+    MutexLock l(&queue_mu_);
+    if (queued_bytes_ + block->size() <= kMaxQueuedBytes) {
+      queue_.push_back(block);
+      queued_bytes_ += block->size();
+      queued = true;
+      if (!scheduled_) {
+        scheduled_ = true;
+        Ref();  // Released by BackgroundDemote()
+        schedule = true;
+      }
+    }
+  }
+  if (schedule) {
+    env_->Schedule(&DemotionTarget::BGWork, this);
+  }
+  if (!queued) {
+    delete block;  // May drop the last reference to this
+  }
+}
+
+void DemotionTarget::BGWork(void* arg) {
+  reinterpret_cast<DemotionTarget*>(arg)->BackgroundDemote();
+}
+
+void DemotionTarget::BackgroundDemote() {
+  while (true) {
+    std::vector<DemotableBlock*> blocks;
+    {
+      MutexLock l(&queue_mu_);
+      if (queue_.empty()) {
+        scheduled_ = false;
+        break;
+      }
+      blocks.swap(queue_);
+      queued_bytes_ = 0;
+    }
+    for (DemotableBlock* block : blocks) {
+      if (!closed()) {
+        block->Demote();
+      }
+      delete block;
+    }
+  }
+  Unref();
+}
+
+// Deleter for DemotableBlocks.
+static void DemoteCachedBlock(const Slice& key, void* value) {
+  DemotableBlock* block =
+      static_cast<DemotableBlock*>(reinterpret_cast<Block*>(value));
+  block->target()->Add(block);
+}
+
+// If "compressed_cache" holds the block for "key", uncompress it into
+// *contents and return true.  Unless "keep" is set the entry is erased,
+// since the caller moves the block back into the block cache.
+static bool LookupCompressedBlock(Cache* compressed_cache, const Slice& key,
+                                  bool keep, BlockContents* contents,
+                                  Status* s) {
+  Cache::Handle* handle = compressed_cache->Lookup(key);
+  if (handle == nullptr) {
+    return false;
+  }
+  const std::string* compressed =
+      reinterpret_cast<std::string*>(compressed_cache->Value(handle));
+  *s = UncompressBlock(compressed->data(), compressed->size() - 1, contents);
+  compressed_cache->Release(handle);
+  if (!keep) {
+    compressed_cache->Erase(key);
+  }
+  return true;
+}
+
+// If "persistent_cache" holds the block for "key", uncompress it into
+// *contents and return true.
+static bool LookupPersistentBlock(PersistentCache* persistent_cache,
+                                  const Slice& key, BlockContents* contents) {
+  std::string stored;
+  return persistent_cache->Lookup(key, &stored) && !stored.empty() &&
+         UncompressBlock(stored.data(), stored.size() - 1, contents).ok();
+}
+
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
@@ -156,6 +487,35 @@ static void ReleaseBlock(void* arg, void* h) {
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
+  assert(table->rep_->file != nullptr);
+  return BlockReader(table, table->rep_->file, options, index_value, nullptr);
+}
+
+namespace {
+
+// The argument of Table::FileBlockReader.
+struct TableFile {
+  const Table* table;
+  RandomAccessFile* file;
+};
+
+}  // namespace
+
+static void DeleteTableFile(void* arg, void* ignored) {
+  delete reinterpret_cast<TableFile*>(arg);
+}
+
+Iterator* Table::FileBlockReader(void* arg, const ReadOptions& options,
+                                 const Slice& index_value) {
+  TableFile* table_file = reinterpret_cast<TableFile*>(arg);
+  return BlockReader(table_file->table, table_file->file, options,
+                     index_value, nullptr);
+}
+
+Iterator* Table::BlockReader(const Table* table, RandomAccessFile* file,
+                             const ReadOptions& options,
+                             const Slice& index_value,
+                             const Slice* get_target) {
   Cache* block_cache = table->rep_->options.block_cache;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
@@ -177,17 +537,50 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        const Table::Rep* rep = table->rep_;
+        DemotionTarget* target = rep->demotion_target;
+        Cache* compressed_cache =
+            target != nullptr ? target->compressed_cache() : nullptr;
+        char compressed_key_buffer[16];
+        if (compressed_cache != nullptr) {
+          target->EncodeCompressedKey(handle.offset(), compressed_key_buffer);
+        }
+        Slice compressed_key(compressed_key_buffer,
+                             sizeof(compressed_key_buffer));
+        PersistentCache* persistent_cache = nullptr;
+        std::string persistent_key;
+        if (!rep->persistent_cache_key_prefix.empty()) {
+          persistent_cache = rep->options.persistent_cache;
+          persistent_key = rep->persistent_cache_key_prefix;
+          PutFixed64(&persistent_key, handle.offset());
+        }
+        if ((compressed_cache == nullptr ||
+             !LookupCompressedBlock(compressed_cache, compressed_key,
+                                    !options.fill_cache, &contents, &s)) &&
+            (persistent_cache == nullptr ||
+             !LookupPersistentBlock(persistent_cache, persistent_key,
+                                    &contents))) {
+          s = ReadBlock(file, options, handle, &contents);
+        }
         if (s.ok()) {
-          block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
+            if (target != nullptr) {
+              block = new DemotableBlock(contents, target, handle.offset(),
+                                         persistent_key);
+              cache_handle = block_cache->Insert(key, block, block->size(),
+                                                 &DemoteCachedBlock);
+            } else {
+              block = new Block(contents);
+              cache_handle = block_cache->Insert(key, block, block->size(),
+                                                 &DeleteCachedBlock);
+            }
+          } else {
+            block = new Block(contents);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(file, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -196,7 +589,12 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 
   Iterator* iter;
   if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    const Comparator* comparator = table->rep_->options.comparator;
+    if (get_target == nullptr) {
+      iter = block->NewIterator(comparator);
+    } else {
+      iter = block->NewIteratorForGet(comparator, *get_target);
+    }
     if (cache_handle == nullptr) {
       iter->RegisterCleanup(&DeleteBlock, block, nullptr);
     } else {
@@ -229,14 +627,44 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
  * 这样就非常合理且高效了
  */
 Iterator* Table::NewIterator(const ReadOptions& options) const {
+  if (rep_->plain != nullptr) {
+    return rep_->plain->NewIterator();
+  }
+  assert(rep_->file != nullptr);  // See ForgetFile()
   return NewTwoLevelIterator(
       rep_->index_block->NewIterator(rep_->options.comparator),
       &Table::BlockReader, const_cast<Table*>(this), options);
 }
 
-Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
+Iterator* Table::NewIterator(const ReadOptions& options,
+                             RandomAccessFile* file) const {
+  if (rep_->plain != nullptr) {
+    return rep_->plain->NewIterator();
+  }
+  TableFile* arg = new TableFile;
+  arg->table = this;
+  arg->file = file;
+  Iterator* iter = NewTwoLevelIterator(
+      rep_->index_block->NewIterator(rep_->options.comparator),
+      &Table::FileBlockReader, arg, options);
+  iter->RegisterCleanup(&DeleteTableFile, arg, nullptr);
+  return iter;
+}
+
+void Table::ForgetFile() { rep_->file = nullptr; }
+
+static void DeleteIterator(void* arg1, void* arg2) {
+  delete reinterpret_cast<Iterator*>(arg1);
+}
+
+Status Table::InternalGet(const ReadOptions& options, RandomAccessFile* file,
+                          const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
-                                                const Slice&)) {
+                                                const Slice&),
+                          PinnableSlice* pinned) {
+  if (rep_->plain != nullptr) {
+    return rep_->plain->Get(k, arg, handle_result);
+  }
   Status s;
   Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
   iiter->Seek(k);
@@ -248,13 +676,18 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
+      Iterator* block_iter =
+          BlockReader(this, file, options, iiter->value(), &k);
       if (block_iter->Valid()) {
         (*handle_result)(arg, block_iter->key(), block_iter->value());
       }
       s = block_iter->status();
-      delete block_iter;
+      if (pinned != nullptr && pinned->IsPinned()) {
+        // The iterator holds the block (or its cache handle).
+        pinned->RegisterCleanup(&DeleteIterator, block_iter, nullptr);
+      } else {
+        delete block_iter;
+      }
     }
   }
   if (s.ok()) {
@@ -265,6 +698,9 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
 }
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
+  if (rep_->plain != nullptr) {
+    return rep_->plain->ApproximateOffsetOf(key);
+  }
   Iterator* index_iter =
       rep_->index_block->NewIterator(rep_->options.comparator);
   index_iter->Seek(key);
@@ -291,4 +727,14 @@ uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   return result;
 }
 
+size_t Table::ApproximateMemoryUsage() const {
+  size_t usage = sizeof(Table) + sizeof(Rep);
+  if (rep_->plain != nullptr) {
+    usage += rep_->plain->ApproximateMemoryUsage();
+  } else {
+    usage += rep_->index_block->size() + rep_->filter_size;
+  }
+  return usage;
+}
+
 }  // namespace leveldb
@@ -5,34 +5,67 @@
 #include "leveldb/table_builder.h"
 
 #include <cassert>
+#include <deque>
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
 #include "table/block_builder.h"
+#include "table/compression_pool.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/plain_table.h"
 #include "util/coding.h"
-#include "util/crc32c.h"
 
 namespace leveldb {
 
+namespace {
+
+// Maximum number of data blocks per compression thread that may be
+// waiting to be written before Add() blocks.
+const int kMaxPendingBlocksPerThread = 4;
+
+// A finished data block that is compressed in the background and then
+// written to the file in order.
+struct PendingBlock : public CompressionTask {
+  std::string filter_keys;  // Length-prefixed keys of the block
+  std::string index_key;    // Valid iff has_index_key
+  bool has_index_key;
+};
+
+}  // namespace
+
 struct TableBuilder::Rep {
-  Rep(const Options& opt, WritableFile* f)
+  Rep(const Options& opt, WritableFile* f, CompressionPool* shared_pool)
       : options(opt),
         index_block_options(opt),
         file(f),
         offset(0),
-        data_block(&options),
+        data_block(&options, opt.data_block_hash_index),
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
+        filter_block(opt.filter_policy == nullptr ||
+                             opt.table_format == kPlainTableFormat
                          ? nullptr
                          : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        pending_index_entry(false),
+        pool(nullptr),
+        owns_pool(false),
+        pending_bytes(0),
+        plain(opt.table_format == kPlainTableFormat
+                  ? new PlainTableBuilder(opt, f)
+                  : nullptr) {
     index_block_options.block_restart_interval = 1;
+    if (opt.compression_threads > 1 && opt.table_format == kBlockTableFormat) {
+      if (shared_pool != nullptr) {
+        pool = shared_pool;
+      } else {
+        pool = new CompressionPool(opt.env, opt.compression_threads);
+        owns_pool = true;
+      }
+    }
   }
 
   Options options;
@@ -60,11 +93,30 @@ struct TableBuilder::Rep {
   BlockHandle pending_handle;  // Handle to add to index block
 
   std::string compressed_output;
+
+  // Only used with more than one compression thread.  Data blocks are
+  // queued in pending_blocks, in file order, until they are compressed.
+  // Their keys are collected in filter_keys so they can be added to the
+  // filter once the block's offset is known.  pending_bytes is the
+  // uncompressed size of the queued blocks and their trailers.
+  CompressionPool* pool;
+  bool owns_pool;
+  std::deque<PendingBlock*> pending_blocks;
+  std::string filter_keys;
+  uint64_t pending_bytes;
+
+  // Only used for Options::table_format == kPlainTableFormat, in which
+  // case entries bypass the block builders.
+  PlainTableBuilder* plain;
 };
 
 // 构造函数。初始化rep_对象
 TableBuilder::TableBuilder(const Options& options, WritableFile* file)
-    : rep_(new Rep(options, file)) {
+    : TableBuilder(options, file, nullptr) {}
+
+TableBuilder::TableBuilder(const Options& options, WritableFile* file,
+                           CompressionPool* pool)
+    : rep_(new Rep(options, file, pool)) {
   if (rep_->filter_block != nullptr) {
     rep_->filter_block->StartBlock(0);
   }
@@ -73,7 +125,17 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 // 析构函数。删除rep_
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
+  for (PendingBlock* block : rep_->pending_blocks) {
+    // Threads of a shared pool keep running, so wait for them to be done
+    // with the block.
+    rep_->pool->WaitFor(block);
+    delete block;
+  }
+  if (rep_->owns_pool) {
+    delete rep_->pool;
+  }
   delete rep_->filter_block;
+  delete rep_->plain;
   delete rep_;
 }
 
@@ -84,6 +146,18 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.compression_threads != rep_->options.compression_threads) {
+    return Status::InvalidArgument(
+        "changing compression_threads while building table");
+  }
+  if (options.data_block_hash_index != rep_->options.data_block_hash_index) {
+    return Status::InvalidArgument(
+        "changing data_block_hash_index while building table");
+  }
+  if (options.table_format != rep_->options.table_format) {
+    return Status::InvalidArgument(
+        "changing table_format while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -101,17 +175,26 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
   }
 
+  if (r->plain != nullptr) {
+    r->status = r->plain->Add(key, value);
+    r->offset = r->plain->FileSize();
+    r->last_key.assign(key.data(), key.size());
+    r->num_entries++;
+    return;
+  }
+
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
-    r->pending_index_entry = false;
+    AddPendingIndexEntry();
   }
 
   if (r->filter_block != nullptr) {
-    r->filter_block->AddKey(key);
+    if (r->pool != nullptr) {
+      PutLengthPrefixedSlice(&r->filter_keys, key);
+    } else {
+      r->filter_block->AddKey(key);
+    }
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -130,8 +213,12 @@ void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
-  if (r->data_block.empty()) return;
+  if (r->data_block.empty()) return;  // Always true for plain tables
   assert(!r->pending_index_entry);
+  if (r->pool != nullptr) {
+    ScheduleDataBlock();
+    return;
+  }
   WriteBlock(&r->data_block, &r->pending_handle);
   if (ok()) {
     r->pending_index_entry = true;
@@ -153,26 +240,7 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
 
   Slice block_contents;
   CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
-  switch (type) {
-    case kNoCompression:
-      block_contents = raw;
-      break;
-
-    case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        // Snappy not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
-      }
-      break;
-    }
-  }
+  CompressBlock(raw, &type, &r->compressed_output, &block_contents);
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
   block->Reset();
@@ -180,16 +248,18 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
                                  CompressionType type, BlockHandle* handle) {
+  char trailer[kBlockTrailerSize];
+  EncodeBlockTrailer(block_contents, type, trailer);
+  AppendBlock(block_contents, trailer, handle);
+}
+
+void TableBuilder::AppendBlock(const Slice& block_contents,
+                               const char* trailer, BlockHandle* handle) {
   Rep* r = rep_;
   handle->set_offset(r->offset);
   handle->set_size(block_contents.size());
   r->status = r->file->Append(block_contents);
   if (r->status.ok()) {
-    char trailer[kBlockTrailerSize];
-    trailer[0] = type;
-    uint32_t crc = crc32c::Value(block_contents.data(), block_contents.size());
-    crc = crc32c::Extend(crc, trailer, 1);  // Extend crc to cover block type
-    EncodeFixed32(trailer + 1, crc32c::Mask(crc));
     r->status = r->file->Append(Slice(trailer, kBlockTrailerSize));
     if (r->status.ok()) {
       r->offset += block_contents.size() + kBlockTrailerSize;
@@ -197,6 +267,75 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
   }
 }
 
+void TableBuilder::AddPendingIndexEntry() {
+  Rep* r = rep_;
+  if (!r->pending_blocks.empty()) {
+    // The block is still being compressed, so its handle is not known
+    // yet.  It is added to the index block when the block is written.
+    PendingBlock* block = r->pending_blocks.back();
+    assert(!block->has_index_key);
+    block->index_key = r->last_key;
+    block->has_index_key = true;
+  } else {
+    std::string handle_encoding;
+    r->pending_handle.EncodeTo(&handle_encoding);
+    r->index_block.Add(r->last_key, Slice(handle_encoding));
+  }
+  r->pending_index_entry = false;
+}
+
+void TableBuilder::ScheduleDataBlock() {
+  Rep* r = rep_;
+  PendingBlock* block = new PendingBlock;
+  Slice raw = r->data_block.Finish();
+  block->raw.assign(raw.data(), raw.size());
+  block->type = r->options.compression;
+  block->filter_keys.swap(r->filter_keys);
+  block->has_index_key = false;
+  r->data_block.Reset();
+  r->pending_blocks.push_back(block);
+  r->pending_bytes += block->raw.size() + kBlockTrailerSize;
+  r->pool->Schedule(block);
+  r->pending_index_entry = true;
+  WritePendingBlocks(kMaxPendingBlocksPerThread * r->pool->threads());
+}
+
+void TableBuilder::WritePendingBlocks(size_t max_pending) {
+  Rep* r = rep_;
+  while (r->pending_blocks.size() > max_pending) {
+    PendingBlock* block = r->pending_blocks.front();
+    r->pool->WaitFor(block);
+    r->pending_blocks.pop_front();
+    r->pending_bytes -= block->raw.size() + kBlockTrailerSize;
+
+    if (ok()) {
+      BlockHandle handle;
+      AppendBlock(block->contents, block->trailer, &handle);
+      if (ok()) {
+        if (block->has_index_key) {
+          std::string handle_encoding;
+          handle.EncodeTo(&handle_encoding);
+          r->index_block.Add(block->index_key, Slice(handle_encoding));
+        } else {
+          // Only the last block can still be waiting for its index key.
+          assert(r->pending_blocks.empty());
+          r->pending_handle = handle;
+        }
+        r->status = r->file->Flush();
+      }
+      if (r->filter_block != nullptr) {
+        Slice keys(block->filter_keys);
+        Slice key;
+        while (GetLengthPrefixedSlice(&keys, &key)) {
+          r->filter_block->AddKey(key);
+        }
+        r->filter_block->StartBlock(r->offset);
+      }
+    }
+    delete block;
+  }
+}
+
 Status TableBuilder::status() const { return rep_->status; }
 
 // 当执行 TableBuilder::Finish 操作时，会将 index_block_ 也写入文件，
@@ -207,6 +346,16 @@ Status TableBuilder::Finish() {
   Flush();
   assert(!r->closed);
   r->closed = true;
+  if (r->plain != nullptr) {
+    if (ok()) {
+      r->status = r->plain->Finish();
+      r->offset = r->plain->FileSize();
+    }
+    return r->status;
+  }
+  if (r->pool != nullptr) {
+    WritePendingBlocks(0);
+  }
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
 
@@ -236,10 +385,7 @@ Status TableBuilder::Finish() {
   if (ok()) {
     if (r->pending_index_entry) {
       r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
+      AddPendingIndexEntry();
     }
     WriteBlock(&r->index_block, &index_block_handle);
   }
@@ -267,6 +413,8 @@ void TableBuilder::Abandon() {
 
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
-uint64_t TableBuilder::FileSize() const { return rep_->offset; }
+uint64_t TableBuilder::FileSize() const {
+  return rep_->offset + rep_->pending_bytes;
+}
 
 }  // namespace leveldb
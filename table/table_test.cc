@@ -4,19 +4,25 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
+#include "leveldb/persistent_cache.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
+#include "table/compression_pool.h"
 #include "table/format.h"
 #include "util/random.h"
 #include "util/testutil.h"
@@ -132,6 +138,74 @@ class StringSource : public RandomAccessFile {
   std::string contents_;
 };
 
+// A StringSource that counts its reads.
+class CountingStringSource : public StringSource {
+ public:
+  CountingStringSource(const Slice& contents)
+      : StringSource(contents), reads_(0) {}
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    reads_++;
+    return StringSource::Read(offset, n, result, scratch);
+  }
+
+  int reads() const { return reads_; }
+
+ private:
+  mutable int reads_;
+};
+
+// An Env whose Schedule()d jobs only run when RunScheduled() is called.
+// Meant for single-threaded tests.
+class ManualScheduleEnv : public EnvWrapper {
+ public:
+  ManualScheduleEnv() : EnvWrapper(Env::Default()) {}
+
+  void Schedule(void (*function)(void*), void* arg) override {
+    jobs_.emplace_back(function, arg);
+  }
+
+  int scheduled() const { return jobs_.size(); }
+
+  void RunScheduled() {
+    while (!jobs_.empty()) {
+      std::pair<void (*)(void*), void*> job = jobs_.front();
+      jobs_.erase(jobs_.begin());
+      job.first(job.second);
+    }
+  }
+
+ private:
+  std::vector<std::pair<void (*)(void*), void*>> jobs_;
+};
+
+// A file that returns pointers into its own memory, like an mmap-ed file.
+class MappedStringSource : public RandomAccessFile {
+ public:
+  MappedStringSource(const Slice& contents)
+      : contents_(contents.data(), contents.size()), largest_copy_(0) {}
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    if (offset + n > contents_.size()) {
+      return Status::InvalidArgument("invalid Read offset");
+    }
+    if (scratch != nullptr && n > largest_copy_) {
+      largest_copy_ = n;
+    }
+    *result = Slice(contents_.data() + offset, n);
+    return Status::OK();
+  }
+
+  // Size of the largest read that came with a scratch buffer.
+  size_t largest_copy() const { return largest_copy_; }
+
+ private:
+  std::string contents_;
+  mutable size_t largest_copy_;
+};
+
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
 
 // Helper class for tests to unify the interface between
@@ -370,36 +444,49 @@ class DBConstructor : public Constructor {
   DB* db_;
 };
 
-enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST };
+enum TestType {
+  TABLE_TEST,
+  PLAIN_TABLE_TEST,
+  BLOCK_TEST,
+  MEMTABLE_TEST,
+  DB_TEST
+};
 
 struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  int compression_threads;
 };
 
 static const TestArgs kTestArgList[] = {
-    {TABLE_TEST, false, 16},
-    {TABLE_TEST, false, 1},
-    {TABLE_TEST, false, 1024},
-    {TABLE_TEST, true, 16},
-    {TABLE_TEST, true, 1},
-    {TABLE_TEST, true, 1024},
-
-    {BLOCK_TEST, false, 16},
-    {BLOCK_TEST, false, 1},
-    {BLOCK_TEST, false, 1024},
-    {BLOCK_TEST, true, 16},
-    {BLOCK_TEST, true, 1},
-    {BLOCK_TEST, true, 1024},
+    {TABLE_TEST, false, 16, 1},
+    {TABLE_TEST, false, 1, 1},
+    {TABLE_TEST, false, 1024, 1},
+    {TABLE_TEST, true, 16, 1},
+    {TABLE_TEST, true, 1, 1},
+    {TABLE_TEST, true, 1024, 1},
+    {TABLE_TEST, false, 16, 4},
+    {TABLE_TEST, true, 1, 4},
+
+    // Restart interval does not matter for plain tables
+    {PLAIN_TABLE_TEST, false, 16, 1},
+    {PLAIN_TABLE_TEST, true, 16, 1},
+
+    {BLOCK_TEST, false, 16, 1},
+    {BLOCK_TEST, false, 1, 1},
+    {BLOCK_TEST, false, 1024, 1},
+    {BLOCK_TEST, true, 16, 1},
+    {BLOCK_TEST, true, 1, 1},
+    {BLOCK_TEST, true, 1024, 1},
 
     // Restart interval does not matter for memtables
-    {MEMTABLE_TEST, false, 16},
-    {MEMTABLE_TEST, true, 16},
+    {MEMTABLE_TEST, false, 16, 1},
+    {MEMTABLE_TEST, true, 16, 1},
 
     // Do not bother with restart interval variations for DB
-    {DB_TEST, false, 16},
-    {DB_TEST, true, 16},
+    {DB_TEST, false, 16, 1},
+    {DB_TEST, true, 16, 1},
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -413,6 +500,7 @@ class Harness : public testing::Test {
     options_ = Options();
 
     options_.block_restart_interval = args.restart_interval;
+    options_.compression_threads = args.compression_threads;
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
@@ -423,6 +511,10 @@ class Harness : public testing::Test {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
         break;
+      case PLAIN_TABLE_TEST:
+        options_.table_format = kPlainTableFormat;
+        constructor_ = new TableConstructor(options_.comparator);
+        break;
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
@@ -699,7 +791,7 @@ TEST_F(Harness, Randomized) {
 
 TEST_F(Harness, RandomizedLongDB) {
   Random rnd(test::RandomSeed());
-  TestArgs args = {DB_TEST, false, 16};
+  TestArgs args = {DB_TEST, false, 16, 1};
   Init(args);
   int num_entries = 100000;
   for (int e = 0; e < num_entries; e++) {
@@ -784,6 +876,94 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
+namespace {
+// Considers keys that differ only in the case of ASCII letters equal, so
+// equal keys need not have equal bytes.
+class CaseInsensitiveComparator : public Comparator {
+ public:
+  const char* Name() const override { return "test.CaseInsensitive"; }
+
+  int Compare(const Slice& a, const Slice& b) const override {
+    const size_t n = std::min(a.size(), b.size());
+    for (size_t i = 0; i < n; i++) {
+      const int ca = Lower(a[i]);
+      const int cb = Lower(b[i]);
+      if (ca != cb) {
+        return ca < cb ? -1 : +1;
+      }
+    }
+    return a.size() < b.size() ? -1 : (a.size() > b.size() ? +1 : 0);
+  }
+
+  void FindShortestSeparator(std::string*, const Slice&) const override {}
+  void FindShortSuccessor(std::string*) const override {}
+
+ private:
+  static int Lower(char c) {
+    const unsigned char u = static_cast<unsigned char>(c);
+    return (u >= 'A' && u <= 'Z') ? u - 'A' + 'a' : u;
+  }
+};
+}  // namespace
+
+TEST(TableTest, HashIndexWithCaseInsensitiveComparator) {
+  CaseInsensitiveComparator cmp;
+  for (bool plain : {false, true}) {
+    const std::string name = testing::TempDir() + "table_testdb_nocase";
+    Options options;
+    options.comparator = &cmp;
+    options.data_block_hash_index = true;
+    if (plain) {
+      options.table_format = kPlainTableFormat;
+    }
+    ASSERT_LEVELDB_OK(DestroyDB(name, options));
+    options.create_if_missing = true;
+    DB* db;
+    ASSERT_LEVELDB_OK(DB::Open(options, name, &db));
+    ASSERT_LEVELDB_OK(db->Put(WriteOptions(), "Apple", "1"));
+    ASSERT_LEVELDB_OK(db->Put(WriteOptions(), "banana", "2"));
+    ASSERT_LEVELDB_OK(db->Put(WriteOptions(), "CHERRY", "3"));
+    db->CompactRange(nullptr, nullptr);  // Read back from a table
+
+    std::string value;
+    ASSERT_LEVELDB_OK(db->Get(ReadOptions(), "apple", &value));
+    ASSERT_EQ("1", value);
+    ASSERT_LEVELDB_OK(db->Get(ReadOptions(), "BANANA", &value));
+    ASSERT_EQ("2", value);
+    ASSERT_LEVELDB_OK(db->Get(ReadOptions(), "Cherry", &value));
+    ASSERT_EQ("3", value);
+    ASSERT_TRUE(db->Get(ReadOptions(), "date", &value).IsNotFound());
+    delete db;
+    ASSERT_LEVELDB_OK(DestroyDB(name, options));
+  }
+}
+
+TEST(TableTest, PlainTableFromMappedFile) {
+  Options options;
+  options.table_format = kPlainTableFormat;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  for (int i = 0; i < 1000; i++) {
+    char key[10];
+    std::snprintf(key, sizeof(key), "k%05d", i);
+    builder.Add(key, std::string(100, 'a' + (i % 26)));
+  }
+  ASSERT_LEVELDB_OK(builder.Finish());
+
+  // The table refers to the mapping instead of allocating a copy.
+  MappedStringSource source(sink.contents());
+  Table* table;
+  ASSERT_LEVELDB_OK(
+      Table::Open(options, &source, sink.contents().size(), &table));
+  ASSERT_LT(source.largest_copy(), 100);
+  Iterator* iter = table->NewIterator(ReadOptions());
+  iter->Seek("k00500");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(std::string(100, 'a' + (500 % 26)), iter->value().ToString());
+  delete iter;
+  delete table;
+}
+
 static bool SnappyCompressionSupported() {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -824,4 +1004,360 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+// Build a table of "n" entries.  If "sizes" is non-null, stores in it
+// the value of FileSize() after each entry.
+static std::string BuildTable(const Options& options, int n,
+                              CompressionPool* pool = nullptr,
+                              std::vector<uint64_t>* sizes = nullptr) {
+  Random rnd(301);
+  StringSink sink;
+  TableBuilder builder(options, &sink, pool);
+  std::string value;
+  for (int i = 0; i < n; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%08d", i);
+    builder.Add(key, test::CompressibleString(&rnd, 0.25, 300, &value));
+    if (sizes != nullptr) {
+      sizes->push_back(builder.FileSize());
+    }
+  }
+  EXPECT_LEVELDB_OK(builder.Finish());
+  EXPECT_EQ(sink.contents().size(), builder.FileSize());
+  return sink.contents();
+}
+
+TEST(TableTest, ParallelCompressionMatchesSerial) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  Options serial;
+  serial.block_size = 1024;
+  serial.filter_policy = policy;
+  Options parallel = serial;
+  parallel.compression_threads = 4;
+
+  for (int n : {0, 1, 5000}) {
+    ASSERT_EQ(BuildTable(serial, n), BuildTable(parallel, n)) << n;
+  }
+
+  // Builders can share the threads of a longer-lived pool.
+  CompressionPool pool(Env::Default(), 2);
+  for (int n : {0, 1, 5000}) {
+    ASSERT_EQ(BuildTable(serial, n), BuildTable(parallel, n, &pool)) << n;
+  }
+
+  // Blocks that are still being compressed count towards FileSize() at
+  // their uncompressed size, so it never lags behind a serial build.
+  std::vector<uint64_t> serial_sizes, parallel_sizes;
+  BuildTable(serial, 5000, nullptr, &serial_sizes);
+  BuildTable(parallel, 5000, &pool, &parallel_sizes);
+  ASSERT_EQ(serial_sizes.size(), parallel_sizes.size());
+  for (size_t i = 0; i < serial_sizes.size(); i++) {
+    ASSERT_GE(parallel_sizes[i], serial_sizes[i]) << i;
+  }
+  delete policy;
+}
+
+// Read every entry of "table" and return how many there were.
+static int ReadAll(Table* table, const ReadOptions& options) {
+  Iterator* iter = table->NewIterator(options);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  EXPECT_LEVELDB_OK(iter->status());
+  delete iter;
+  return count;
+}
+
+TEST(TableTest, CompressedBlockCache) {
+  Options options;
+  options.block_size = 1024;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    char key[10];
+    std::snprintf(key, sizeof(key), "k%05d", i);
+    builder.Add(key, std::string(100, 'a' + (i % 26)));
+  }
+  ASSERT_LEVELDB_OK(builder.Finish());
+
+  ManualScheduleEnv env;
+  CountingStringSource source(sink.contents());
+  options.env = &env;
+  options.block_cache = NewLRUCache(0);  // Every block is dropped at once
+  options.compressed_block_cache = NewLRUCache(1 << 20);
+  Table* table;
+  ASSERT_LEVELDB_OK(
+      Table::Open(options, &source, sink.contents().size(), &table));
+
+  // Blocks dropped from the block cache land in the compressed cache, but
+  // only once the background job has run.
+  int reads = source.reads();
+  ASSERT_EQ(N, ReadAll(table, ReadOptions()));
+  ASSERT_GT(source.reads(), reads);
+  ASSERT_EQ(1, env.scheduled());
+  ASSERT_EQ(0, options.compressed_block_cache->TotalCharge());
+  env.RunScheduled();
+  ASSERT_GT(options.compressed_block_cache->TotalCharge(), 0);
+
+  // So reading them again needs no file reads, with or without fill_cache.
+  reads = source.reads();
+  ASSERT_EQ(N, ReadAll(table, ReadOptions()));
+  env.RunScheduled();
+  ReadOptions no_fill;
+  no_fill.fill_cache = false;
+  ASSERT_EQ(N, ReadAll(table, no_fill));
+  ASSERT_EQ(N, ReadAll(table, ReadOptions()));
+  env.RunScheduled();
+  ASSERT_EQ(reads, source.reads());
+
+  delete table;
+  delete options.block_cache;
+  delete options.compressed_block_cache;
+}
+
+TEST(TableTest, CompressedBlockCacheHitsDoNoDemotion) {
+  Options options;
+  options.block_size = 1024;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    char key[10];
+    std::snprintf(key, sizeof(key), "k%05d", i);
+    builder.Add(key, std::string(100, 'a' + (i % 26)));
+  }
+  ASSERT_LEVELDB_OK(builder.Finish());
+
+  // One table drops every block; the other keeps all of them cached.
+  ManualScheduleEnv env;
+  StringSource source(sink.contents());
+  options.env = &env;
+  options.compressed_block_cache = NewLRUCache(1 << 20);
+  Cache* small_cache = NewLRUCache(0);
+  Cache* large_cache = NewLRUCache(1 << 20);
+  Table* dropping;
+  Table* caching;
+  options.block_cache = small_cache;
+  ASSERT_LEVELDB_OK(
+      Table::Open(options, &source, sink.contents().size(), &dropping));
+  options.block_cache = large_cache;
+  ASSERT_LEVELDB_OK(
+      Table::Open(options, &source, sink.contents().size(), &caching));
+  ASSERT_EQ(N, ReadAll(caching, ReadOptions()));
+  ASSERT_EQ(N, ReadAll(dropping, ReadOptions()));
+  ASSERT_EQ(1, env.scheduled());
+
+  // Block cache hits leave the blocks dropped by the other table queued.
+  ASSERT_EQ(N, ReadAll(caching, ReadOptions()));
+  ASSERT_EQ(1, env.scheduled());
+  ASSERT_EQ(0, options.compressed_block_cache->TotalCharge());
+
+  env.RunScheduled();
+  ASSERT_GT(options.compressed_block_cache->TotalCharge(), 0);
+
+  delete caching;
+  delete dropping;
+  delete large_cache;
+  delete small_cache;
+  delete options.compressed_block_cache;
+}
+
+TEST(TableTest, SharedCompressedBlockCache) {
+  Options options;
+  options.block_size = 1024;
+  const int N = 1000;
+  StringSink sinks[2];
+  for (int t = 0; t < 2; t++) {
+    TableBuilder builder(options, &sinks[t]);
+    for (int i = 0; i < N; i++) {
+      char key[10];
+      std::snprintf(key, sizeof(key), "k%05d", i);
+      builder.Add(key, std::string(100, 'a' + t));
+    }
+    ASSERT_LEVELDB_OK(builder.Finish());
+  }
+
+  // Two tables with block caches of their own share a compressed cache.
+  // Their blocks have the same offsets, and both block caches hand out
+  // the same ids.
+  ManualScheduleEnv env;
+  options.env = &env;
+  options.compressed_block_cache = NewLRUCache(1 << 20);
+  StringSource* sources[2];
+  Cache* block_caches[2];
+  Table* tables[2];
+  for (int t = 0; t < 2; t++) {
+    sources[t] = new StringSource(sinks[t].contents());
+    block_caches[t] = NewLRUCache(0);  // Every block is dropped at once
+    options.block_cache = block_caches[t];
+    ASSERT_LEVELDB_OK(Table::Open(options, sources[t],
+                                  sinks[t].contents().size(), &tables[t]));
+  }
+
+  // Each table only ever sees its own blocks.
+  for (int pass = 0; pass < 2; pass++) {
+    for (int t = 0; t < 2; t++) {
+      Iterator* iter = tables[t]->NewIterator(ReadOptions());
+      int count = 0;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ASSERT_EQ(std::string(100, 'a' + t), iter->value().ToString());
+        count++;
+      }
+      ASSERT_LEVELDB_OK(iter->status());
+      ASSERT_EQ(N, count);
+      delete iter;
+      env.RunScheduled();
+    }
+  }
+  ASSERT_GT(options.compressed_block_cache->TotalCharge(), 0);
+
+  for (int t = 0; t < 2; t++) {
+    delete tables[t];
+    delete block_caches[t];
+    delete sources[t];
+  }
+  delete options.compressed_block_cache;
+}
+
+TEST(TableTest, PersistentCache) {
+  Options options;
+  options.block_size = 1024;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    char key[10];
+    std::snprintf(key, sizeof(key), "k%05d", i);
+    builder.Add(key, std::string(100, 'a' + (i % 26)));
+  }
+  ASSERT_LEVELDB_OK(builder.Finish());
+
+  Env* env = Env::Default();
+  const std::string path = testing::TempDir() + "table_test_persistent_cache";
+  std::vector<std::string> filenames;
+  env->GetChildren(path, &filenames);
+  for (const std::string& filename : filenames) {
+    env->RemoveFile(path + "/" + filename);
+  }
+
+  ManualScheduleEnv schedule_env;
+  CountingStringSource source(sink.contents());
+  options.env = &schedule_env;
+  options.block_cache = NewLRUCache(0);  // Every block is dropped at once
+  ASSERT_LEVELDB_OK(
+      NewPersistentCache(env, path, 1 << 20, &options.persistent_cache));
+  Table* table;
+  ASSERT_LEVELDB_OK(Table::Open(options, &source, sink.contents().size(),
+                                "prefix", &table));
+  ASSERT_EQ(N, ReadAll(table, ReadOptions()));
+  schedule_env.RunScheduled();
+  delete table;
+  delete options.persistent_cache;
+
+  // A new table and cache find the blocks written by the old ones.
+  ASSERT_LEVELDB_OK(
+      NewPersistentCache(env, path, 1 << 20, &options.persistent_cache));
+  ASSERT_LEVELDB_OK(Table::Open(options, &source, sink.contents().size(),
+                                "prefix", &table));
+  int reads = source.reads();
+  ASSERT_EQ(N, ReadAll(table, ReadOptions()));
+  ASSERT_EQ(reads, source.reads());
+  schedule_env.RunScheduled();
+  delete table;
+
+  // Under another prefix they are read from the file.
+  ASSERT_LEVELDB_OK(Table::Open(options, &source, sink.contents().size(),
+                                "other", &table));
+  reads = source.reads();
+  ASSERT_EQ(N, ReadAll(table, ReadOptions()));
+  ASSERT_GT(source.reads(), reads);
+  schedule_env.RunScheduled();
+  delete table;
+
+  delete options.block_cache;
+  delete options.persistent_cache;
+}
+
+static std::string IKey(const std::string& user_key, SequenceNumber seq) {
+  std::string encoded;
+  AppendInternalKey(&encoded,
+                    ParsedInternalKey(user_key, seq, kValueTypeForSeek));
+  return encoded;
+}
+
+TEST(TableTest, DataBlockHashIndex) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  Options options;
+  options.comparator = &cmp;
+  options.block_restart_interval = 4;
+
+  // Even user keys only, with up to three versions each so that some
+  // keys span restart intervals.
+  BlockBuilder hashed_builder(&options, true);
+  BlockBuilder plain_builder(&options);
+  for (int i = 0; i < 200; i += 2) {
+    char user_key[10];
+    std::snprintf(user_key, sizeof(user_key), "k%03d", i);
+    for (int v = i % 3; v >= 0; v--) {
+      hashed_builder.Add(IKey(user_key, 100 + v), user_key);
+      plain_builder.Add(IKey(user_key, 100 + v), user_key);
+    }
+  }
+  const std::string hashed_data = hashed_builder.Finish().ToString();
+  const std::string plain_data = plain_builder.Finish().ToString();
+  ASSERT_GT(hashed_data.size(), plain_data.size());
+
+  BlockContents contents;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  contents.data = hashed_data;
+  Block hashed(contents);
+  contents.data = plain_data;
+  Block plain(contents);
+
+  // Iteration is unaffected by the index.
+  Iterator* hashed_iter = hashed.NewIterator(&cmp);
+  Iterator* plain_iter = plain.NewIterator(&cmp);
+  hashed_iter->SeekToFirst();
+  for (plain_iter->SeekToFirst(); plain_iter->Valid(); plain_iter->Next()) {
+    ASSERT_TRUE(hashed_iter->Valid());
+    ASSERT_EQ(plain_iter->key().ToString(), hashed_iter->key().ToString());
+    ASSERT_EQ(plain_iter->value().ToString(),
+              hashed_iter->value().ToString());
+    hashed_iter->Next();
+  }
+  ASSERT_TRUE(!hashed_iter->Valid());
+  delete hashed_iter;
+
+  // Point lookups find the same entry as Seek() whenever its user key
+  // matches the target.
+  for (int i = 0; i < 201; i++) {
+    char user_key[10];
+    std::snprintf(user_key, sizeof(user_key), "k%03d", i);
+    for (SequenceNumber seq : {SequenceNumber(99), SequenceNumber(100),
+                               SequenceNumber(101), kMaxSequenceNumber}) {
+      const std::string target = IKey(user_key, seq);
+      plain_iter->Seek(target);
+      const bool expected = plain_iter->Valid() &&
+                            ExtractUserKey(plain_iter->key()) == user_key;
+      Iterator* iter = hashed.NewIteratorForGet(&cmp, target);
+      const bool found =
+          iter->Valid() && ExtractUserKey(iter->key()) == user_key;
+      ASSERT_EQ(expected, found) << user_key << "@" << seq;
+      if (found) {
+        ASSERT_EQ(plain_iter->key().ToString(), iter->key().ToString());
+      }
+      ASSERT_LEVELDB_OK(iter->status());
+      delete iter;
+
+      // Blocks without an index fall back to Seek().
+      iter = plain.NewIteratorForGet(&cmp, target);
+      ASSERT_EQ(plain_iter->Valid(), iter->Valid());
+      delete iter;
+    }
+  }
+  delete plain_iter;
+}
+
 }  // namespace leveldb
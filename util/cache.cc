@@ -4,9 +4,12 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <new>
+#include <thread>
 
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -71,6 +74,8 @@ struct LRUHandle {
   size_t charge;  // TODO(opt): Only allow uint32_t?
   size_t key_length;
   bool in_cache;     // Whether entry is in the cache.
+  bool hit;          // Whether entry was looked up since it became old.
+  bool in_young;     // Whether entry is in the young part of lru_.
   uint32_t refs;     // References, including cache reference, if present.
   uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
   char key_data[1];  // Beginning of key
@@ -90,18 +95,21 @@ struct LRUHandle {
 // we have tested.  E.g., readrandom speeds up by ~5% over the g++
 // 4.4.3's builtin hashtable.
 //LevelDB实现了自己的简单Hash表。因为去除了移植性，所以速度更快。
+//
+// Handle is LRUHandle or ClockHandle.
+template <typename Handle>
 class HandleTable {
  public:
   HandleTable() : length_(0), elems_(0), list_(nullptr) { Resize(); }
   ~HandleTable() { delete[] list_; }
 
-  LRUHandle* Lookup(const Slice& key, uint32_t hash) {
+  Handle* Lookup(const Slice& key, uint32_t hash) {
     return *FindPointer(key, hash);
   }
 
-  LRUHandle* Insert(LRUHandle* h) {
-    LRUHandle** ptr = FindPointer(h->key(), h->hash);
-    LRUHandle* old = *ptr;
+  Handle* Insert(Handle* h) {
+    Handle** ptr = FindPointer(h->key(), h->hash);
+    Handle* old = *ptr;
     h->next_hash = (old == nullptr ? nullptr : old->next_hash);
     *ptr = h;
     if (old == nullptr) {
@@ -115,9 +123,9 @@ class HandleTable {
     return old;
   }
 
-  LRUHandle* Remove(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = FindPointer(key, hash);
-    LRUHandle* result = *ptr;
+  Handle* Remove(const Slice& key, uint32_t hash) {
+    Handle** ptr = FindPointer(key, hash);
+    Handle* result = *ptr;
     if (result != nullptr) {
       *ptr = result->next_hash;
       --elems_;
@@ -131,15 +139,15 @@ class HandleTable {
   // 这个表由一个存储桶数组组成，每个存储桶是一个散列到存储桶中的缓存条目的链表。
   uint32_t length_;   //存储桶的数量
   uint32_t elems_;    //当前哈希表的实际元素个数
-  LRUHandle** list_;  //桶数组。实际存储的数据内容，底层结构
+  Handle** list_;  //桶数组。实际存储的数据内容，底层结构
 
   // Return a pointer to slot that points to a cache entry that
   // matches key/hash.  If there is no such cache entry, return a
   // pointer to the trailing slot in the corresponding linked list.
   // 根据指定的key与hash，返回对应的双重指针。
   // (先根据Hash值与存储桶数目length_，找到list_中对应的桶，然后再根据hash与key寻找，避免hash冲突)
-  LRUHandle** FindPointer(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = &list_[hash & (length_ - 1)];
+  Handle** FindPointer(const Slice& key, uint32_t hash) {
+    Handle** ptr = &list_[hash & (length_ - 1)];
     while (*ptr != nullptr && ((*ptr)->hash != hash || key != (*ptr)->key())) {
       ptr = &(*ptr)->next_hash;
     }
@@ -161,15 +169,15 @@ class HandleTable {
     while (new_length < elems_) {
       new_length *= 2;
     }
-    LRUHandle** new_list = new LRUHandle*[new_length];
+    Handle** new_list = new Handle*[new_length];
     memset(new_list, 0, sizeof(new_list[0]) * new_length);
     uint32_t count = 0;
     for (uint32_t i = 0; i < length_; i++) {
-      LRUHandle* h = list_[i];
+      Handle* h = list_[i];
       while (h != nullptr) {
-        LRUHandle* next = h->next_hash;
+        Handle* next = h->next_hash;
         uint32_t hash = h->hash;
-        LRUHandle** ptr = &new_list[hash & (new_length - 1)];
+        Handle** ptr = &new_list[hash & (new_length - 1)];
         h->next_hash = *ptr;
         *ptr = h;
         h = next;
@@ -190,7 +198,13 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  //
+  // young_ratio of the capacity is reserved for entries that were looked
+  // up after they entered the LRU list (see NewLRUCache).
+  void SetCapacity(size_t capacity, double young_ratio = 0) {
+    capacity_ = capacity;
+    young_capacity_ = static_cast<size_t>(capacity * young_ratio);
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
@@ -208,6 +222,8 @@ class LRUCache {
  private:
   void LRU_Remove(LRUHandle* e);
   void LRU_Append(LRUHandle* list, LRUHandle* e);
+  // Put e, which is no longer in use, into lru_.
+  void LRU_Insert(LRUHandle* e);
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -215,6 +231,7 @@ class LRUCache {
   // Initialized before use.
   // 初始化的容量
   size_t capacity_;
+  size_t young_capacity_;  // 0 disables midpoint insertion
 
   // mutex_ protects the following state.
   // 锁,用来保护下列的状态
@@ -235,16 +252,30 @@ class LRUCache {
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
   // Entries have refs==1 and in_cache==true.
+  //
+  // If young_capacity_ > 0 the list is split at lru_old_, the newest "old"
+  // entry (or &lru_ if there is none).  Entries that return from in_use_
+  // are inserted at this midpoint, unless they were looked up since they
+  // last became old, in which case they become the newest "young" entry.
+  // Young entries beyond young_capacity_ are demoted to the midpoint.  A
+  // scan that reads each entry once thus only displaces old entries.
   LRUHandle lru_ GUARDED_BY(mutex_);
+  LRUHandle* lru_old_;   // Protected by mutex_
+  size_t young_usage_;  // Protected by mutex_
 
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
 
-  HandleTable table_ GUARDED_BY(mutex_);
+  HandleTable<LRUHandle> table_ GUARDED_BY(mutex_);
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0),
+      young_capacity_(0),
+      usage_(0),
+      lru_old_(&lru_),
+      young_usage_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
@@ -286,15 +317,47 @@ void LRUCache::Unref(LRUHandle* e) {
   } else if (e->in_cache && e->refs == 1) {
     // No longer in use; move to lru_ list.
     LRU_Remove(e);
-    LRU_Append(&lru_, e);
+    LRU_Insert(e);
   }
 }
 
 void LRUCache::LRU_Remove(LRUHandle* e) {
+  if (e == lru_old_) {
+    lru_old_ = e->prev;
+  }
+  if (e->in_young) {
+    e->in_young = false;
+    young_usage_ -= e->charge;
+  }
   e->next->prev = e->prev;
   e->prev->next = e->next;
 }
 
+void LRUCache::LRU_Insert(LRUHandle* e) {
+  if (young_capacity_ == 0) {
+    LRU_Append(&lru_, e);
+    return;
+  }
+  if (!e->hit) {
+    // Make "e" the newest old entry.
+    LRU_Append(lru_old_->next, e);
+    lru_old_ = e;
+    return;
+  }
+  LRU_Append(&lru_, e);
+  e->in_young = true;
+  young_usage_ += e->charge;
+  while (young_usage_ > young_capacity_) {
+    // Demote the oldest young entry; it must be hit again to return.
+    LRUHandle* old = lru_old_->next;
+    assert(old->in_young);
+    old->in_young = false;
+    old->hit = false;
+    young_usage_ -= old->charge;
+    lru_old_ = old;
+  }
+}
+
 void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
   // Make "e" newest entry by inserting just before *list
   e->next = list;
@@ -308,6 +371,7 @@ Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != nullptr) {
+    e->hit = true;
     Ref(e);
   }
   return reinterpret_cast<Cache::Handle*>(e);
@@ -333,6 +397,8 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->hit = false;
+  e->in_young = false;
   e->refs = 1;  // for the returned handle.
   std::memcpy(e->key_data, key.data(), key.size());
 
@@ -392,16 +458,327 @@ void LRUCache::Prune() {
   }
 }
 
-static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+// CLOCK cache implementation
+//
+// A ClockCache shard approximates LRU with the generalized CLOCK algorithm
+// so that Lookup() does not have to reorder a list.  A hit only takes the
+// shard's lock in shared mode, increments the entry's atomic reference
+// count and bumps its usage count (up to kMaxClockUsage); Release() just
+// decrements the reference count.  Concurrent hits on a shard therefore
+// do not exclude each other.
+//
+// The entries in the cache form a circular list that a clock hand sweeps
+// when Insert() needs room.  The hand skips entries that are in use,
+// decrements the usage count of entries that have one, and evicts the
+// first entry that is neither.  Entries that are hit often thus survive
+// several turns of the hand.
+
+// Upper bound on the usage count of a ClockHandle.
+static const uint32_t kMaxClockUsage = 3;
+
+struct ClockHandle {
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  ClockHandle* next_hash;
+  ClockHandle* next;
+  ClockHandle* prev;
+  size_t charge;
+  size_t key_length;
+  bool in_cache;                // Whether entry is in the cache.
+  std::atomic<uint32_t> usage;  // Bumped by Lookup(); decremented by the hand
+  std::atomic<uint32_t> refs;   // References, including cache reference.
+  uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
+  char key_data[1];  // Beginning of key
+
+  Slice key() const {
+    // next is only equal to this if the handle is the list head of an
+    // empty list. List heads never have meaningful keys.
+    assert(next != this);
+
+    return Slice(key_data, key_length);
+  }
+};
+
+// A reader-writer spin lock.  Readers only increment a shared counter.
+// Writers are serialized by a mutex and wait for the readers to drain.
+class SharedSpinLock {
+ public:
+  SharedSpinLock() : state_(0) {}
+
+  void ReadLock() {
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    while (true) {
+      if ((state & kWriter) != 0) {
+        std::this_thread::yield();
+        state = state_.load(std::memory_order_relaxed);
+      } else if (state_.compare_exchange_weak(state, state + 1,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed)) {
+        return;
+      }
+    }
+  }
+
+  void ReadUnlock() { state_.fetch_sub(1, std::memory_order_release); }
+
+  void WriteLock() {
+    writer_mutex_.Lock();
+    state_.fetch_or(kWriter, std::memory_order_acquire);
+    while (state_.load(std::memory_order_acquire) != kWriter) {
+      std::this_thread::yield();
+    }
+  }
+
+  void WriteUnlock() {
+    state_.store(0, std::memory_order_release);
+    writer_mutex_.Unlock();
+  }
+
+ private:
+  static constexpr uint32_t kWriter = 1u << 31;
+
+  port::Mutex writer_mutex_;
+  std::atomic<uint32_t> state_;  // kWriter | number of readers
+};
+
+class ReadLockGuard {
+ public:
+  explicit ReadLockGuard(SharedSpinLock* lock) : lock_(lock) {
+    lock_->ReadLock();
+  }
+  ReadLockGuard(const ReadLockGuard&) = delete;
+  ReadLockGuard& operator=(const ReadLockGuard&) = delete;
+  ~ReadLockGuard() { lock_->ReadUnlock(); }
+
+ private:
+  SharedSpinLock* const lock_;
+};
+
+class WriteLockGuard {
+ public:
+  explicit WriteLockGuard(SharedSpinLock* lock) : lock_(lock) {
+    lock_->WriteLock();
+  }
+  WriteLockGuard(const WriteLockGuard&) = delete;
+  WriteLockGuard& operator=(const WriteLockGuard&) = delete;
+  ~WriteLockGuard() { lock_->WriteUnlock(); }
+
+ private:
+  SharedSpinLock* const lock_;
+};
+
+// A single shard of a sharded CLOCK cache.
+class ClockCache {
+ public:
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of them.
+  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value));
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    ReadLockGuard l(&lock_);
+    return usage_;
+  }
+
+ private:
+  static void Unref(ClockHandle* e);
+
+  // Remove *e, which has already been removed from the hash table, from
+  // the clock list and drop the cache's reference.  Return whether
+  // e != nullptr.  REQUIRES: lock_ held in write mode.
+  bool FinishErase(ClockHandle* e);
+
+  // Evict one entry that is not in use.  Returns false if there is none.
+  // REQUIRES: lock_ held in write mode.
+  bool EvictOne();
+
+  // Initialized before use.
+  size_t capacity_;
+
+  // lock_ protects the following state.  Lookup() takes it in read mode;
+  // everything that changes the table or the clock list takes it in write
+  // mode.
+  mutable SharedSpinLock lock_;
+  size_t usage_;
+
+  // Dummy head of the circular list of entries in the cache.  hand_ is
+  // the next entry the clock hand looks at, or &clock_.
+  ClockHandle clock_;
+  ClockHandle* hand_;
+  size_t size_;  // Number of entries in the list
+
+  HandleTable<ClockHandle> table_;
+};
+
+ClockCache::ClockCache() : capacity_(0), usage_(0), hand_(&clock_), size_(0) {
+  clock_.next = &clock_;
+  clock_.prev = &clock_;
+}
+
+ClockCache::~ClockCache() {
+  for (ClockHandle* e = clock_.next; e != &clock_;) {
+    ClockHandle* next = e->next;
+    assert(e->in_cache);
+    // Error if caller has an unreleased handle
+    assert(e->refs.load(std::memory_order_relaxed) == 1);
+    e->in_cache = false;
+    Unref(e);
+    e = next;
+  }
+}
+
+void ClockCache::Unref(ClockHandle* e) {
+  if (e->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {  // Deallocate.
+    assert(!e->in_cache);
+    (*e->deleter)(e->key(), e->value);
+    e->~ClockHandle();
+    free(e);
+  }
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  ReadLockGuard l(&lock_);
+  ClockHandle* e = table_.Lookup(key, hash);
+  if (e != nullptr) {
+    // The cache's reference keeps e alive while the lock is held.
+    e->refs.fetch_add(1, std::memory_order_relaxed);
+    // Increments may be lost when hits race; the count is only a hint.
+    const uint32_t usage = e->usage.load(std::memory_order_relaxed);
+    if (usage < kMaxClockUsage) {
+      e->usage.store(usage + 1, std::memory_order_relaxed);
+    }
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+Cache::Handle* ClockCache::Insert(const Slice& key, uint32_t hash,
+                                  void* value, size_t charge,
+                                  void (*deleter)(const Slice& key,
+                                                  void* value)) {
+  void* mem = malloc(sizeof(ClockHandle) - 1 + key.size());
+  ClockHandle* e = new (mem) ClockHandle;
+  e->value = value;
+  e->deleter = deleter;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->hash = hash;
+  e->in_cache = false;
+  e->usage.store(0, std::memory_order_relaxed);
+  e->refs.store(1, std::memory_order_relaxed);  // for the returned handle.
+  std::memcpy(e->key_data, key.data(), key.size());
+
+  WriteLockGuard l(&lock_);
+  if (capacity_ > 0) {
+    e->refs.fetch_add(1, std::memory_order_relaxed);  // for the cache.
+    e->in_cache = true;
+    // Insert just behind the hand, so that the entry gets a full turn
+    // before the hand looks at it.
+    e->next = hand_;
+    e->prev = hand_->prev;
+    e->prev->next = e;
+    e->next->prev = e;
+    size_++;
+    usage_ += charge;
+    FinishErase(table_.Insert(e));
+  } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
+    // next is read by key() in an assert, so it must be initialized
+    e->next = nullptr;
+  }
+  while (usage_ > capacity_ && EvictOne()) {
+  }
+
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+bool ClockCache::EvictOne() {
+  // kMaxClockUsage turns clear every usage count, so an entry that is not
+  // in use is found by then if there is one.
+  for (size_t steps = 0; steps <= (kMaxClockUsage + 1) * size_; steps++) {
+    ClockHandle* e = hand_;
+    hand_ = hand_->next;
+    if (e == &clock_ || e->refs.load(std::memory_order_relaxed) > 1) {
+      continue;  // List head, or in use
+    }
+    const uint32_t usage = e->usage.load(std::memory_order_relaxed);
+    if (usage > 0) {
+      e->usage.store(usage - 1, std::memory_order_relaxed);
+      continue;
+    }
+    bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+    if (!erased) {  // to avoid unused variable when compiled NDEBUG
+      assert(erased);
+    }
+    return true;
+  }
+  return false;
+}
+
+bool ClockCache::FinishErase(ClockHandle* e) {
+  if (e != nullptr) {
+    assert(e->in_cache);
+    if (hand_ == e) {
+      hand_ = e->next;
+    }
+    e->next->prev = e->prev;
+    e->prev->next = e->next;
+    size_--;
+    e->in_cache = false;
+    usage_ -= e->charge;
+    Unref(e);
+  }
+  return e != nullptr;
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  WriteLockGuard l(&lock_);
+  FinishErase(table_.Remove(key, hash));
+}
+
+void ClockCache::Prune() {
+  WriteLockGuard l(&lock_);
+  for (ClockHandle* e = clock_.next; e != &clock_;) {
+    ClockHandle* next = e->next;
+    if (e->refs.load(std::memory_order_relaxed) == 1) {
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
+    }
+    e = next;
+  }
+}
+
+// Number of shards used by NewLRUCache(capacity).
+static const int kDefaultNumShardBits = 4;
+
+// Upper bound on num_shard_bits, to keep the shard array reasonable.
+static const int kMaxNumShardBits = 20;
 
-// 分片LRUCache
-// LevelDB 默认将 LRUCache 分为2^4块，取哈希值的高 4 位作为分片的位置。
+// 分片Cache
+// 取哈希值的高 num_shard_bits 位作为分片的位置。
 // 分片可以提高查询和插入的速度，减少锁的压力，是提高缓存性能的常用方法。
-class ShardedLRUCache : public Cache {
+//
+// Shard is LRUCache or ClockCache, and EntryHandle its entry type.  Extra
+// constructor arguments are passed on to Shard::SetCapacity().
+template <typename Shard, typename EntryHandle>
+class ShardedCache : public Cache {
  private:
-  //LRUCache的数组，包含2^4=16个LRUCache
-  LRUCache shard_[kNumShards];
+  // 2^num_shard_bits_ shards
+  Shard* const shards_;
+  const int num_shard_bits_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -410,58 +787,93 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  // 对hash值进行右移，仅保留高4位作为分片的位置
-  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+  // 对hash值进行右移，仅保留高 num_shard_bits_ 位作为分片的位置
+  Shard* ShardFor(uint32_t hash) {
+    return &shards_[num_shard_bits_ > 0 ? hash >> (32 - num_shard_bits_) : 0];
+  }
+
+  int NumShards() const { return 1 << num_shard_bits_; }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+  template <typename... ShardArgs>
+  ShardedCache(size_t capacity, int num_shard_bits, ShardArgs... shard_args)
+      : shards_(new Shard[size_t{1} << num_shard_bits]),
+        num_shard_bits_(num_shard_bits),
+        last_id_(0) {
+    const size_t per_shard = (capacity + (NumShards() - 1)) / NumShards();
+    for (int s = 0; s < NumShards(); s++) {
+      shards_[s].SetCapacity(per_shard, shard_args...);
     }
   }
-  ~ShardedLRUCache() override {}
+  ~ShardedCache() override { delete[] shards_; }
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return ShardFor(hash)->Insert(key, hash, value, charge, deleter);
   }
   Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Lookup(key, hash);
+    return ShardFor(hash)->Lookup(key, hash);
   }
   void Release(Handle* handle) override {
-    LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
-    shard_[Shard(h->hash)].Release(handle);
+    EntryHandle* h = reinterpret_cast<EntryHandle*>(handle);
+    ShardFor(h->hash)->Release(handle);
   }
   void Erase(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
-    shard_[Shard(hash)].Erase(key, hash);
+    ShardFor(hash)->Erase(key, hash);
   }
   void* Value(Handle* handle) override {
-    return reinterpret_cast<LRUHandle*>(handle)->value;
+    return reinterpret_cast<EntryHandle*>(handle)->value;
   }
   uint64_t NewId() override {
     MutexLock l(&id_mutex_);
     return ++(last_id_);
   }
   void Prune() override {
-    for (int s = 0; s < kNumShards; s++) {
-      shard_[s].Prune();
+    for (int s = 0; s < NumShards(); s++) {
+      shards_[s].Prune();
     }
   }
   size_t TotalCharge() const override {
     size_t total = 0;
-    for (int s = 0; s < kNumShards; s++) {
-      total += shard_[s].TotalCharge();
+    for (int s = 0; s < NumShards(); s++) {
+      total += shards_[s].TotalCharge();
     }
     return total;
   }
 };
 
+int CheckNumShardBits(int num_shard_bits) {
+  assert(num_shard_bits >= 0 && num_shard_bits <= kMaxNumShardBits);
+  if (num_shard_bits < 0) return 0;
+  if (num_shard_bits > kMaxNumShardBits) return kMaxNumShardBits;
+  return num_shard_bits;
+}
+
 }  // end anonymous namespace
 
-// NewLRUCache函数返回SharedLRUCache
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+// NewLRUCache函数返回分片的LRUCache
+Cache* NewLRUCache(size_t capacity) {
+  return NewLRUCache(capacity, kDefaultNumShardBits);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits) {
+  return NewLRUCache(capacity, num_shard_bits, 0);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits, double young_ratio) {
+  assert(young_ratio >= 0 && young_ratio < 1);
+  if (!(young_ratio > 0 && young_ratio < 1)) {
+    young_ratio = 0;
+  }
+  return new ShardedCache<LRUCache, LRUHandle>(
+      capacity, CheckNumShardBits(num_shard_bits), young_ratio);
+}
+
+Cache* NewClockCache(size_t capacity, int num_shard_bits) {
+  return new ShardedCache<ClockCache, ClockHandle>(
+      capacity, CheckNumShardBits(num_shard_bits));
+}
 
 }  // namespace leveldb
@@ -4,10 +4,13 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
 #include "util/coding.h"
+#include "util/random.h"
 
 namespace leveldb {
 
@@ -24,7 +27,31 @@ static int DecodeKey(const Slice& k) {
 static void* EncodeValue(uintptr_t v) { return reinterpret_cast<void*>(v); }
 static int DecodeValue(void* v) { return reinterpret_cast<uintptr_t>(v); }
 
-class CacheTest : public testing::Test {
+enum CacheType {
+  kLRU,
+  kSingleShardLRU,
+  kScanResistantLRU,
+  kClock,
+  kSingleShardClock
+};
+
+static Cache* NewTestCache(CacheType type, size_t capacity) {
+  switch (type) {
+    case kLRU:
+      return NewLRUCache(capacity);
+    case kSingleShardLRU:
+      return NewLRUCache(capacity, 0);
+    case kScanResistantLRU:
+      return NewLRUCache(capacity, 4, 0.5);
+    case kClock:
+      return NewClockCache(capacity, 4);
+    case kSingleShardClock:
+      return NewClockCache(capacity, 0);
+  }
+  return nullptr;
+}
+
+class CacheTest : public testing::TestWithParam<CacheType> {
  public:
   static void Deleter(const Slice& key, void* v) {
     current_->deleted_keys_.push_back(DecodeKey(key));
@@ -36,7 +63,9 @@ class CacheTest : public testing::Test {
   std::vector<int> deleted_values_;
   Cache* cache_;
 
-  CacheTest() : cache_(NewLRUCache(kCacheSize)) { current_ = this; }
+  CacheTest() : cache_(NewTestCache(GetParam(), kCacheSize)) {
+    current_ = this;
+  }
 
   ~CacheTest() { delete cache_; }
 
@@ -64,7 +93,7 @@ class CacheTest : public testing::Test {
 };
 CacheTest* CacheTest::current_;
 
-TEST_F(CacheTest, HitAndMiss) {
+TEST_P(CacheTest, HitAndMiss) {
   ASSERT_EQ(-1, Lookup(100));
 
   Insert(100, 101);
@@ -87,7 +116,7 @@ TEST_F(CacheTest, HitAndMiss) {
   ASSERT_EQ(101, deleted_values_[0]);
 }
 
-TEST_F(CacheTest, Erase) {
+TEST_P(CacheTest, Erase) {
   Erase(200);
   ASSERT_EQ(0, deleted_keys_.size());
 
@@ -106,7 +135,7 @@ TEST_F(CacheTest, Erase) {
   ASSERT_EQ(1, deleted_keys_.size());
 }
 
-TEST_F(CacheTest, EntriesArePinned) {
+TEST_P(CacheTest, EntriesArePinned) {
   Insert(100, 101);
   Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
   ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
@@ -131,7 +160,7 @@ TEST_F(CacheTest, EntriesArePinned) {
   ASSERT_EQ(102, deleted_values_[1]);
 }
 
-TEST_F(CacheTest, EvictionPolicy) {
+TEST_P(CacheTest, EvictionPolicy) {
   Insert(100, 101);
   Insert(200, 201);
   Insert(300, 301);
@@ -150,7 +179,7 @@ TEST_F(CacheTest, EvictionPolicy) {
   cache_->Release(h);
 }
 
-TEST_F(CacheTest, UseExceedsCacheSize) {
+TEST_P(CacheTest, UseExceedsCacheSize) {
   // Overfill the cache, keeping handles on all inserted entries.
   std::vector<Cache::Handle*> h;
   for (int i = 0; i < kCacheSize + 100; i++) {
@@ -167,7 +196,7 @@ TEST_F(CacheTest, UseExceedsCacheSize) {
   }
 }
 
-TEST_F(CacheTest, HeavyEntries) {
+TEST_P(CacheTest, HeavyEntries) {
   // Add a bunch of light and heavy entries and then count the combined
   // size of items still in the cache, which must be approximately the
   // same as the total capacity.
@@ -194,13 +223,13 @@ TEST_F(CacheTest, HeavyEntries) {
   ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
 }
 
-TEST_F(CacheTest, NewId) {
+TEST_P(CacheTest, NewId) {
   uint64_t a = cache_->NewId();
   uint64_t b = cache_->NewId();
   ASSERT_NE(a, b);
 }
 
-TEST_F(CacheTest, Prune) {
+TEST_P(CacheTest, Prune) {
   Insert(1, 100);
   Insert(2, 200);
 
@@ -213,12 +242,104 @@ TEST_F(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
-TEST_F(CacheTest, ZeroSizeCache) {
+TEST_P(CacheTest, ZeroSizeCache) {
   delete cache_;
-  cache_ = NewLRUCache(0);
+  cache_ = NewTestCache(GetParam(), 0);
 
   Insert(1, 100);
   ASSERT_EQ(-1, Lookup(1));
 }
 
+TEST_P(CacheTest, ConcurrentAccess) {
+  static std::atomic<int> inserted(0);
+  static std::atomic<int> deleted(0);
+  inserted.store(0);
+  deleted.store(0);
+  auto count_deleted = [](const Slice& key, void* v) { deleted.fetch_add(1); };
+
+  // More keys than fit, so that lookups, inserts and evictions mix.
+  static const int kNumThreads = 8;
+  static const int kNumKeys = 2 * kCacheSize;
+  std::vector<std::thread> threads;
+  std::vector<int> mismatches(kNumThreads, 0);  // Wrong values seen
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&, t]() {
+      Random rnd(301 + t);
+      for (int i = 0; i < 10000; i++) {
+        const int k = rnd.Uniform(kNumKeys);
+        Cache::Handle* h = cache_->Lookup(EncodeKey(k));
+        if (h == nullptr) {
+          h = cache_->Insert(EncodeKey(k), EncodeValue(k), 1, count_deleted);
+          inserted.fetch_add(1);
+        }
+        if (DecodeValue(cache_->Value(h)) != k) {
+          mismatches[t]++;
+        }
+        cache_->Release(h);
+      }
+    });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  for (int t = 0; t < kNumThreads; t++) {
+    ASSERT_EQ(0, mismatches[t]) << "thread " << t;
+  }
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + kCacheSize / 10);
+
+  delete cache_;
+  cache_ = nullptr;
+  ASSERT_EQ(inserted.load(), deleted.load());
+}
+
+INSTANTIATE_TEST_SUITE_P(AllCaches, CacheTest,
+                         testing::Values(kLRU, kSingleShardLRU,
+                                         kScanResistantLRU, kClock,
+                                         kSingleShardClock));
+
+static void DeleteNothing(const Slice& key, void* v) {}
+
+// Look up num_hot entries twice, then scan many entries once, in a
+// single-shard LRU cache with the given young_ratio.  Returns how many of
+// the hot entries are still cached.
+static int HotEntriesAfterScan(double young_ratio, int num_hot) {
+  static const int kCapacity = 100;
+  Cache* cache = NewLRUCache(kCapacity, 0, young_ratio);
+  auto insert = [cache](int k) {
+    cache->Release(
+        cache->Insert(EncodeKey(k), EncodeValue(k), 1, &DeleteNothing));
+  };
+  auto cached = [cache](int k) {
+    Cache::Handle* h = cache->Lookup(EncodeKey(k));
+    if (h == nullptr) return false;
+    cache->Release(h);
+    return true;
+  };
+
+  for (int k = 0; k < num_hot; k++) {
+    insert(k);
+  }
+  for (int k = 0; k < num_hot; k++) {
+    EXPECT_TRUE(cached(k));
+  }
+  for (int k = 1000; k < 1000 + 10 * kCapacity; k++) {
+    insert(k);
+  }
+  EXPECT_LE(cache->TotalCharge(), kCapacity);
+
+  int result = 0;
+  for (int k = 0; k < num_hot; k++) {
+    if (cached(k)) result++;
+  }
+  delete cache;
+  return result;
+}
+
+TEST(ScanResistantCacheTest, ScanKeepsYoungEntries) {
+  ASSERT_EQ(0, HotEntriesAfterScan(0, 40));  // Plain LRU
+  ASSERT_EQ(40, HotEntriesAfterScan(0.5, 40));
+  // Only the young part, half of the capacity, survives.
+  ASSERT_EQ(50, HotEntriesAfterScan(0.5, 80));
+}
+
 }  // namespace leveldb
@@ -17,6 +17,8 @@ namespace leveldb {
 
 Comparator::~Comparator() = default;
 
+Slice Comparator::HashIndexKey(const Slice&) const { return Slice(); }
+
 namespace {
 class BytewiseComparatorImpl : public Comparator {
  public:
@@ -28,6 +30,8 @@ class BytewiseComparatorImpl : public Comparator {
     return a.compare(b);
   }
 
+  Slice HashIndexKey(const Slice& key) const override { return key; }
+
   void FindShortestSeparator(std::string* start,
                              const Slice& limit) const override {
     // Find length of common prefix
@@ -230,4 +230,29 @@ TEST_F(EnvTest, ReopenAppendableFile) {
   env_->RemoveFile(test_file_name);
 }
 
+TEST_F(EnvTest, ReuseWritableFile) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string old_file_name = test_dir + "/reuse_writable_file_old.txt";
+  std::string test_file_name = test_dir + "/reuse_writable_file.txt";
+  env_->RemoveFile(test_file_name);
+
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, "hello world!", old_file_name));
+  WritableFile* writable_file;
+  ASSERT_LEVELDB_OK(
+      env_->ReuseWritableFile(test_file_name, old_file_name, &writable_file));
+  ASSERT_LEVELDB_OK(writable_file->Preallocate(1 << 20));
+  ASSERT_LEVELDB_OK(writable_file->Append("HE"));
+  ASSERT_LEVELDB_OK(writable_file->Close());
+  delete writable_file;
+
+  ASSERT_TRUE(!env_->FileExists(old_file_name));
+  std::string data;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, test_file_name, &data));
+  // Envs may either keep or truncate the old contents after the new ones.
+  ASSERT_EQ("HE", data.substr(0, 2));
+  ASSERT_TRUE(data == "HE" || data == "HEllo world!") << data;
+  env_->RemoveFile(test_file_name);
+}
+
 }  // namespace leveldb
@@ -0,0 +1,504 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+PersistentCache::~PersistentCache() = default;
+
+namespace {
+
+// Entries are appended to segments, which are written to files named
+// <path>/<number>.cache.  A segment file holds
+//    records: record[n]
+//    index: entry[n]
+//    index checksum: fixed32  // masked crc32c of the index
+//    index offset: fixed32
+//    magic: fixed64
+// where
+//    record := checksum: fixed32  // masked crc32c of the rest of the record
+//              key size: varint32
+//              value size: varint32
+//              key: char[key size]
+//              value: char[value size]
+//    entry := key: varint32 size followed by the key bytes
+//             offset of the record: varint32
+//             size of the record: varint32
+// The index lets the cache recover its entries without reading the
+// records.  A file without a valid trailer is discarded.
+//
+// The newest segment is filled in memory and handed to a background
+// thread once full, so Insert() never waits for the device.  When the
+// segments outgrow the capacity, the oldest one is dropped as a whole.
+
+// Upper bound on the records in a segment.  Larger records are not cached.
+constexpr size_t kMaxSegmentSize = 4 << 20;
+
+// Full segments that may wait for the background thread before Insert()
+// starts dropping entries.
+constexpr size_t kMaxUnwrittenSegments = 2;
+
+constexpr size_t kTrailerSize = 16;
+constexpr uint64_t kSegmentMagic = 0x6c76c7d4a0f1e35bull;
+
+struct Segment {
+  explicit Segment(uint64_t number)
+      : number(number), file(nullptr), size(0), refs(1), dropped(false) {}
+
+  Segment(const Segment&) = delete;
+  Segment& operator=(const Segment&) = delete;
+
+  ~Segment() { delete file; }
+
+  const uint64_t number;
+  std::string buffer;             // Records not yet written to the file
+  RandomAccessFile* file;         // Non-null once the records are written
+  size_t size;                    // Bytes of records
+  std::vector<std::string> keys;  // Keys of the records
+  int refs;
+  bool dropped;  // The file is removed when the last reference is gone
+};
+
+// Decode the record at the start of "input" and store its key, value and
+// size.  Returns false if the record is truncated or corrupt.
+bool DecodeRecord(const Slice& input, Slice* key, Slice* value,
+                  size_t* size) {
+  if (input.size() < 4) {
+    return false;
+  }
+  Slice rest(input.data() + 4, input.size() - 4);
+  uint32_t key_size, value_size;
+  if (!GetVarint32(&rest, &key_size) || !GetVarint32(&rest, &value_size) ||
+      rest.size() < static_cast<uint64_t>(key_size) + value_size) {
+    return false;
+  }
+  *size = (rest.data() - input.data()) + key_size + value_size;
+  const uint32_t crc = crc32c::Unmask(DecodeFixed32(input.data()));
+  if (crc != crc32c::Value(input.data() + 4, *size - 4)) {
+    return false;
+  }
+  *key = Slice(rest.data(), key_size);
+  *value = Slice(rest.data() + key_size, value_size);
+  return true;
+}
+
+class FileCache : public PersistentCache {
+ public:
+  FileCache(Env* env, const std::string& path, uint64_t capacity)
+      : env_(env),
+        path_(path),
+        capacity_(capacity),
+        segment_size_(std::min<uint64_t>(capacity / 8, kMaxSegmentSize)),
+        lock_(nullptr),
+        background_done_(&mutex_),
+        background_scheduled_(false),
+        writing_(nullptr),
+        next_number_(1),
+        usage_(0),
+        active_(nullptr) {}
+
+  ~FileCache() override;
+
+  // Lock the directory and recover the segments found there.
+  Status Open();
+
+  void Insert(const Slice& key, const Slice& value) override;
+  bool Lookup(const Slice& key, std::string* value) override;
+
+ private:
+  struct Location {
+    Segment* segment;
+    uint32_t offset;  // Offset of the record in the segment
+    uint32_t size;    // Size of the record
+  };
+
+  std::string SegmentFileName(uint64_t number) const {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "/%06llu.cache",
+                  static_cast<unsigned long long>(number));
+    return path_ + buf;
+  }
+
+  // Read the index of the segment file "number" and add its entries.
+  Status RecoverSegment(uint64_t number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void AddEntry(Segment* segment, const Slice& key, uint32_t offset,
+                uint32_t size) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void DropSegment(Segment* segment) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void Unref(Segment* segment) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void MaybeScheduleWrite() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGWork(void* cache);
+  void WriteSegments() LOCKS_EXCLUDED(mutex_);
+
+  // Write the records of "segment" and their index to its file, and open
+  // the file for reading.  Reads segment->buffer without holding mutex_:
+  // the buffer of a full segment does not change until it is written.
+  Status WriteSegment(Segment* segment, RandomAccessFile** file);
+
+  Env* const env_;
+  const std::string path_;
+  const uint64_t capacity_;
+  const size_t segment_size_;
+  FileLock* lock_;
+
+  port::Mutex mutex_;
+  port::CondVar background_done_ GUARDED_BY(mutex_);
+  bool background_scheduled_ GUARDED_BY(mutex_);
+  Segment* writing_ GUARDED_BY(mutex_);  // Being written by WriteSegments()
+  uint64_t next_number_ GUARDED_BY(mutex_);
+  uint64_t usage_ GUARDED_BY(mutex_);  // Bytes of records in segments_
+
+  // All segments, oldest first.  Each holds a reference.
+  std::deque<Segment*> segments_ GUARDED_BY(mutex_);
+  Segment* active_ GUARDED_BY(mutex_);  // Segment being filled, if any
+  std::deque<Segment*> unwritten_ GUARDED_BY(mutex_);  // Full, in memory
+  std::unordered_map<std::string, Location> index_ GUARDED_BY(mutex_);
+};
+
+FileCache::~FileCache() {
+  mutex_.Lock();
+  while (background_scheduled_) {
+    background_done_.Wait();
+  }
+  if (active_ != nullptr) {
+    unwritten_.push_back(active_);
+    active_ = nullptr;
+  }
+  mutex_.Unlock();
+
+  WriteSegments();
+
+  mutex_.Lock();
+  index_.clear();
+  for (Segment* segment : segments_) {
+    Unref(segment);
+  }
+  segments_.clear();
+  mutex_.Unlock();
+  if (lock_ != nullptr) {
+    env_->UnlockFile(lock_);
+  }
+}
+
+Status FileCache::Open() {
+  env_->CreateDir(path_);  // Ignore error: the directory may exist
+  Status s = env_->LockFile(path_ + "/LOCK", &lock_);
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<std::string> filenames;
+  s = env_->GetChildren(path_, &filenames);
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<uint64_t> numbers;
+  for (const std::string& filename : filenames) {
+    Slice rest(filename);
+    uint64_t number;
+    if (ConsumeDecimalNumber(&rest, &number) && rest == Slice(".cache")) {
+      numbers.push_back(number);
+    }
+  }
+  std::sort(numbers.begin(), numbers.end());
+
+  MutexLock l(&mutex_);
+  for (uint64_t number : numbers) {
+    if (!RecoverSegment(number).ok()) {
+      env_->RemoveFile(SegmentFileName(number));
+    }
+    next_number_ = number + 1;
+  }
+  while (usage_ > capacity_) {
+    DropSegment(segments_.front());
+  }
+  return Status::OK();
+}
+
+Status FileCache::RecoverSegment(uint64_t number) {
+  const std::string fname = SegmentFileName(number);
+  uint64_t file_size;
+  Status s = env_->GetFileSize(fname, &file_size);
+  if (s.ok() && file_size < kTrailerSize) {
+    s = Status::Corruption(fname, "truncated cache segment");
+  }
+  RandomAccessFile* file = nullptr;
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &file);
+  }
+  char trailer[kTrailerSize];
+  Slice input;
+  if (s.ok()) {
+    s = file->Read(file_size - kTrailerSize, kTrailerSize, &input, trailer);
+  }
+  uint32_t index_offset = 0;
+  if (s.ok()) {
+    index_offset = DecodeFixed32(input.data() + 4);
+    if (input.size() != kTrailerSize ||
+        DecodeFixed64(input.data() + 8) != kSegmentMagic ||
+        index_offset > file_size - kTrailerSize) {
+      s = Status::Corruption(fname, "bad cache segment trailer");
+    }
+  }
+  std::string scratch;
+  if (s.ok()) {
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(input.data()));
+    scratch.resize(file_size - kTrailerSize - index_offset);
+    s = file->Read(index_offset, scratch.size(), &input, &scratch[0]);
+    if (s.ok() && (input.size() != scratch.size() ||
+                   crc != crc32c::Value(input.data(), input.size()))) {
+      s = Status::Corruption(fname, "bad cache segment index");
+    }
+  }
+  if (!s.ok()) {
+    delete file;
+    return s;
+  }
+
+  Segment* segment = new Segment(number);
+  segment->file = file;
+  segment->size = index_offset;
+  segments_.push_back(segment);
+  usage_ += segment->size;
+  Slice key;
+  uint32_t offset, size;
+  while (GetLengthPrefixedSlice(&input, &key) &&
+         GetVarint32(&input, &offset) && GetVarint32(&input, &size)) {
+    if (offset <= index_offset && size <= index_offset - offset) {
+      AddEntry(segment, key, offset, size);
+    }
+  }
+  return Status::OK();
+}
+
+void FileCache::AddEntry(Segment* segment, const Slice& key, uint32_t offset,
+                         uint32_t size) {
+  Location& location = index_[key.ToString()];
+  location.segment = segment;
+  location.offset = offset;
+  location.size = size;
+  segment->keys.push_back(key.ToString());
+}
+
+void FileCache::DropSegment(Segment* segment) {
+  segments_.erase(std::find(segments_.begin(), segments_.end(), segment));
+  for (const std::string& key : segment->keys) {
+    auto iter = index_.find(key);
+    if (iter != index_.end() && iter->second.segment == segment) {
+      index_.erase(iter);
+    }
+  }
+  segment->keys.clear();
+  usage_ -= segment->size;
+  segment->dropped = true;
+  if (segment == active_) {
+    active_ = nullptr;
+  } else if (segment != writing_) {
+    auto iter = std::find(unwritten_.begin(), unwritten_.end(), segment);
+    if (iter != unwritten_.end()) {
+      unwritten_.erase(iter);
+    }
+  }
+  Unref(segment);
+}
+
+void FileCache::Unref(Segment* segment) {
+  assert(segment->refs > 0);
+  if (--segment->refs == 0) {
+    if (segment->dropped && segment->file != nullptr) {
+      delete segment->file;
+      segment->file = nullptr;
+      env_->RemoveFile(SegmentFileName(segment->number));
+    }
+    delete segment;
+  }
+}
+
+void FileCache::Insert(const Slice& key, const Slice& value) {
+  const size_t record_size = 4 + VarintLength(key.size()) +
+                             VarintLength(value.size()) + key.size() +
+                             value.size();
+  if (record_size > segment_size_) {
+    return;
+  }
+  std::string key_string = key.ToString();
+  MutexLock l(&mutex_);
+  if (index_.find(key_string) != index_.end()) {
+    return;
+  }
+  if (active_ != nullptr && active_->size + record_size > segment_size_) {
+    if (unwritten_.size() >= kMaxUnwrittenSegments) {
+      return;  // The device is falling behind
+    }
+    unwritten_.push_back(active_);
+    active_ = nullptr;
+    MaybeScheduleWrite();
+  }
+  if (active_ == nullptr) {
+    active_ = new Segment(next_number_++);
+    segments_.push_back(active_);
+  }
+
+  std::string* buffer = &active_->buffer;
+  const size_t offset = buffer->size();
+  buffer->resize(offset + 4);
+  PutVarint32(buffer, key.size());
+  PutVarint32(buffer, value.size());
+  buffer->append(key.data(), key.size());
+  buffer->append(value.data(), value.size());
+  EncodeFixed32(&(*buffer)[offset],
+                crc32c::Mask(crc32c::Value(buffer->data() + offset + 4,
+                                           record_size - 4)));
+  active_->size = buffer->size();
+  usage_ += record_size;
+  AddEntry(active_, key_string, offset, record_size);
+
+  while (usage_ > capacity_ && segments_.front() != active_) {
+    DropSegment(segments_.front());
+  }
+}
+
+bool FileCache::Lookup(const Slice& key, std::string* value) {
+  MutexLock l(&mutex_);
+  auto iter = index_.find(key.ToString());
+  if (iter == index_.end()) {
+    return false;
+  }
+  const Location location = iter->second;
+  Segment* segment = location.segment;
+  Slice record_key, record_value;
+  size_t size;
+  if (segment->file == nullptr) {
+    Slice record(segment->buffer.data() + location.offset, location.size);
+    if (!DecodeRecord(record, &record_key, &record_value, &size)) {
+      return false;
+    }
+    value->assign(record_value.data(), record_value.size());
+    return true;
+  }
+
+  // Read the file without holding mutex_.
+  segment->refs++;
+  mutex_.Unlock();
+  std::string scratch(location.size, '\0');
+  Slice record;
+  const bool found =
+      segment->file->Read(location.offset, location.size, &record, &scratch[0])
+          .ok() &&
+      DecodeRecord(record, &record_key, &record_value, &size) &&
+      size == location.size && record_key == key;
+  if (found) {
+    value->assign(record_value.data(), record_value.size());
+  }
+  mutex_.Lock();
+  Unref(segment);
+  return found;
+}
+
+void FileCache::MaybeScheduleWrite() {
+  if (!background_scheduled_ && !unwritten_.empty()) {
+    background_scheduled_ = true;
+    env_->Schedule(&FileCache::BGWork, this);
+  }
+}
+
+void FileCache::BGWork(void* cache) {
+  FileCache* file_cache = reinterpret_cast<FileCache*>(cache);
+  file_cache->WriteSegments();
+  MutexLock l(&file_cache->mutex_);
+  file_cache->background_scheduled_ = false;
+  file_cache->background_done_.SignalAll();
+}
+
+void FileCache::WriteSegments() {
+  MutexLock l(&mutex_);
+  while (!unwritten_.empty()) {
+    Segment* segment = unwritten_.front();
+    segment->refs++;
+    writing_ = segment;
+    mutex_.Unlock();
+    RandomAccessFile* file = nullptr;
+    Status s = WriteSegment(segment, &file);
+    mutex_.Lock();
+    writing_ = nullptr;
+    unwritten_.pop_front();
+    if (s.ok()) {
+      segment->file = file;
+      std::string().swap(segment->buffer);
+    } else if (!segment->dropped) {
+      DropSegment(segment);
+    }
+    Unref(segment);
+  }
+}
+
+Status FileCache::WriteSegment(Segment* segment, RandomAccessFile** file) {
+  const std::string& records = segment->buffer;
+  std::string index;
+  Slice input(records);
+  Slice key, value;
+  size_t size;
+  while (DecodeRecord(input, &key, &value, &size)) {
+    PutLengthPrefixedSlice(&index, key);
+    PutVarint32(&index, input.data() - records.data());
+    PutVarint32(&index, size);
+    input.remove_prefix(size);
+  }
+  PutFixed32(&index, crc32c::Mask(crc32c::Value(index.data(), index.size())));
+  PutFixed32(&index, records.size());
+  PutFixed64(&index, kSegmentMagic);
+
+  const std::string fname = SegmentFileName(segment->number);
+  WritableFile* out;
+  Status s = env_->NewWritableFile(fname, &out);
+  if (s.ok()) {
+    s = out->Append(records);
+    if (s.ok()) {
+      s = out->Append(index);
+    }
+    if (s.ok()) {
+      s = out->Close();
+    }
+    delete out;
+  }
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, file);
+  }
+  if (!s.ok()) {
+    env_->RemoveFile(fname);
+  }
+  return s;
+}
+
+}  // namespace
+
+Status NewPersistentCache(Env* env, const std::string& path,
+                          uint64_t capacity, PersistentCache** cache) {
+  *cache = nullptr;
+  FileCache* file_cache = new FileCache(env, path, capacity);
+  Status s = file_cache->Open();
+  if (s.ok()) {
+    *cache = file_cache;
+  } else {
+    delete file_cache;
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,166 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+#include "util/coding.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  std::string result;
+  PutFixed32(&result, i);
+  return result;
+}
+
+static std::string Value(int i) { return std::string(1000, 'a' + (i % 26)); }
+
+class PersistentCacheTest : public testing::Test {
+ public:
+  PersistentCacheTest()
+      : env_(Env::Default()),
+        path_(testing::TempDir() + "persistent_cache_test"),
+        cache_(nullptr) {
+    DestroyFiles();
+  }
+
+  ~PersistentCacheTest() {
+    delete cache_;
+    DestroyFiles();
+  }
+
+  Status Open(uint64_t capacity) {
+    delete cache_;
+    cache_ = nullptr;
+    return NewPersistentCache(env_, path_, capacity, &cache_);
+  }
+
+  // Insert entry i, retrying while the cache drops it because the
+  // background thread has not caught up with its writes.
+  void Insert(int i) {
+    cache_->Insert(Key(i), Value(i));
+    while (Lookup(i) == "NOT_FOUND") {
+      env_->SleepForMicroseconds(1000);
+      cache_->Insert(Key(i), Value(i));
+    }
+  }
+
+  std::string Lookup(int i) {
+    std::string value;
+    return cache_->Lookup(Key(i), &value) ? value : "NOT_FOUND";
+  }
+
+  // Number of segment files in the directory.
+  int CountSegments() {
+    std::vector<std::string> filenames;
+    env_->GetChildren(path_, &filenames);
+    int count = 0;
+    for (const std::string& filename : filenames) {
+      if (filename.size() > 6 &&
+          filename.compare(filename.size() - 6, 6, ".cache") == 0) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  void DestroyFiles() {
+    std::vector<std::string> filenames;
+    env_->GetChildren(path_, &filenames);
+    for (const std::string& filename : filenames) {
+      env_->RemoveFile(path_ + "/" + filename);
+    }
+    env_->RemoveDir(path_);
+  }
+
+  Env* const env_;
+  const std::string path_;
+  PersistentCache* cache_;
+};
+
+TEST_F(PersistentCacheTest, InsertAndLookup) {
+  ASSERT_LEVELDB_OK(Open(1 << 20));
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  cache_->Insert(Key(1), Value(1));
+  cache_->Insert(Key(2), Value(2));
+  ASSERT_EQ(Value(1), Lookup(1));
+  ASSERT_EQ(Value(2), Lookup(2));
+  ASSERT_EQ("NOT_FOUND", Lookup(3));
+
+  // Keys that are present are not replaced.
+  cache_->Insert(Key(1), Value(3));
+  ASSERT_EQ(Value(1), Lookup(1));
+}
+
+TEST_F(PersistentCacheTest, SurvivesReopen) {
+  const int N = 1000;
+  ASSERT_LEVELDB_OK(Open(4 << 20));
+  for (int i = 0; i < N; i++) {
+    Insert(i);
+  }
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Value(i), Lookup(i)) << i;
+  }
+
+  ASSERT_LEVELDB_OK(Open(4 << 20));
+  ASSERT_GT(CountSegments(), 1);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Value(i), Lookup(i)) << i;
+  }
+  Insert(N);
+  ASSERT_EQ(Value(N), Lookup(N));
+}
+
+TEST_F(PersistentCacheTest, Eviction) {
+  const int N = 2000;
+  ASSERT_LEVELDB_OK(Open(400 << 10));
+  for (int i = 0; i < N; i++) {
+    Insert(i);
+  }
+  // The oldest entries are gone and the newest are kept.
+  ASSERT_EQ("NOT_FOUND", Lookup(0));
+  ASSERT_EQ(Value(N - 1), Lookup(N - 1));
+  int found = 0;
+  for (int i = 0; i < N; i++) {
+    if (Lookup(i) != "NOT_FOUND") {
+      found++;
+    }
+  }
+  ASSERT_LE(found, 400);
+  ASSERT_GE(found, 300);
+
+  // Reopening with a smaller capacity drops more segments.
+  ASSERT_LEVELDB_OK(Open(100 << 10));
+  ASSERT_LE(CountSegments(), 8);
+  ASSERT_EQ(Value(N - 1), Lookup(N - 1));
+  ASSERT_EQ("NOT_FOUND", Lookup(N / 2));
+}
+
+TEST_F(PersistentCacheTest, CorruptSegmentIsDiscarded) {
+  ASSERT_LEVELDB_OK(Open(1 << 20));
+  cache_->Insert(Key(1), Value(1));
+  delete cache_;
+  cache_ = nullptr;
+  ASSERT_LEVELDB_OK(
+      WriteStringToFile(env_, "garbage", path_ + "/000100.cache"));
+
+  ASSERT_LEVELDB_OK(Open(1 << 20));
+  ASSERT_EQ(Value(1), Lookup(1));
+  ASSERT_FALSE(env_->FileExists(path_ + "/000100.cache"));
+}
+
+TEST_F(PersistentCacheTest, DirectoryIsLocked) {
+  ASSERT_LEVELDB_OK(Open(1 << 20));
+  PersistentCache* other;
+  ASSERT_TRUE(!NewPersistentCache(env_, path_, 1 << 20, &other).ok());
+  ASSERT_EQ(nullptr, other);
+}
+
+}  // namespace leveldb
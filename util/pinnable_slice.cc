@@ -0,0 +1,75 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/pinnable_slice.h"
+
+#include <cassert>
+
+namespace leveldb {
+
+PinnableSlice::PinnableSlice() : PinnableSlice(nullptr) {}
+
+PinnableSlice::PinnableSlice(std::string* buf)
+    : buf_(buf != nullptr ? buf : &self_space_), pinned_(false) {
+  cleanup_head_.function = nullptr;
+  cleanup_head_.next = nullptr;
+}
+
+PinnableSlice::~PinnableSlice() { ReleasePinned(); }
+
+void PinnableSlice::ReleasePinned() {
+  if (cleanup_head_.function != nullptr) {
+    (*cleanup_head_.function)(cleanup_head_.arg1, cleanup_head_.arg2);
+    for (CleanupNode* node = cleanup_head_.next; node != nullptr;) {
+      (*node->function)(node->arg1, node->arg2);
+      CleanupNode* next_node = node->next;
+      delete node;
+      node = next_node;
+    }
+    cleanup_head_.function = nullptr;
+    cleanup_head_.next = nullptr;
+  }
+  pinned_ = false;
+}
+
+void PinnableSlice::PinSlice(const Slice& s) {
+  ReleasePinned();
+  Slice::operator=(s);
+  pinned_ = true;
+}
+
+void PinnableSlice::PinSelf(const Slice& s) {
+  buf_->assign(s.data(), s.size());
+  PinSelf();
+}
+
+void PinnableSlice::PinSelf() {
+  ReleasePinned();
+  Slice::operator=(*buf_);
+}
+
+void PinnableSlice::Reset() {
+  ReleasePinned();
+  buf_->clear();
+  Slice::operator=(Slice());
+}
+
+void PinnableSlice::RegisterCleanup(CleanupFunction func, void* arg1,
+                                    void* arg2) {
+  assert(func != nullptr);
+  assert(pinned_);
+  CleanupNode* node;
+  if (cleanup_head_.function == nullptr) {
+    node = &cleanup_head_;
+  } else {
+    node = new CleanupNode();
+    node->next = cleanup_head_.next;
+    cleanup_head_.next = node;
+  }
+  node->function = func;
+  node->arg1 = arg1;
+  node->arg2 = arg2;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,175 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <atomic>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+#include "util/no_destructor.h"
+
+namespace leveldb {
+
+namespace {
+
+struct Entry {
+  Entry() : ptr(nullptr) {}
+  Entry(const Entry& e) : ptr(e.ptr.load(std::memory_order_relaxed)) {}
+
+  std::atomic<void*> ptr;
+};
+
+// The slots of one thread, indexed by ThreadLocalPtr id.  Threads are
+// kept in a circular doubly-linked list so that Scrape() can visit them.
+struct ThreadData {
+  std::vector<Entry> entries;
+  ThreadData* next;
+  ThreadData* prev;
+};
+
+thread_local ThreadData* tls_data = nullptr;
+
+}  // namespace
+
+class ThreadLocalPtr::StaticMeta {
+ public:
+  StaticMeta() : next_id_(0) { head_.next = head_.prev = &head_; }
+
+  uint32_t AcquireId(UnrefHandler handler) LOCKS_EXCLUDED(mutex_) {
+    MutexLock l(&mutex_);
+    uint32_t id;
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+    } else {
+      id = next_id_++;
+      handlers_.resize(next_id_);
+    }
+    handlers_[id] = handler;
+    return id;
+  }
+
+  void ReclaimId(uint32_t id) LOCKS_EXCLUDED(mutex_) {
+    MutexLock l(&mutex_);
+    for (ThreadData* t = head_.next; t != &head_; t = t->next) {
+      if (id < t->entries.size()) {
+        t->entries[id].ptr.store(nullptr, std::memory_order_relaxed);
+      }
+    }
+    handlers_[id] = nullptr;
+    free_ids_.push_back(id);
+  }
+
+  // Return the calling thread's slot for "id".
+  std::atomic<void*>* Slot(uint32_t id) {
+    ThreadData* data = tls_data;
+    if (data == nullptr || id >= data->entries.size()) {
+      data = Grow(id);
+    }
+    return &data->entries[id].ptr;
+  }
+
+  void Scrape(uint32_t id, std::vector<void*>* ptrs, void* replacement)
+      LOCKS_EXCLUDED(mutex_) {
+    MutexLock l(&mutex_);
+    for (ThreadData* t = head_.next; t != &head_; t = t->next) {
+      if (id < t->entries.size()) {
+        void* ptr =
+            t->entries[id].ptr.exchange(replacement, std::memory_order_acq_rel);
+        if (ptr != nullptr) {
+          ptrs->push_back(ptr);
+        }
+      }
+    }
+  }
+
+  void OnThreadExit(ThreadData* data) LOCKS_EXCLUDED(mutex_) {
+    // The handlers run with mutex_ held so that they cannot race with
+    // the owner of the pointers calling Scrape() or ~ThreadLocalPtr().
+    MutexLock l(&mutex_);
+    data->prev->next = data->next;
+    data->next->prev = data->prev;
+    for (size_t id = 0; id < data->entries.size(); id++) {
+      void* ptr = data->entries[id].ptr.load(std::memory_order_relaxed);
+      if (ptr != nullptr && handlers_[id] != nullptr) {
+        (*handlers_[id])(ptr);
+      }
+    }
+    delete data;
+  }
+
+ private:
+  // Destroyed when a thread that has used a ThreadLocalPtr exits.
+  struct ThreadExitHook {
+    ~ThreadExitHook() {
+      if (tls_data != nullptr) {
+        ThreadData* data = tls_data;
+        tls_data = nullptr;
+        Instance()->OnThreadExit(data);
+      }
+    }
+  };
+
+  // Register the calling thread if needed and make room for slot "id".
+  ThreadData* Grow(uint32_t id) LOCKS_EXCLUDED(mutex_) {
+    static thread_local ThreadExitHook hook;
+    (void)hook;
+
+    MutexLock l(&mutex_);
+    if (tls_data == nullptr) {
+      tls_data = new ThreadData;
+      tls_data->next = &head_;
+      tls_data->prev = head_.prev;
+      head_.prev->next = tls_data;
+      head_.prev = tls_data;
+    }
+    if (id >= tls_data->entries.size()) {
+      // Scrape() may read the entries of other threads, so they are only
+      // resized with mutex_ held.
+      tls_data->entries.resize(id + 1);
+    }
+    return tls_data;
+  }
+
+  port::Mutex mutex_;
+  ThreadData head_ GUARDED_BY(mutex_);  // Dummy head of the thread list
+  uint32_t next_id_ GUARDED_BY(mutex_);
+  std::vector<uint32_t> free_ids_ GUARDED_BY(mutex_);
+  std::vector<UnrefHandler> handlers_ GUARDED_BY(mutex_);  // Indexed by id
+};
+
+ThreadLocalPtr::StaticMeta* ThreadLocalPtr::Instance() {
+  static NoDestructor<StaticMeta> instance;
+  return instance.get();
+}
+
+ThreadLocalPtr::ThreadLocalPtr(UnrefHandler handler)
+    : id_(Instance()->AcquireId(handler)) {}
+
+ThreadLocalPtr::~ThreadLocalPtr() { Instance()->ReclaimId(id_); }
+
+void* ThreadLocalPtr::Get() const {
+  return Instance()->Slot(id_)->load(std::memory_order_acquire);
+}
+
+void ThreadLocalPtr::Reset(void* ptr) {
+  Instance()->Slot(id_)->store(ptr, std::memory_order_release);
+}
+
+void* ThreadLocalPtr::Swap(void* ptr) {
+  return Instance()->Slot(id_)->exchange(ptr, std::memory_order_acq_rel);
+}
+
+bool ThreadLocalPtr::CompareAndSwap(void* ptr, void*& expected) {
+  return Instance()->Slot(id_)->compare_exchange_strong(
+      expected, ptr, std::memory_order_acq_rel, std::memory_order_acquire);
+}
+
+void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement) {
+  Instance()->Scrape(id_, ptrs, replacement);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,62 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace leveldb {
+
+// A ThreadLocalPtr holds one pointer per thread.  Unlike a thread_local
+// variable it can be a non-static class member, so that every instance
+// of the owning class gets its own per-thread slots.  The owner can also
+// collect and replace the pointers of all threads with Scrape(), which
+// lets it invalidate per-thread caches.
+//
+// Get(), Reset(), Swap() and CompareAndSwap() only touch the calling
+// thread's slot and take no lock.  Every pointer starts out as nullptr.
+class ThreadLocalPtr {
+ public:
+  // Called with a thread's non-null pointer when that thread exits.
+  using UnrefHandler = void (*)(void* ptr);
+
+  explicit ThreadLocalPtr(UnrefHandler handler = nullptr);
+
+  ThreadLocalPtr(const ThreadLocalPtr&) = delete;
+  ThreadLocalPtr& operator=(const ThreadLocalPtr&) = delete;
+
+  // The pointers still stored are dropped without calling the handler.
+  ~ThreadLocalPtr();
+
+  // Return the calling thread's pointer.
+  void* Get() const;
+
+  // Set the calling thread's pointer to "ptr".
+  void Reset(void* ptr);
+
+  // Set the calling thread's pointer to "ptr" and return its old value.
+  void* Swap(void* ptr);
+
+  // If the calling thread's pointer equals "expected", set it to "ptr" and
+  // return true.  Otherwise store its current value in "expected" and
+  // return false.
+  bool CompareAndSwap(void* ptr, void*& expected);
+
+  // Replace the pointer of every thread that has stored one with
+  // "replacement" and append the previous non-null values to *ptrs.
+  void Scrape(std::vector<void*>* ptrs, void* replacement);
+
+ private:
+  class StaticMeta;
+
+  static StaticMeta* Instance();
+
+  const uint32_t id_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
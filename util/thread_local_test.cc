@@ -0,0 +1,122 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+namespace {
+
+std::atomic<int> unref_count(0);
+
+void CountUnref(void* ptr) { unref_count.fetch_add(1); }
+
+}  // namespace
+
+TEST(ThreadLocalTest, Empty) {
+  ThreadLocalPtr tls;
+  ASSERT_EQ(nullptr, tls.Get());
+  std::vector<void*> ptrs;
+  tls.Scrape(&ptrs, nullptr);
+  ASSERT_TRUE(ptrs.empty());
+}
+
+TEST(ThreadLocalTest, SwapAndCompareAndSwap) {
+  int a, b;
+  ThreadLocalPtr tls;
+  tls.Reset(&a);
+  ASSERT_EQ(&a, tls.Get());
+  ASSERT_EQ(&a, tls.Swap(&b));
+  ASSERT_EQ(&b, tls.Get());
+
+  void* expected = &a;
+  ASSERT_FALSE(tls.CompareAndSwap(nullptr, expected));
+  ASSERT_EQ(&b, expected);
+  ASSERT_TRUE(tls.CompareAndSwap(nullptr, expected));
+  ASSERT_EQ(nullptr, tls.Get());
+}
+
+TEST(ThreadLocalTest, SeparateInstances) {
+  int a, b;
+  ThreadLocalPtr tls1;
+  ThreadLocalPtr tls2;
+  tls1.Reset(&a);
+  tls2.Reset(&b);
+  ASSERT_EQ(&a, tls1.Get());
+  ASSERT_EQ(&b, tls2.Get());
+}
+
+TEST(ThreadLocalTest, SeparateThreads) {
+  static const int kNumThreads = 4;
+  int values[kNumThreads];
+  ThreadLocalPtr tls;
+  int main_value;
+  tls.Reset(&main_value);
+
+  std::atomic<int> ready(0);
+  std::atomic<bool> done(false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([&, i]() {
+      ASSERT_EQ(nullptr, tls.Get());
+      tls.Reset(&values[i]);
+      ready.fetch_add(1);
+      while (!done.load()) {
+        std::this_thread::yield();
+      }
+      ASSERT_EQ(nullptr, tls.Get());  // Scraped
+    });
+  }
+  while (ready.load() < kNumThreads) {
+    std::this_thread::yield();
+  }
+  ASSERT_EQ(&main_value, tls.Get());
+
+  std::vector<void*> ptrs;
+  tls.Scrape(&ptrs, nullptr);
+  done.store(true);
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(kNumThreads + 1, ptrs.size());
+  ASSERT_EQ(nullptr, tls.Get());
+  for (int i = 0; i < kNumThreads; i++) {
+    ASSERT_NE(ptrs.end(), std::find(ptrs.begin(), ptrs.end(), &values[i]));
+  }
+}
+
+TEST(ThreadLocalTest, UnrefOnThreadExit) {
+  int value;
+  ThreadLocalPtr tls(&CountUnref);
+  unref_count.store(0);
+  std::thread([&]() { tls.Reset(&value); }).join();
+  ASSERT_EQ(1, unref_count.load());
+
+  // Threads that leave no pointer behind are not reported.
+  std::thread([&]() {
+    tls.Reset(&value);
+    tls.Reset(nullptr);
+  }).join();
+  ASSERT_EQ(1, unref_count.load());
+}
+
+TEST(ThreadLocalTest, ReusedId) {
+  int value;
+  {
+    ThreadLocalPtr tls;
+    tls.Reset(&value);
+  }
+  // Whatever id the new instance gets, it starts out empty.
+  ThreadLocalPtr tls;
+  ASSERT_EQ(nullptr, tls.Get());
+}
+
+}  // namespace leveldb